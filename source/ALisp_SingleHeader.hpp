@@ -19,6 +19,15 @@
 #include "MathFunctions.cpp"
 #include "SequenceFunctions.cpp"
 #include "StringFunctions.cpp"
+#include "Regex.cpp"
+#include "Format.cpp"
+#include "Rope.cpp"
+#include "Backquote.cpp"
+#include "SpecialForms.cpp"
+#include "LoopFunctions.cpp"
+#include "Optimizer.cpp"
+#include "Buffer.cpp"
+#include "BufferFunctions.cpp"
 #include "Function.cpp"
 #include "Object.cpp"
 #include "FArgs.cpp"
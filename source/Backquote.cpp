@@ -0,0 +1,109 @@
+#include "Backquote.hpp"
+#include "ConsCellObject.hpp"
+#include "Machine.hpp"
+#include "SymbolObject.hpp"
+#include "alisp.hpp"
+
+namespace alisp
+{
+
+ALISP_INLINE BackquoteTemplate::BackquoteTemplate(Machine& machine, const Object& templ) :
+    m_machine(machine),
+    m_comma(machine.getSymbol(",")),
+    m_splice(machine.getSymbol(",@"))
+{
+    m_root = compile(templ);
+}
+
+ALISP_INLINE BackquoteTemplate::Node BackquoteTemplate::compile(const Object& obj) const
+{
+    Node node;
+    if (!obj.isList() || obj.isNil()) {
+        node.object = obj.clone();
+        return node;
+    }
+    const ConsCellObject& list = *obj.asList();
+    if (list.car() == m_comma || list.car() == m_splice) {
+        // There is no list to splice into at the top, so ,@ is the same as , there.
+        node.kind = Node::Kind::Unquote;
+        node.object = list.cadr()->clone();
+        return node;
+    }
+
+    node.kind = Node::Kind::List;
+    bool constant = true;
+    for (const ConsCell* cell = list.cc.get(); cell; cell = cell->next()) {
+        if (cell != list.cc.get() && cell->car.get() == m_comma && cell->next()) {
+            // `(a . ,b) is read as (a \, b), so the rest of the list is the unquoted cdr.
+            node.tail = std::make_unique<Node>();
+            node.tail->kind = Node::Kind::Unquote;
+            node.tail->object = cell->next()->car->clone();
+            constant = false;
+            break;
+        }
+        node.elements.push_back(compileElement(*cell->car));
+        constant = constant && node.elements.back().kind == Node::Kind::Constant;
+        if (cell->dotted()) {
+            node.tail = std::make_unique<Node>(compile(*cell->dotted()));
+            constant = constant && node.tail->kind == Node::Kind::Constant;
+        }
+    }
+    if (constant) {
+        Node shared;
+        shared.object = obj.clone();
+        return shared;
+    }
+    return node;
+}
+
+ALISP_INLINE BackquoteTemplate::Node BackquoteTemplate::compileElement(const Object& obj) const
+{
+    if (obj.isList() && !obj.isNil() && obj.asList()->car() == m_splice) {
+        Node node;
+        node.kind = Node::Kind::Splice;
+        node.object = obj.asList()->cadr()->clone();
+        return node;
+    }
+    return compile(obj);
+}
+
+ALISP_INLINE ObjectPtr BackquoteTemplate::fill(const Node& node) const
+{
+    switch (node.kind) {
+    case Node::Kind::Constant:
+        return node.object->clone();
+    case Node::Kind::Unquote:
+    case Node::Kind::Splice:
+        return node.object->eval();
+    case Node::Kind::List:
+        break;
+    }
+
+    ListBuilder builder(m_machine);
+    for (const Node& element : node.elements) {
+        if (element.kind != Node::Kind::Splice) {
+            builder.append(fill(element));
+            continue;
+        }
+        ObjectPtr value = element.object->eval();
+        if (!value->isList()) {
+            builder.append(std::move(value));
+            continue;
+        }
+        for (const Object& obj : *value->asList()) {
+            builder.append(obj.clone());
+        }
+    }
+    if (node.tail) {
+        ObjectPtr tail = fill(*node.tail);
+        if (!builder.tail()) {
+            return tail;
+        }
+        if (!tail->isNil()) {
+            builder.dot(std::move(tail));
+        }
+    }
+    return builder.get();
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "Object.hpp"
+#include "Symbol.hpp"
+#include <memory>
+#include <vector>
+
+namespace alisp
+{
+
+class Machine;
+
+// A backquote template taken apart once into a plan for building lists from it: which forms
+// are evaluated and where their values go. Parts of the template without commas are shared by
+// all the lists built from it instead of being copied, as in Emacs.
+class BackquoteTemplate
+{
+    struct Node
+    {
+        enum class Kind
+        {
+            Constant, // object as it is
+            Unquote,  // value of object
+            Splice,   // elements of the value of object, in a list only
+            List      // elements filled in, followed by tail if there is one
+        };
+
+        Kind kind = Kind::Constant;
+        ObjectPtr object;
+        std::vector<Node> elements;
+        std::unique_ptr<Node> tail;
+    };
+
+    Machine& m_machine;
+    std::shared_ptr<Symbol> m_comma;
+    std::shared_ptr<Symbol> m_splice;
+    Node m_root;
+
+    Node compile(const Object& obj) const;
+    Node compileElement(const Object& obj) const;
+    ObjectPtr fill(const Node& node) const;
+public:
+    BackquoteTemplate(Machine& machine, const Object& templ);
+
+    // A new list from the template, with the values of the forms after the commas.
+    ObjectPtr fill() const { return fill(m_root); }
+};
+
+}
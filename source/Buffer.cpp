@@ -0,0 +1,197 @@
+#include "Buffer.hpp"
+#include "Error.hpp"
+#include "UTF8.hpp"
+#include "alisp.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace alisp
+{
+
+ALISP_INLINE size_t Buffer::charLength(size_t offset) const
+{
+    const size_t end = bytes();
+    size_t i = offset + 1;
+    while (i < end && !utf8::kernels::startsCharacter(byteAt(i))) {
+        i++;
+    }
+    return i - offset;
+}
+
+ALISP_INLINE size_t Buffer::charStartBefore(size_t offset) const
+{
+    do {
+        offset--;
+    } while (offset > 0 && !utf8::kernels::startsCharacter(byteAt(offset)));
+    return offset;
+}
+
+ALISP_INLINE size_t Buffer::byteOffset(size_t chars) const
+{
+    if (m_chars == bytes()) {
+        return chars;
+    }
+
+    // Walk from whichever known position is closest: the beginning, point or the end.
+    size_t fromChars = 0, fromByte = 0;
+    auto distance = [chars](size_t c) { return c > chars ? c - chars : chars - c; };
+    if (distance(m_point) < distance(fromChars)) {
+        fromChars = m_point;
+        fromByte = m_pointByte;
+    }
+    if (distance(m_chars) < distance(fromChars)) {
+        fromChars = m_chars;
+        fromByte = bytes();
+    }
+    for (; fromChars < chars; fromChars++) {
+        fromByte += charLength(fromByte);
+    }
+    for (; fromChars > chars; fromChars--) {
+        fromByte = charStartBefore(fromByte);
+    }
+    return fromByte;
+}
+
+ALISP_INLINE void Buffer::moveGap(size_t offset)
+{
+    if (offset < m_gapStart) {
+        const size_t n = m_gapStart - offset;
+        std::memmove(m_data.data() + m_gapEnd - n, m_data.data() + offset, n);
+        m_gapStart -= n;
+        m_gapEnd -= n;
+    }
+    else if (offset > m_gapStart) {
+        const size_t n = offset - m_gapStart;
+        std::memmove(m_data.data() + m_gapStart, m_data.data() + m_gapEnd, n);
+        m_gapStart += n;
+        m_gapEnd += n;
+    }
+}
+
+ALISP_INLINE void Buffer::reserveGap(size_t size)
+{
+    if (m_gapEnd - m_gapStart >= size) {
+        return;
+    }
+    const size_t after = m_data.size() - m_gapEnd;
+    const size_t capacity = std::max(m_data.size() * 2, bytes() + size + 64);
+    std::vector<char> data(capacity);
+    if (!m_data.empty()) { // An empty vector need not have any storage to copy from
+        std::memcpy(data.data(), m_data.data(), m_gapStart);
+        std::memcpy(data.data() + capacity - after, m_data.data() + m_gapEnd, after);
+    }
+    m_data = std::move(data);
+    m_gapEnd = capacity - after;
+}
+
+ALISP_INLINE void Buffer::checkPosition(std::int64_t pos) const
+{
+    if (pos < pointMin() || pos > pointMax()) {
+        throw exceptions::ArgsOutOfRange(std::to_string(pos));
+    }
+}
+
+ALISP_INLINE std::int64_t Buffer::gotoChar(std::int64_t pos)
+{
+    pos = std::clamp(pos, pointMin(), pointMax());
+    m_pointByte = byteOffset(pos - 1);
+    m_point = pos - 1;
+    return pos;
+}
+
+ALISP_INLINE void Buffer::insert(const std::string& text)
+{
+    moveGap(m_pointByte);
+    reserveGap(text.size());
+    std::memcpy(m_data.data() + m_gapStart, text.data(), text.size());
+    m_gapStart += text.size();
+    const size_t chars = utf8::countChars(text.data(), text.size());
+    m_chars += chars;
+    m_point += chars;
+    m_pointByte += text.size();
+}
+
+ALISP_INLINE void Buffer::deleteRegion(std::int64_t start, std::int64_t end)
+{
+    checkPosition(start);
+    checkPosition(end);
+    if (start > end) {
+        std::swap(start, end);
+    }
+    const size_t from = start - 1, to = end - 1;
+    const size_t fromByte = byteOffset(from);
+    size_t toByte = fromByte;
+    if (m_chars == bytes()) {
+        toByte = to;
+    }
+    else {
+        for (size_t i = from; i < to; i++) {
+            toByte += charLength(toByte);
+        }
+    }
+    moveGap(fromByte);
+    m_gapEnd += toByte - fromByte;
+    m_chars -= to - from;
+    if (m_point >= to) {
+        m_point -= to - from;
+        m_pointByte -= toByte - fromByte;
+    }
+    else if (m_point > from) {
+        m_point = from;
+        m_pointByte = fromByte;
+    }
+}
+
+ALISP_INLINE void Buffer::erase()
+{
+    m_data.clear();
+    m_gapStart = m_gapEnd = 0;
+    m_chars = m_point = m_pointByte = 0;
+}
+
+ALISP_INLINE std::string Buffer::substring(std::int64_t start, std::int64_t end) const
+{
+    checkPosition(start);
+    checkPosition(end);
+    if (start > end) {
+        std::swap(start, end);
+    }
+    const size_t from = byteOffset(start - 1), to = byteOffset(end - 1);
+    std::string ret;
+    ret.reserve(to - from);
+    if (from < m_gapStart) {
+        ret.append(m_data.data() + from, std::min(to, m_gapStart) - from);
+    }
+    if (to > m_gapStart) {
+        const size_t gap = m_gapEnd - m_gapStart;
+        const size_t afterFrom = std::max(from, m_gapStart);
+        ret.append(m_data.data() + afterFrom + gap, to - afterFrom);
+    }
+    return ret;
+}
+
+ALISP_INLINE std::pair<std::int64_t, std::int64_t> Buffer::searchForward(const std::string& text,
+                                                                         std::int64_t bound)
+{
+    if (bound <= point()) {
+        if (text.empty() && bound == point()) {
+            return {bound, bound};
+        }
+        return {0, 0};
+    }
+
+    // Moving the gap to point makes the text after it contiguous, and the gap tends to be near
+    // point anyway since that is where insertions happen.
+    moveGap(m_pointByte);
+    const size_t length = byteOffset(bound - 1) - m_pointByte;
+    const std::string_view after(m_data.data() + m_gapEnd, length);
+    const size_t found = after.find(text);
+    if (found == std::string_view::npos) {
+        return {0, 0};
+    }
+    const std::int64_t start = point() + utf8::countChars(after.data(), found);
+    return {start, start + static_cast<std::int64_t>(utf8::countChars(text.data(), text.size()))};
+}
+
+}
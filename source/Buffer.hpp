@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace alisp
+{
+
+// Text being edited, stored in a gap buffer. The gap is kept where the last edit happened so
+// that a run of edits around the same place costs only the size of each edit. Positions are
+// counted in characters from 1 as in Emacs, while the text itself is UTF-8.
+class Buffer
+{
+    std::vector<char> m_data;
+    size_t m_gapStart = 0; // Byte offsets of the gap in m_data
+    size_t m_gapEnd = 0;
+    size_t m_chars = 0;    // Length of the text in characters
+    size_t m_point = 0;    // Point as a character offset from the beginning
+    size_t m_pointByte = 0;
+
+    size_t bytes() const { return m_data.size() - (m_gapEnd - m_gapStart); }
+    char byteAt(size_t offset) const
+    {
+        return m_data[offset < m_gapStart ? offset : offset + m_gapEnd - m_gapStart];
+    }
+    size_t charLength(size_t offset) const;
+    size_t charStartBefore(size_t offset) const;
+    size_t byteOffset(size_t chars) const;
+    void moveGap(size_t offset);
+    void reserveGap(size_t size);
+public:
+    std::string name;
+
+    Buffer(std::string name) : name(std::move(name)) {}
+
+    size_t size() const { return m_chars; }
+    std::int64_t point() const { return static_cast<std::int64_t>(m_point) + 1; }
+    std::int64_t pointMin() const { return 1; }
+    std::int64_t pointMax() const { return static_cast<std::int64_t>(m_chars) + 1; }
+
+    // Moves point, clamped to the accessible text. Returns the new position.
+    std::int64_t gotoChar(std::int64_t pos);
+
+    // Inserts text at point and moves point past it.
+    void insert(const std::string& text);
+
+    // Deletes text between two positions given in either order.
+    void deleteRegion(std::int64_t start, std::int64_t end);
+    void erase();
+
+    std::string substring(std::int64_t start, std::int64_t end) const;
+    std::string toString() const { return substring(pointMin(), pointMax()); }
+
+    // Finds the next occurrence of the text at or after point, ending no later than bound.
+    // Returns the positions where the match starts and ends, or zeros if there is none.
+    std::pair<std::int64_t, std::int64_t> searchForward(const std::string& text,
+                                                        std::int64_t bound);
+
+    // Throws when the position is outside the text.
+    void checkPosition(std::int64_t pos) const;
+};
+
+}
@@ -0,0 +1,144 @@
+#include "AtScopeExit.hpp"
+#include "Buffer.hpp"
+#include "BufferObject.hpp"
+#include "Error.hpp"
+#include "Machine.hpp"
+#include "Object.hpp"
+#include "StringObject.hpp"
+#include "UTF8.hpp"
+#include "alisp.hpp"
+#include <limits>
+
+namespace alisp
+{
+
+ALISP_INLINE void Machine::initBufferFunctions()
+{
+    m_currentBuffer = std::make_shared<Buffer>("*scratch*");
+    m_buffers[m_currentBuffer->name] = m_currentBuffer;
+
+    // Buffers can be referred to either by the object or by name. Returns null for a name
+    // which no buffer has.
+    auto getBuffer = [this](const Object& obj) -> std::shared_ptr<Buffer> {
+        if (auto buffer = dynamic_cast<const BufferObject*>(&obj)) {
+            return buffer->value;
+        }
+        if (!obj.isString()) {
+            throw exceptions::WrongTypeArgument(obj.toString());
+        }
+        const auto it = m_buffers.find(obj.value<std::string>());
+        return it == m_buffers.end() ? nullptr : it->second;
+    };
+    auto requireBuffer = [getBuffer](const Object& obj) {
+        auto buffer = getBuffer(obj);
+        if (!buffer) {
+            throw exceptions::Error("No such buffer " + obj.toString(true));
+        }
+        return buffer;
+    };
+    auto optionalBuffer = [this, requireBuffer](const std::optional<ObjectPtr>& obj) {
+        return obj && !(*obj)->isNil() ? requireBuffer(**obj) : m_currentBuffer;
+    };
+    defun("get-buffer-create", [this, getBuffer](const Object& bufferOrName) -> ObjectPtr {
+        auto buffer = getBuffer(bufferOrName);
+        if (!buffer) {
+            buffer = std::make_shared<Buffer>(bufferOrName.value<std::string>());
+            m_buffers[buffer->name] = buffer;
+        }
+        return std::make_unique<BufferObject>(buffer);
+    });
+    defun("get-buffer", [this, getBuffer](const Object& bufferOrName) -> ObjectPtr {
+        auto buffer = getBuffer(bufferOrName);
+        return buffer ? std::make_unique<BufferObject>(buffer) : makeNil();
+    });
+    defun("bufferp", [](const Object& obj) { return !!dynamic_cast<const BufferObject*>(&obj); });
+    defun("current-buffer", [this]() -> ObjectPtr {
+        return std::make_unique<BufferObject>(m_currentBuffer);
+    });
+    defun("set-buffer", [this, requireBuffer](const Object& bufferOrName) -> ObjectPtr {
+        m_currentBuffer = requireBuffer(bufferOrName);
+        return std::make_unique<BufferObject>(m_currentBuffer);
+    });
+    makeFunc("with-current-buffer", 1, std::numeric_limits<int>::max(),
+             [this, requireBuffer](FArgs& args) {
+        auto buffer = requireBuffer(*args.pop());
+        const auto previous = m_currentBuffer;
+        m_currentBuffer = buffer;
+        AtScopeExit onExit([this, previous]() { m_currentBuffer = previous; });
+        return args.hasNext() ? args.evalAll() : makeNil();
+    });
+    defun("buffer-name", [this, optionalBuffer](std::optional<ObjectPtr> buffer) -> ObjectPtr {
+        const auto b = optionalBuffer(buffer);
+        if (m_buffers.find(b->name) == m_buffers.end()) {
+            return makeNil();
+        }
+        return makeObject(b->name);
+    });
+    defun("kill-buffer", [this, optionalBuffer](std::optional<ObjectPtr> bufferOrName) {
+        const auto buffer = optionalBuffer(bufferOrName);
+        m_buffers.erase(buffer->name);
+        if (buffer == m_currentBuffer) {
+            const auto it = m_buffers.begin();
+            m_currentBuffer = it != m_buffers.end() ? it->second :
+                std::make_shared<Buffer>("*scratch*");
+            m_buffers[m_currentBuffer->name] = m_currentBuffer;
+        }
+        return true;
+    });
+    defun("insert", [this](Rest& args) {
+        for (auto obj : args) {
+            if (obj->isString()) {
+                m_currentBuffer->insert(obj->value<std::string>());
+            }
+            else if (obj->isCharacter()) {
+                m_currentBuffer->insert(utf8::encode(obj->value<std::uint32_t>()));
+            }
+            else {
+                throw exceptions::WrongTypeArgument(obj->toString());
+            }
+        }
+    });
+    defun("delete-region", [this](std::int64_t start, std::int64_t end) {
+        m_currentBuffer->deleteRegion(start, end);
+    });
+    defun("erase-buffer", [this]() { m_currentBuffer->erase(); });
+    defun("goto-char", [this](std::int64_t pos) { return m_currentBuffer->gotoChar(pos); });
+    defun("point", [this]() { return m_currentBuffer->point(); });
+    defun("point-min", [this]() { return m_currentBuffer->pointMin(); });
+    defun("point-max", [this]() { return m_currentBuffer->pointMax(); });
+    defun("buffer-size", [optionalBuffer](std::optional<ObjectPtr> buffer) {
+        return optionalBuffer(buffer)->size();
+    });
+    defun("buffer-substring", [this](std::int64_t start, std::int64_t end) {
+        return m_currentBuffer->substring(start, end);
+    });
+    defun("buffer-string", [this]() { return m_currentBuffer->toString(); });
+    defun("search-forward", [this](const std::string& str,
+                                   std::optional<std::int64_t> bound,
+                                   std::optional<ObjectPtr> noError) -> ObjectPtr {
+        // Like in Emacs, a failed search signals unless noerror is given. With t point stays
+        // where it was and with any other non-nil value it moves to the bound.
+        Buffer& buffer = *m_currentBuffer;
+        const std::int64_t limit = bound ? *bound : buffer.pointMax();
+        if (bound && limit < buffer.point()) {
+            throw exceptions::Error("Invalid search bound (wrong side of point)");
+        }
+        buffer.checkPosition(limit);
+        const auto match = buffer.searchForward(str, limit);
+        if (!match.first) {
+            if (!noError || (*noError)->isNil()) {
+                throw exceptions::SearchFailed(str);
+            }
+            if (!(*noError)->eq(*makeTrue())) {
+                buffer.gotoChar(limit);
+            }
+            return makeNil();
+        }
+        m_matchData = { match.first, match.second };
+        m_matchString = std::nullopt;
+        m_matchBuffer = m_currentBuffer;
+        return makeInt(buffer.gotoChar(match.second));
+    });
+}
+
+}
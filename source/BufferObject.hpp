@@ -0,0 +1,21 @@
+#pragma once
+#include "SharedValueObject.hpp"
+#include "Buffer.hpp"
+
+namespace alisp
+{
+
+struct BufferObject : SharedValueObject<Buffer>
+{
+    BufferObject(std::shared_ptr<Buffer> buffer) : SharedValueObject<Buffer>(buffer) { }
+
+    std::unique_ptr<Object> clone() const override
+    {
+        return std::make_unique<BufferObject>(value);
+    }
+
+    std::string toString(bool) const override { return "#<buffer " + value->name + ">"; }
+    std::string typeOf() const override { return "buffer"; }
+};
+
+}
@@ -1,5 +1,5 @@
 #include "alisp.hpp"
-#include <vector>
+#include <algorithm>
 #include "ConsCellObject.hpp"
 
 namespace alisp
@@ -10,40 +10,77 @@ ALISP_INLINE void ConsCell::iterateList(std::function<bool(Object* car,
                                                  Object* dotcdr)> f) const
 {
     auto p = this;
-    std::set<const ConsCell*> traversed;
+    CycleDetector detector(p);
     bool circular = false;
     Object* dotcdr = nullptr;
     while (p && p->car) {
-        if (traversed.count(p)) {
-            circular = true;
-        }
-        if (p->cdr && !p->cdr->isList()) {
-            dotcdr = p->cdr.get();
+        if (p->dotted()) {
+            dotcdr = p->dotted();
         }
         if (!f(p->car.get(), circular, dotcdr)) {
             return;
         }
-        traversed.insert(p);
         p = p->next();
+        if (p && detector.step(p)) {
+            circular = true;
+        }
     }
 }
 
-ALISP_INLINE const ConsCell* ConsCell::next() const
+ALISP_INLINE ConsCell::~ConsCell()
 {
-    auto cc = dynamic_cast<ConsCellObject*>(this->cdr.get());
-    if (cc) {
-        return cc->cc.get();
+    // Free the rest of the list one cell at a time instead of recursing once per cell.
+    ConsCellPtr next = std::move(m_next);
+    while (next && next->refCount == 1) {
+        ConsCellPtr after = std::move(next->m_next);
+        next = std::move(after);
     }
-    return nullptr;
+    memoryStats().destroyed(MemoryKind::ConsCell);
+}
+
+ALISP_INLINE void ConsCell::setNext(ConsCellPtr next)
+{
+    m_dotted.reset();
+    m_next = std::move(next);
 }
 
-ALISP_INLINE ConsCell* ConsCell::next()
+ALISP_INLINE void ConsCell::setCdr(std::unique_ptr<Object> cdr)
 {
-    auto cc = dynamic_cast<ConsCellObject*>(this->cdr.get());
-    if (cc) {
-        return cc->cc.get();
+    if (cdr && cdr->isList()) {
+        ConsCellObject* list = cdr->asList();
+        setNext(list->isNil() ? nullptr : std::move(list->cc));
+        return;
+    }
+    m_next = nullptr;
+    m_dotted = std::move(cdr);
+}
+
+ALISP_INLINE void ConsCell::copyCdr(const ConsCell& from)
+{
+    if (from.m_dotted) {
+        setCdr(from.m_dotted->clone());
+    }
+    else {
+        setNext(from.m_next);
+    }
+}
+
+ALISP_INLINE std::unique_ptr<Object> ConsCell::cdr(Machine& machine) const
+{
+    if (m_dotted) {
+        return m_dotted->clone();
+    }
+    return std::make_unique<ConsCellObject>(m_next, &machine);
+}
+
+ALISP_INLINE void releaseRef(ConsCell* cell)
+{
+    if (cell->refCount > 1) {
+        collectCycles(cell);
+    }
+    if (--cell->refCount == 0) {
+        delete cell;
     }
-    return nullptr;
 }
 
 ALISP_INLINE void ConsCell::traverse(const std::function<bool(const ConsCell*)>& f) const
@@ -63,31 +100,95 @@ ALISP_INLINE void ConsCell::traverse(const std::function<bool(const ConsCell*)>&
     }
 }
 
-ALISP_STATIC bool traverseCycle(const ConsCell* cc,
-                                std::vector<const ConsCell*>& visited,
-                                size_t d)
+ALISP_INLINE ConsCell::Chain ConsCell::chain(const Chain* outer) const
 {
-    size_t added = 0;
-    while (cc) {
-        assert(cc && cc->car);
-        //if (cc->car->isInt()) {
-        //    std::cout << std::string(d, ' ') << cc->car->toString() << " " << cc << " "
-        //              << visited.size() << std::endl;
-        //}
-        if (std::find(visited.begin(), visited.end(), cc) != visited.end()) {
-            return true;
+    Chain c;
+    c.head = this;
+    c.outer = outer;
+    if (!*this) {
+        return c;
+    }
+    CycleDetector detector(this);
+    const ConsCell* p = this;
+    const ConsCell* last = this;
+    size_t count = 1;
+    while ((p = p->next())) {
+        if (detector.step(p)) {
+            c.circular = true;
+            break;
+        }
+        last = p;
+        count++;
+    }
+    if (!c.circular) {
+        c.key = last;
+        c.length = count;
+        return c;
+    }
+
+    // p is somewhere in the cycle. Measure the cycle and then find where it starts by
+    // walking two pointers which are exactly one cycle length apart.
+    size_t cycleLength = 0;
+    const ConsCell* q = p;
+    c.key = p;
+    do {
+        c.key = std::min(c.key, q, std::less<const ConsCell*>());
+        q = q->next();
+        cycleLength++;
+    } while (q != p);
+    const ConsCell* lead = this;
+    for (size_t i = 0; i < cycleLength; i++) {
+        lead = lead->next();
+    }
+    size_t cycleStart = 0;
+    for (q = this; q != lead; q = q->next(), lead = lead->next()) {
+        cycleStart++;
+    }
+    c.length = cycleStart + cycleLength;
+    return c;
+}
+
+ALISP_INLINE std::optional<size_t> ConsCell::Chain::indexOf(const ConsCell* cell) const
+{
+    const ConsCell* p = head;
+    for (size_t i = 0; i < length; i++, p = p->next()) {
+        if (p == cell) {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+ALISP_INLINE std::optional<size_t> ConsCell::Chain::backReference() const
+{
+    // A cell can only be part of another chain if both chains end the same way, which lets
+    // us skip the linear search for unrelated chains.
+    for (const Chain* o = outer; o; o = o->outer) {
+        if (o->key != key) {
+            continue;
+        }
+        const auto index = o->indexOf(head);
+        if (index && (*index <= o->position || o->circular)) {
+            return index;
         }
-        visited.push_back(cc);
-        added++;
-        if (cc->car && cc->car->isList() && !cc->car->isNil()) {
-            if (traverseCycle(cc->car->asList()->cc.get(), visited, d+1)) {
+    }
+    return std::nullopt;
+}
+
+ALISP_STATIC bool isCyclical(ConsCell::Chain& chain)
+{
+    if (chain.circular) {
+        return true;
+    }
+    const ConsCell* p = chain.head;
+    for (size_t i = 0; i < chain.length; i++, p = p->next()) {
+        chain.position = i;
+        if (p->car && p->car->isList() && !p->car->isNil()) {
+            ConsCell::Chain inner = p->car->asList()->cc->chain(&chain);
+            if (inner.backReference() || isCyclical(inner)) {
                 return true;
             }
         }
-        cc = cc->next();
-    }
-    for (size_t i=0;i<added;i++) {
-        visited.pop_back();
     }
     return false;
 }
@@ -97,8 +198,8 @@ ALISP_INLINE bool ConsCell::isCyclical() const
     if (!*this) {
         return false;
     }
-    std::vector<const ConsCell*> visited;
-    return traverseCycle(this, visited, 0);
+    Chain c = chain();
+    return alisp::isCyclical(c);
 }
 
 }
@@ -1,19 +1,79 @@
 #pragma once
+#include <cstddef>
 #include <memory>
 #include <functional>
+#include <optional>
+#include "MemoryStats.hpp"
+#include "ObjectPtr.hpp"
+#include "RefCounted.hpp"
 
 namespace alisp
 {
 
 struct Object;
+class Machine;
+struct ConsCell;
+using ConsCellPtr = RefPtr<ConsCell>;
 
-struct ConsCell
+// Brent's cycle detection for walks along a cdr chain. The tortoise teleports to the hare
+// every time the hare has taken a power of two steps, so a cycle is detected in linear time
+// without remembering the visited cells. Call step() with every cell the walk advances to.
+struct CycleDetector
+{
+    const ConsCell* tortoise;
+    size_t power = 2;
+    size_t countdown = 2;
+
+    CycleDetector(const ConsCell* head) : tortoise(head) {}
+
+    bool step(const ConsCell* cell)
+    {
+        if (--countdown == 0) {
+            power *= 2;
+            countdown = power;
+            tortoise = cell;
+            return false;
+        }
+        return cell == tortoise;
+    }
+};
+
+// A cons cell carries its own reference count so that a cell takes a single allocation. The
+// cdr is a direct link to the next cell, which makes walking a list plain pointer chasing.
+// Only the last cell of a dotted list stores its cdr as an object.
+struct ConsCell : RefCounted
 {
     std::unique_ptr<Object> car;
-    std::unique_ptr<Object> cdr;
 
-    const ConsCell* next() const;
-    ConsCell* next();
+    ConsCell() { memoryStats().created(MemoryKind::ConsCell); }
+    ConsCell(const ConsCell&) = delete;
+    ConsCell& operator=(const ConsCell&) = delete;
+    ~ConsCell();
+
+    static void* operator new(std::size_t size)
+    {
+        memoryStats().allocated(MemoryKind::ConsCell, size);
+        return ::operator new(size);
+    }
+
+    static void operator delete(void* ptr, std::size_t size)
+    {
+        memoryStats().freed(MemoryKind::ConsCell, size);
+        ::operator delete(ptr);
+    }
+
+    const ConsCell* next() const { return m_next.get(); }
+    ConsCell* next() { return m_next.get(); }
+    const ConsCellPtr& nextCell() const { return m_next; }
+    Object* dotted() const { return m_dotted.get(); }
+    bool hasCdr() const { return m_next || m_dotted; }
+    void setNext(ConsCellPtr next);
+    void setCdr(std::unique_ptr<Object> cdr);
+    void copyCdr(const ConsCell& from);
+    std::unique_ptr<Object> cdr(Machine& machine) const;
+    std::unique_ptr<Object> takeCar() { return std::move(car); }
+    ConsCellPtr takeNext() { return std::move(m_next); }
+    std::unique_ptr<Object> takeDotted() { return std::move(m_dotted); }
     bool operator!() const { return !car; }
 
     void iterateList(std::function<bool(Object* car, bool isCircular, Object* dotcdr)> f) const;
@@ -61,8 +121,33 @@ struct ConsCell
     ConstIterator begin() const { return !*this ? end() : ConstIterator{this}; }
     ConstIterator end() const { return ConstIterator{nullptr}; }
 
+    // The cdr chain starting from a cell. Chains of nested walks live on the C++ stack and
+    // point to the chain whose car led to them, so back references through cars can be
+    // detected without allocating.
+    struct Chain
+    {
+        const ConsCell* head = nullptr;
+        size_t length = 0; // Number of distinct cells.
+        bool circular = false;
+        const ConsCell* key = nullptr; // Last cell, or the lowest addressed cell of the cycle.
+        const Chain* outer = nullptr;
+        size_t position = 0; // Index of the cell currently being visited.
+
+        std::optional<size_t> indexOf(const ConsCell* cell) const;
+        std::optional<size_t> backReference() const;
+    };
+
+    Chain chain(const Chain* outer = nullptr) const;
     void traverse(const std::function<bool(const ConsCell*)>& f) const;
     bool isCyclical() const;
+
+private:
+    ConsCellPtr m_next;
+    std::unique_ptr<Object> m_dotted;
 };
 
+// Dropping a reference to a cell which is still referenced elsewhere may leave behind an
+// unreachable cycle, so releasing a cell goes through the cycle collector.
+void releaseRef(ConsCell* cell);
+
 }
@@ -8,24 +8,25 @@
 #include "FArgs.hpp"
 #include "Function.hpp"
 #include <cstring>
+#include <exception>
 #include <stdexcept>
 
 namespace alisp
 {
 
-ALISP_INLINE Object* ConsCellObject::cadr() const
+ALISP_INLINE std::unique_ptr<Object> makeNil(Machine* parent)
 {
-    return cdr() && cdr()->isList() ? cdr()->asList()->car() : nullptr;
+    return parent ? parent->makeNil() : std::make_unique<ConsCellObject>(parent);
 }
 
-ALISP_INLINE const ConsCellObject* ConsCellObject::next() const
+ALISP_INLINE ObjectPtr ConsCellObject::cdr() const
 {
-    return cdr() && cdr()->isList() ? cdr()->asList() : nullptr;
+    return cc ? cc->cdr(*parent) : makeNil(parent);
 }
 
-ALISP_INLINE ConsCellObject* ConsCellObject::next()
+ALISP_INLINE Object* ConsCellObject::cadr() const
 {
-    return cdr() && cdr()->isList() ? cdr()->asList() : nullptr;
+    return cc && cc->next() ? cc->next()->car.get() : nullptr;
 }
 
 ALISP_INLINE ObjectPtr ConsCellObject::copy() const
@@ -75,13 +76,10 @@ ALISP_INLINE ObjectPtr ConsCellObject::reverse() const
         else if (dotted) {
             throw exceptions::WrongTypeArgument(toString());
         }
-        auto prev = reversed->cc;
-        auto newcc = std::make_shared<ConsCell>();
+        auto newcc = ConsCellPtr::make();
         newcc->car = obj->clone();
-        newcc->cdr =
-            (prev && (prev->car || prev->cdr)) ?
-            std::make_unique<ConsCellObject>(prev, parent) : nullptr;
-        reversed->cc = newcc;
+        newcc->setNext(std::move(reversed->cc));
+        reversed->cc = std::move(newcc);
         return true;
     });
     return reversed;
@@ -131,8 +129,8 @@ ALISP_INLINE std::shared_ptr<Function> ConsCellObject::resolveFunction() const
         auto func = std::make_shared<Function>(*parent);
         auto cc = this->cc->next();
         std::shared_ptr<ConsCellObject> closure =
-            parent->makeConsCell(cc->car->clone(), cc->cdr->clone());
-        const FuncParams fp = getFuncParams(*closure->cdr()->asList());
+            parent->makeConsCell(cc->car->clone(), cc->cdr(*parent));
+        const FuncParams fp = getFuncParams(*closure->cc->next());
         func->minArgs = fp.min;
         func->maxArgs = fp.max;
         func->func = [&m, closure](FArgs& a) {
@@ -146,8 +144,8 @@ ALISP_INLINE std::shared_ptr<Function> ConsCellObject::resolveFunction() const
         auto func = std::make_shared<Function>(*parent);
         auto cc = this->cc->next();
         std::shared_ptr<ConsCellObject> closure =
-            parent->makeConsCell(cc->car->clone(), cc->cdr->clone());
-        const FuncParams fp = getFuncParams(*closure);
+            parent->makeConsCell(cc->car->clone(), cc->cdr(*parent));
+        const FuncParams fp = getFuncParams(*closure->cc);
         func->minArgs = fp.min;
         func->maxArgs = fp.max;
         func->func = [&m, closure](FArgs& a) { return m.execute(*closure, a); };
@@ -167,14 +165,16 @@ ALISP_INLINE bool ConsCellObject::equal(const Object& o) const
 {
     if (eq(o)) return true;
     if (!o.isList()) return false;
-    const Object* myCar = car();
-    const Object* otherCar = o.asList()->car();
-    const Object* myCdr = cdr();
-    const Object* otherCdr = o.asList()->cdr();
-    if ((!myCar && otherCar) || (myCar && !otherCar)) return false;
-    if ((!myCdr && otherCdr) || (myCdr && !otherCdr)) return false;
-    return (myCar == otherCdr || myCar->equal(*otherCar)) &&
-        (myCdr == otherCdr || myCdr->equal(*otherCdr));    
+    const ConsCell* a = cc.get();
+    const ConsCell* b = o.asList()->cc.get();
+    while (a && b && a != b) {
+        if (!a->car != !b->car || (a->car && !a->car->equal(*b->car))) return false;
+        if (!a->dotted() != !b->dotted()) return false;
+        if (a->dotted() && !a->dotted()->equal(*b->dotted())) return false;
+        a = a->next();
+        b = b->next();
+    }
+    return a == b;
 }
 
 ALISP_STATIC int countArgs(const ConsCell* cc)
@@ -190,11 +190,36 @@ ALISP_STATIC int countArgs(const ConsCell* cc)
     return i;
 }
 
+// The symbol whose function a form calls, if the form starts with one which has a function.
+ALISP_STATIC Symbol* calledSymbol(const ConsCellObject& form)
+{
+    const SymbolObject* sym = form.car()->asSymbol();
+    Symbol* s = sym ? sym->getSymbolOrNull() : nullptr;
+    return s && s->function ? s : nullptr;
+}
+
+// The (macro lambda ...) definition of the function a form calls, if that is a macro.
+ALISP_STATIC const ConsCellObject* calledMacro(const ConsCellObject& form, const Symbol& called)
+{
+    if (!called.function->isList()) {
+        return nullptr;
+    }
+    const ConsCellObject* definition = called.function->asList();
+    const SymbolObject* head = definition->car() ? definition->car()->asSymbol() : nullptr;
+    if (!head || (head->sym ? head->sym->name : head->name) != MacroName ||
+        head->getSymbolOrNull() != form.parent->getSymbolOrNull(MacroName).get()) {
+        return nullptr;
+    }
+    return definition;
+}
+
 ALISP_INLINE ObjectPtr ConsCellObject::eval()
 {
-    thread_local int depth = 0;
-    depth++;
-    const AtScopeExit onExit([]{ depth--; });
+    const size_t depth = parent->enterFrame(cc.get());
+    const int exceptions = std::uncaught_exceptions();
+    const AtScopeExit onExit([this, exceptions]{
+        parent->leaveFrame(std::uncaught_exceptions() > exceptions);
+    });
     if (depth >= 500) {
         throw exceptions::Error("Max recursion depth limit exceeded.");
     }
@@ -202,21 +227,34 @@ ALISP_INLINE ObjectPtr ConsCellObject::eval()
     if (!cc || !(*cc)) {
         return std::make_unique<ConsCellObject>(parent);
     }
-    try {
-        auto &c = *cc;
-        const auto f = car()->resolveFunction();
-        assert(f && "Throws if fails");
-        const int argc = countArgs(c.next());
-        if (argc < f->minArgs || argc > f->maxArgs) {
-            throw exceptions::WrongNumberOfArguments(argc);
-        }
-        FArgs args(*c.next(), *parent);
-        return f->func(args);
+    auto &c = *cc;
+    Symbol* called = calledSymbol(*this);
+    if (called && called->special != SpecialForm::None) {
+        return parent->evalSpecialForm(called->special, c.next());
     }
-    catch (exceptions::Error& err) {
-        err.stackTrace += toString() + "\n";
-        throw;
+    if (const ConsCellObject* macro = called ? calledMacro(*this, *called) : nullptr) {
+        return parent->evalMacroCall(*this, *macro);
     }
+    const auto f = called ? called->resolvedFunction() : car()->resolveFunction();
+    assert(f && "Throws if fails");
+    const int argc = countArgs(c.next());
+    if (argc < f->minArgs || argc > f->maxArgs) {
+        throw exceptions::WrongNumberOfArguments(argc);
+    }
+    FArgs args(*c.next(), *parent);
+    return f->func(args);
+}
+
+ALISP_INLINE Object* ConsCellObject::tryEvalBorrowed()
+{
+    if (!cc || !(*cc)) {
+        return this;
+    }
+    const SymbolObject* carSym = car()->asSymbol();
+    if (carSym && cc->next() && carSym->name == parent->parsedSymbolName("quote")) {
+        return cc->next()->car.get();
+    }
+    return nullptr;
 }
 
 ALISP_INLINE void ConsCellObject::traverse(const std::function<bool(const Object&)>& f) const
@@ -224,114 +262,88 @@ ALISP_INLINE void ConsCellObject::traverse(const std::function<bool(const Object
     if (!*this) {
         return;
     }
-    const ConsCellObject* cell = this;
-    while (cell) {
-        if (!f(*cell)) {
-            return;
-        }
-        cell->cc->car->traverse(f);
-        cell = cell->cc->cdr ? cell->cc->cdr->asList() : nullptr;
-    }    
+    if (!f(*this)) {
+        return;
+    }
+    for (const ConsCell* cell = cc.get(); cell; cell = cell->next()) {
+        cell->car->traverse(f);
+    }
 }
 
-ALISP_INLINE std::string ConsCellObject::toString(bool aesthetic) const
+ALISP_STATIC std::string listToString(const ConsCellObject& list, ConsCell::Chain& chain);
+
+ALISP_STATIC std::string carToString(const Object& car, const ConsCell::Chain& chain)
 {
-    if (!cc || !cc->car && !cc->cdr) {
-        return NilName;
+    if (car.isList() && !car.isNil()) {
+        ConsCell::Chain inner = car.asList()->cc->chain(&chain);
+        if (const auto index = inner.backReference()) {
+            return "#" + std::to_string(*index);
+        }
+        return listToString(*car.asList(), inner);
     }
+    return car.toString();
+}
 
-    std::vector<const ConsCell*> cellPtrs;
-    auto p = cc.get();
-    bool infinite = false;
-    while (p) {
-        auto it = std::find(cellPtrs.begin(), cellPtrs.end(), p);
-        if (it != cellPtrs.end()) {
-            infinite = true;
-            break;
-        }
-        cellPtrs.push_back(p);
-        p = p->next();
+ALISP_STATIC std::string listToString(const ConsCellObject& list, ConsCell::Chain& chain)
+{
+    const ConsCell* cc = list.cc.get();
+    const SymbolObject* carSym = dynamic_cast<const SymbolObject*>(list.car());
+    const bool quote = carSym && carSym->name == list.parent->parsedSymbolName("quote");
+    const bool fquote = carSym && carSym->name == list.parent->parsedSymbolName("function");
+    if (quote || fquote) {
+        chain.position = 1;
+        return (quote ? "'" : "#'") +
+            (cc->next() ? carToString(*cc->next()->car, chain) : std::string(""));
     }
 
-    const SymbolObject* carSym = dynamic_cast<const SymbolObject*>(car());
-    const bool quote = carSym && carSym->name == parent->parsedSymbolName("quote");
-    if (quote) {
-        return "'" + (cc->next() ? cc->next()->car->toString() : std::string(""));
-    }
-    const bool fquote = carSym && carSym->name == parent->parsedSymbolName("function");
-    if (fquote) {
-        return "#'" + (cc->next() ? cc->next()->car->toString() : std::string(""));
-    }
-
-    auto carToString = [&](const Object* car) -> std::string {
-        if (car->isList() && !car->isNil()) {
-            const ConsCell* car2 = car->asList()->cc.get();
-            if (car2->isCyclical()) {
-                std::int64_t i = -1;
-                car2->traverse([&](const ConsCell* cell) {
-                    auto it = std::find(cellPtrs.begin(), cellPtrs.end(), car2);
-                    if (it != cellPtrs.end()) {
-                        i = std::distance(cellPtrs.begin(), it);
-                        return false;
-                    }
-                    return true;
-                });
-                return "#" + std::to_string(i);
-            }
-        }
-        return car->toString();
-    };
-        
+    // Like Emacs, keep printing a circular list until the cycle is detected and then refer
+    // back to the element at half of the printed length.
     std::string s = "(";
-    const ConsCell *t = cc.get();
-    std::map<const ConsCell*, size_t> visited;
-    std::int64_t index = 0;
-    std::optional<std::int64_t> loopback;
-    while (t) {
-        if (!t->next() && t->cdr) {
-            s += t->car->toString() + " . " + t->cdr->toString();
-            break;
+    CycleDetector detector(cc);
+    size_t printed = 0;
+    for (const ConsCell* t = cc; t;) {
+        chain.position = printed;
+        if (printed) {
+            s += " ";
         }
-        else if (infinite && visited[t->next()] == (cellPtrs.size() > 1 ? 2 : 1)) {
-            s += ". ";
-            if (cellPtrs.size() == 1) {
-                loopback = 0;
+        s += t->car ? carToString(*t->car, chain) : "";
+        printed++;
+        const ConsCell* next = t->next();
+        if (!next) {
+            if (t->dotted()) {
+                s += " . " + t->dotted()->toString();
             }
-            s += "#" + std::to_string(*loopback);
             break;
         }
-        if (infinite && !loopback && visited[t->next()]) {
-            loopback = index;
-        }
-        visited[t]++;
-        index++;
-        s += t->car ? carToString(t->car.get()) : "";
-        t = t->next();
-        if (t) {
-            s += " ";
+        if (detector.step(next)) {
+            s += " . #" + std::to_string(printed >> 1);
+            break;
         }
+        t = next;
     }
     s += ")";
     return s;
 }
 
+ALISP_INLINE std::string ConsCellObject::toString(bool aesthetic) const
+{
+    if (!cc || !cc->car && !cc->hasCdr()) {
+        return NilName;
+    }
+    ConsCell::Chain chain = cc->chain();
+    return listToString(*this, chain);
+}
+
 ALISP_INLINE size_t ConsCellObject::length() const
 {
     if (!*this) {
         return 0;
     }
-    std::set<const ConsCell*> visited;
-    size_t l = 1;
-    auto p = cc.get();
-    visited.insert(p);
-    while ((p = p->next())) {
-        if (visited.count(p)) {
-            throw exceptions::Error("Cyclical list length");
-        }
-        visited.insert(p);
-        l++;
+    const ConsCell::Chain chain = cc->chain();
+    if (chain.circular) {
+        throw exceptions::Error("Cyclical list length");
     }
-    return l;
+    return chain.length;
 }
 
 std::unique_ptr<Object> ConsCellObject::elt(std::int64_t index) const
@@ -353,7 +365,7 @@ ALISP_INLINE void ListBuilder::append(const Object& obj)
 
 ALISP_INLINE void ListBuilder::dot(std::unique_ptr<Object> obj)
 {
-    m_last->cdr = std::move(obj);
+    m_last->setCdr(std::move(obj));
 }
 
 ALISP_INLINE void ListBuilder::append(std::unique_ptr<Object> obj)
@@ -362,16 +374,17 @@ ALISP_INLINE void ListBuilder::append(std::unique_ptr<Object> obj)
         m_list = std::make_unique<ConsCellObject>(&m_parent);
     }
     if (!m_last) {
-        m_list->cc = std::make_shared<ConsCell>();
+        m_list->cc = ConsCellPtr::make();
         m_last = m_list->cc.get();
     }
     if (!m_last->car) {
         m_last->car = std::move(obj);
     }
     else {
-        auto newCc = std::make_unique<ConsCellObject>(std::move(obj), nullptr, &m_parent);
-        auto nextLast = newCc->cc.get();
-        m_last->cdr = std::move(newCc);
+        auto newCc = ConsCellPtr::make();
+        newCc->car = std::move(obj);
+        ConsCell* nextLast = newCc.get();
+        m_last->setNext(std::move(newCc));
         m_last = nextLast;
     }
 }
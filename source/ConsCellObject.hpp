@@ -10,62 +10,55 @@ namespace alisp {
 class Machine;
 struct Symbol;
 
+std::unique_ptr<Object> makeNil(Machine* parent);
+
 struct ConsCellObject :
         SharedValueObjectBase,
         Sequence,
         ConvertibleTo<const Symbol&>,
         ConvertibleTo<Symbol&>,
         ConvertibleTo<const ConsCell&>,
-        ConvertibleTo<std::shared_ptr<ConsCell>>,
+        ConvertibleTo<ConsCellPtr>,
         ConvertibleTo<ConsCell&>,
         ConvertibleTo<ConsCell*>,
         ConvertibleTo<const ConsCell*>
 {
-    std::shared_ptr<ConsCell> cc;
+    ConsCellPtr cc;
     Machine* parent = nullptr;
 
     ConsCellObject(Machine* parent) : parent(parent) { }
-    ConsCellObject(std::shared_ptr<ConsCell> value, Machine* machine) :
-        cc(value),
+    ConsCellObject(ConsCellPtr value, Machine* machine) :
+        cc(std::move(value)),
         parent(machine) {}
     ConsCellObject(std::unique_ptr<Object> car, std::unique_ptr<Object> cdr, Machine* p) :
         ConsCellObject(p)
     {
-        cc = std::make_shared<ConsCell>();
+        cc = ConsCellPtr::make();
         this->cc->car = std::move(car);
-        if (!cdr || !(*cdr)) {
-            return;
-        }
-        this->cc->cdr = std::move(cdr);
+        this->cc->setCdr(std::move(cdr));
     }
 
     ConsCellObject(const ConsCellObject& o) : cc(o.cc), parent(o.parent) {}
 
-    ~ConsCellObject()
-    {
-        if (cc) tryDestroySharedData();
-    }        
-
-    void reset() override { cc.reset(); }
     std::string toString(bool aesthetic = false) const override;
     bool isList() const override { return true; }
     bool isNil() const override { return !(*this); }
     bool operator!() const override { return !cc || !(*cc); }
     ConsCellObject* asList() override { return this; }
     const ConsCellObject* asList() const override { return this; }
-    std::shared_ptr<ConsCell> consCell() const { return cc;  }
     Object* car() const { return cc ? cc->car.get() : nullptr; };
-    Object* cdr() const { return cc ? cc->cdr.get() : nullptr; };
+    ObjectPtr cdr() const;
     Object* cadr() const;
     Object* setCar(ObjectPtr obj) { cc->car = std::move(obj); return cc->car.get(); }
-    Object* setCdr(ObjectPtr obj) { cc->cdr = std::move(obj); return cc->cdr.get(); }
-    const ConsCellObject* next() const;
-    ConsCellObject* next();
+    void setCdr(ObjectPtr obj) { cc->setCdr(std::move(obj)); }
     std::shared_ptr<Function> resolveFunction() const override;
     std::string typeOf() const override { return "cons"; }
 
     std::unique_ptr<Object> clone() const override
     {
+        if (!cc) {
+            return makeNil(parent);
+        }
         return std::make_unique<ConsCellObject>(*this);
     }
 
@@ -76,6 +69,7 @@ struct ConsCellObject :
     bool equal(const Object &o) const override;
     size_t length() const override;
     std::unique_ptr<Object> eval() override;
+    Object* tryEvalBorrowed() override;
     std::unique_ptr<Object> elt(std::int64_t index) const override;
     std::unique_ptr<ConsCellObject> mapCar(const Function& func) const override;
 
@@ -91,6 +85,7 @@ struct ConsCellObject :
 
     std::unique_ptr<ConsCellObject> deepCopy() const;
     void traverse(const std::function<bool(const Object&)>& f) const override;
+    void visitShared(const SharedRefVisitor& f) const override { alisp::visitShared(cc.get(), f); }
 
     const void* sharedDataPointer() const override { return cc.get(); }
     size_t sharedDataRefCount() const override { return cc.use_count(); }
@@ -101,8 +96,7 @@ struct ConsCellObject :
     ConsCell& convertTo(ConvertibleTo<ConsCell&>::Tag) const override;
     bool canConvertTo(ConvertibleTo<Symbol&>::Tag) const override;
     bool canConvertTo(ConvertibleTo<const Symbol&>::Tag) const override;
-    std::shared_ptr<ConsCell>
-    convertTo(ConvertibleTo<std::shared_ptr<ConsCell>>::Tag) const override { return cc; }
+    ConsCellPtr convertTo(ConvertibleTo<ConsCellPtr>::Tag) const override { return cc; }
     ConsCell* convertTo(ConvertibleTo<ConsCell*>::Tag) const override { return cc.get(); }
     const ConsCell* convertTo(ConvertibleTo<const ConsCell*>::Tag) const override {
         return cc.get();
@@ -111,10 +105,6 @@ struct ConsCellObject :
     bool canConvertTo(ConvertibleTo<const ConsCell&>::Tag) const override;
 };
 
-inline std::unique_ptr<Object> makeNil(Machine* parent)
-{
-    return std::make_unique<ConsCellObject>(parent);
-}
 
 inline std::unique_ptr<ConsCellObject> makeList(Machine* parent)
 {
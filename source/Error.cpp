@@ -8,6 +8,7 @@
 #include "StringObject.hpp"
 #include "Machine.hpp"
 #include <limits>
+#include <ostream>
 
 namespace alisp {
 namespace exceptions {
@@ -75,6 +76,21 @@ std::string Error::getMessageString()
     return msg;
 }
 
+std::string Error::stackTrace() const
+{
+    std::string trace = formattedFrames;
+    for (const ConsCellPtr& frame : frames) {
+        trace += ConsCellObject(frame, machine).toString() + "\n";
+    }
+    return trace;
+}
+
+void Error::formatFrames()
+{
+    formattedFrames = stackTrace();
+    frames.clear();
+}
+
 }
 
 ALISP_STATIC bool handlerMatches(const SymbolObject& error, const SymbolObject& handler)
@@ -102,18 +118,80 @@ void Machine::initErrorFunctions()
                                                                ""),
                                 data.clone());
     });
-    defun("error-message-string", [](const ConsCell* err) {
+    makeSpecialForm("catch", 1, std::numeric_limits<int>::max(), [this](FArgs& args) {
+        const ObjectPtr tag = args.take();
+        m_catchTags.push_back(tag.get());
+        const AtScopeExit onExit([this]{ m_catchTags.pop_back(); });
+        const size_t frames = m_unwoundFrames.size();
+        try {
+            return args.hasNext() ? args.evalAll() : makeNil();
+        }
+        catch (exceptions::Throw& thrown) {
+            if (!thrown.tag->eq(*tag)) {
+                throw;
+            }
+            m_unwoundFrames.resize(frames);
+            return std::move(thrown.value);
+        }
+    });
+    defun("throw", [this](const Object& tag, const Object& value) -> ObjectPtr {
+        // Only a catch which is there can be thrown to, anything else is an error which can be
+        // handled with condition-case.
+        for (auto it = m_catchTags.rbegin(); it != m_catchTags.rend(); ++it) {
+            if ((*it)->eq(tag)) {
+                throw exceptions::Throw{tag.clone(), value.clone()};
+            }
+        }
+        ListBuilder data(*this);
+        data.append(tag.clone());
+        data.append(value.clone());
+        throw exceptions::Error(makeSymbol("no-catch", true), data.get());
+    });
+    makeSpecialForm("unwind-protect", 1, std::numeric_limits<int>::max(), [this](FArgs& args) {
+        ConsCell* unwindForms = args.cc->next();
+        auto unwind = [this, unwindForms]() {
+            for (ConsCell* cc = unwindForms; cc; cc = cc->next()) {
+                cc->car->eval();
+            }
+        };
+        ObjectPtr ret;
+        try {
+            ret = args.take();
+        }
+        catch (...) {
+            unwind();
+            throw;
+        }
+        unwind();
+        return ret;
+    });
+    // Like in Emacs, frames are listed innermost first, starting from the caller of these.
+    defun("backtrace-frames", [this]() {
+        ListBuilder frames(*this);
+        for (auto it = m_evalStack.rbegin() + 1; it < m_evalStack.rend(); ++it) {
+            frames.append(std::make_unique<ConsCellObject>(ConsCellPtr(*it), this));
+        }
+        return frames.get();
+    });
+    defun("backtrace", [this]() {
+        std::ostream& out = standardOutput();
+        for (auto it = m_evalStack.rbegin() + 1; it < m_evalStack.rend(); ++it) {
+            out << "  " << ConsCellObject(ConsCellPtr(*it), this).toString() << "\n";
+        }
+        return makeNil();
+    });
+    defun("error-message-string", [this](const ConsCell* err) {
         if (!err) {
             return std::string("peculiar error");
         }
-        return err->car->toString() + ":" + err->cdr->toString();
+        return err->car->toString() + ":" + err->cdr(*this)->toString();
     });
     makeFunc("condition-case", 2, std::numeric_limits<int>::max(), [&](FArgs& args) {
         auto arg = args.pop(false);
         if (!arg->isSymbol() && !arg->isNil()) {
             throw exceptions::WrongTypeArgument(arg->toString());
         }
-        const std::string symName = arg->isNil() ? NilName : arg->asSymbol()->getSymbolName();
+        const size_t frames = m_unwoundFrames.size();
         try {
             auto protectedForm = args.pop(false);
             return protectedForm->eval();
@@ -150,12 +228,13 @@ void Machine::initErrorFunctions()
                     throw exceptions::Error("Invalid condition handler: " + next->toString());
                 }
                 if (match) {
-                    pushLocalVariable(symName,
-                                      args.m.makeConsCell(error.sym->clone(), error.data->clone()));
-                    auto& m = args.m;
-                    AtScopeExit onExit([&m, symName](){
-                        m.popLocalVariable(symName);
-                    });
+                    m_unwoundFrames.resize(frames);
+                    const size_t depth = bindingDepth();
+                    if (!arg->isNil()) {
+                        bindVariable(*arg->asSymbol(), makeConsCell(error.sym->clone(),
+                                                                    error.data->clone()));
+                    }
+                    AtScopeExit onExit([this, depth](){ unbindVariables(depth); });
                     auto cc = next->asList()->cc.get();
                     cc = cc->next();
                     ObjectPtr ret;
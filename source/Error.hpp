@@ -1,7 +1,11 @@
 #pragma once
 #include "alisp.hpp"
+#include "ConsCell.hpp"
+#include "ObjectPtr.hpp"
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace alisp {
 
@@ -28,7 +32,12 @@ struct Error : Exception
 {
     std::unique_ptr<SymbolObject> sym;
     std::unique_ptr<Object> data;
-    std::string stackTrace;
+
+    // Forms which were being evaluated when the error was signaled, innermost first. They are
+    // only printed if the stack trace is asked for, or once the error leaves the machine.
+    std::vector<ConsCellPtr> frames;
+    Machine* machine = nullptr;
+    std::string formattedFrames; // Of the frames let go of so far, which are the innermost
     
     Error(std::unique_ptr<SymbolObject> sym,
           std::unique_ptr<Object> data);
@@ -39,6 +48,11 @@ struct Error : Exception
     std::string symbolName, message;
     void onHandle(Machine& m);
     std::string getMessageString();
+    std::string stackTrace() const;
+
+    // Formats the frames and lets go of them, for an error which leaves Machine::evaluate and
+    // may outlive the machine and the code.
+    void formatFrames();
 };
 
 struct ArithError : Error
@@ -88,6 +102,24 @@ struct WrongNumberOfArguments : Error
     }
 };
 
+struct InvalidRegexp : Error
+{
+    InvalidRegexp(std::string msg) :
+        Error(msg, ConvertParsedNamesToUpperCase ? "INVALID-REGEXP" : "invalid-regexp") {}
+};
+
+struct ArgsOutOfRange : Error
+{
+    ArgsOutOfRange(std::string msg) :
+        Error(msg, ConvertParsedNamesToUpperCase ? "ARGS-OUT-OF-RANGE" : "args-out-of-range") {}
+};
+
+struct SearchFailed : Error
+{
+    SearchFailed(std::string msg) :
+        Error(msg, ConvertParsedNamesToUpperCase ? "SEARCH-FAILED" : "search-failed") {}
+};
+
 struct VoidVariable : Error
 {
     VoidVariable(std::string vname) : Error(vname, 
@@ -96,5 +128,13 @@ struct VoidVariable : Error
 };
 
 
+// Thrown by throw to the catch of its tag. It is not an Error, so it passes condition-case
+// and the frames on the way by without them doing anything, and it does not allocate.
+struct Throw
+{
+    ObjectPtr tag;
+    ObjectPtr value;
+};
+
 } // namespace exceptions
 }
@@ -4,26 +4,45 @@
 namespace alisp
 {
 
+ALISP_INLINE FArgs::~FArgs()
+{
+    for (const Object* obj : pinned) {
+        obj->unpin();
+    }
+}
+
 ALISP_INLINE Object* FArgs::pop(bool eval)
 {
     if (!cc) {
         return nullptr;
     }
-    auto self = cc->car->trySelfEvaluate();
-    if (self) {
-        cc = cc->next();
-        return self;
-    }
+    Object* arg = cc->car.get();
+    cc = cc->next();
     if (!eval || disableEval) {
-        auto ptr = cc->car.get();
-        cc = cc->next();
-        return ptr;
+        return arg;
     }
-    argStorage.push_back(cc->car->eval());
-    cc = cc->next();
+    if (Object* value = arg->tryEvalBorrowed()) {
+        value->pin();
+        pinned.push_back(value);
+        return value;
+    }
+    argStorage.push_back(arg->eval());
     return argStorage.back().get();
 }
 
+ALISP_INLINE ObjectPtr FArgs::take()
+{
+    Object* arg = cc->car.get();
+    cc = cc->next();
+    if (disableEval) {
+        return arg->clone();
+    }
+    if (Object* value = arg->tryEvalBorrowed()) {
+        return value->clone();
+    }
+    return arg->eval();
+}
+
 ALISP_INLINE ObjectPtr FArgs::evalAll(ConsCell* begin)
 {
     auto code = begin ? begin : cc;
@@ -3,6 +3,7 @@
 #include "Object.hpp"
 #include "ConsCell.hpp"
 #include "Template.hpp"
+#include <cassert>
 #include <type_traits>
 #include <vector>
 
@@ -23,6 +24,7 @@ struct Function
     std::function<std::unique_ptr<Object>(FArgs&)> func;
     bool isMacro = false;
     bool isSpecialForm = false;
+    bool pure = false; // Depends on nothing but its arguments, so calls can be folded
 };
 
 struct FArgs
@@ -30,13 +32,23 @@ struct FArgs
     ConsCell* cc;
     Machine& m;
     std::vector<std::unique_ptr<Object>> argStorage;
+    std::vector<const Object*> pinned;
     std::vector<std::shared_ptr<Function>> funcStorage;
     bool disableEval = false;
     
     FArgs(ConsCell& cc, Machine& m) : cc(&cc), m(m) {}
+    FArgs(const FArgs&) = delete;
+    ~FArgs();
 
     Object* current() { return cc ? cc->car.get() : nullptr; }
+
+    // Evaluates the next argument. Values which already exist, like those of variables, are
+    // borrowed and pinned until the call is over instead of copied.
     Object* pop(bool eval = true);
+
+    // Evaluates the next argument into an object owned by the caller. A newly created value is
+    // handed over as is instead of copied.
+    ObjectPtr take();
     
     void skip()
     {
@@ -0,0 +1,59 @@
+#pragma once
+#include "ConsCell.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+namespace alisp
+{
+
+// Values computed from code, like expansions of macro calls, by the cons cell of the code. An
+// entry holds on to the cell, so that a cell which is gone can not be reused for other code
+// and mistaken for it. Entries of code which nothing else refers to anymore are purged.
+template<typename T>
+class FormCache
+{
+    struct Entry
+    {
+        ConsCellPtr form;
+        T value;
+    };
+
+    std::unordered_map<const ConsCell*, Entry> m_entries;
+    size_t m_added = 0; // Since the last purge
+    size_t m_purgeAt = 1024;
+public:
+    T* find(const ConsCell& form)
+    {
+        const auto it = m_entries.find(&form);
+        return it == m_entries.end() ? nullptr : &it->second.value;
+    }
+
+    T& insert(ConsCellPtr form, T value)
+    {
+        if (m_entries.size() >= m_purgeAt) {
+            purge();
+            m_purgeAt = std::max<size_t>(1024, m_entries.size() * 2);
+        }
+        Entry& entry = m_entries[form.get()];
+        entry.form = std::move(form);
+        entry.value = std::move(value);
+        m_added++;
+        return entry.value;
+    }
+
+    // Drops the entries of code which only the cache refers to.
+    void purge()
+    {
+        if (!m_added) {
+            return;
+        }
+        for (auto it = m_entries.begin(); it != m_entries.end();) {
+            it = it->second.form.use_count() == 1 ? m_entries.erase(it) : std::next(it);
+        }
+        m_added = 0;
+    }
+
+    size_t size() const { return m_entries.size(); }
+};
+
+}
@@ -0,0 +1,304 @@
+#include "Format.hpp"
+#include "Error.hpp"
+#include "FArgs.hpp"
+#include "Object.hpp"
+#include "StringObject.hpp"
+#include "UTF8.hpp"
+#include "ValueObject.hpp"
+#include "alisp.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+namespace alisp
+{
+
+// Widths and precisions beyond this are refused instead of padding out or printing that much.
+constexpr int MaxFieldSize = 1000000;
+
+ALISP_INLINE FormatString::FormatString(std::string text) : m_text(std::move(text))
+{
+    auto addLiteral = [this](size_t offset, size_t length) {
+        if (!m_directives.empty() && !m_directives.back().conversion &&
+            m_directives.back().offset + m_directives.back().length == offset) {
+            m_directives.back().length += length;
+        }
+        else {
+            Directive d;
+            d.offset = offset;
+            d.length = length;
+            m_directives.push_back(d);
+        }
+        m_literalBytes += length;
+    };
+    auto isDigit = [](char c) { return c >= '0' && c <= '9'; };
+    auto addDigit = [](int& field, char c) {
+        field = field * 10 + (c - '0');
+        if (field > MaxFieldSize) {
+            throw exceptions::Error("Format width or precision too large");
+        }
+    };
+
+    const size_t n = m_text.size();
+    size_t i = 0;
+    while (i < n) {
+        const size_t percent = m_text.find('%', i);
+        const size_t end = percent == std::string::npos ? n : percent;
+        if (end > i) {
+            addLiteral(i, end - i);
+        }
+        if (percent == std::string::npos) {
+            break;
+        }
+        i = percent + 1;
+        if (i < n && m_text[i] == '%') {
+            addLiteral(i++, 1);
+            continue;
+        }
+        Directive d;
+        for (bool flag = true; flag && i < n; ) {
+            switch (m_text[i]) {
+            case '-': d.leftAlign = true; break;
+            case '+': d.plus = true; break;
+            case ' ': d.space = true; break;
+            case '0': d.zeroPad = true; break;
+            case '#': d.alternate = true; break;
+            default: flag = false; continue;
+            }
+            i++;
+        }
+        for (; i < n && isDigit(m_text[i]); i++) {
+            addDigit(d.width, m_text[i]);
+        }
+        if (i < n && m_text[i] == '.') {
+            d.precision = 0;
+            for (i++; i < n && isDigit(m_text[i]); i++) {
+                addDigit(d.precision, m_text[i]);
+            }
+        }
+        if (i >= n) {
+            throw exceptions::Error("Format string ends in middle of format specifier");
+        }
+        d.conversion = m_text[i++];
+        if (!std::strchr("sSdoxXcefg", d.conversion)) {
+            throw exceptions::Error(std::string("Invalid format operation %") + d.conversion);
+        }
+        m_directives.push_back(d);
+    }
+}
+
+ALISP_INLINE void FormatString::appendField(std::string& out,
+                                            const std::string& prefix,
+                                            const char* body,
+                                            size_t bytes,
+                                            size_t chars,
+                                            const Directive& d,
+                                            bool zeroPad) const
+{
+    const size_t width = static_cast<size_t>(d.width);
+    const size_t total = prefix.size() + chars;
+    const size_t padding = width > total ? width - total : 0;
+    if (d.leftAlign) {
+        out += prefix;
+        out.append(body, bytes);
+        out.append(padding, ' ');
+    }
+    else if (zeroPad) {
+        out += prefix;
+        out.append(padding, '0');
+        out.append(body, bytes);
+    }
+    else {
+        out.append(padding, ' ');
+        out += prefix;
+        out.append(body, bytes);
+    }
+}
+
+ALISP_INLINE void FormatString::appendInteger(std::string& out,
+                                              const Object& arg,
+                                              const Directive& d) const
+{
+    if (!arg.isInt() && !arg.isFloat()) {
+        throw exceptions::Error("Format specifier doesn’t match argument type");
+    }
+    // Floats are truncated. Those too large for an integer are printed in full, as Emacs does
+    // with bignums: the decimal digits of a whole double are exact in fixed notation, and its
+    // octal and hex digits follow from its bits.
+    bool negative = false;
+    std::uint64_t magnitude = 0;
+    char digits[400]; // Enough for the largest double in octal
+    size_t length = 0;
+    const int base = d.conversion == 'o' ? 8 : d.conversion == 'd' ? 10 : 16;
+    if (arg.isFloat()) {
+        const double value = std::trunc(arg.value<double>());
+        if (!std::isfinite(value)) {
+            throw exceptions::ArithError("Overflow: " + arg.toString());
+        }
+        negative = value < 0;
+        if (value >= -9223372036854775808.0 && value < 9223372036854775808.0) {
+            const std::int64_t i = static_cast<std::int64_t>(value);
+            magnitude = i < 0 ? 0 - static_cast<std::uint64_t>(i) : i;
+        }
+        else if (base == 10) {
+            length = std::to_chars(digits, digits + sizeof(digits), std::fabs(value),
+                                   std::chars_format::fixed, 0).ptr - digits;
+        }
+        else {
+            int exponent;
+            const std::uint64_t mantissa = static_cast<std::uint64_t>(
+                std::ldexp(std::frexp(std::fabs(value), &exponent), 53));
+            const int shift = exponent - 53; // At least 11, the value being 2^63 or more
+            const int bits = base == 8 ? 3 : 4;
+            for (int bit = 0; bit < exponent; bit += bits) {
+                int digit = 0;
+                for (int b = std::min(bit + bits, exponent) - 1; b >= bit; b--) {
+                    digit = digit * 2 + (b >= shift ? (mantissa >> (b - shift)) & 1 : 0);
+                }
+                digits[length++] = "0123456789abcdef"[digit];
+            }
+            std::reverse(digits, digits + length);
+        }
+    }
+    else {
+        const std::int64_t value = arg.value<std::int64_t>();
+        negative = value < 0;
+        magnitude = negative ? 0 - static_cast<std::uint64_t>(value) : value;
+    }
+    if (!length) {
+        length = std::to_chars(digits, digits + sizeof(digits), magnitude, base).ptr - digits;
+    }
+    if (d.conversion == 'X') {
+        for (size_t i = 0; i < length; i++) {
+            digits[i] = utf8::kernels::toUpperAscii(digits[i]);
+        }
+    }
+
+    std::string prefix = negative ? "-" : d.plus ? "+" : d.space ? " " : "";
+    if (d.alternate && digits[0] != '0') {
+        prefix += d.conversion == 'o' ? "0" : d.conversion == 'x' ? "0x" :
+            d.conversion == 'X' ? "0X" : "";
+    }
+    if (d.precision > static_cast<int>(length)) {
+        std::string body(d.precision - length, '0');
+        body.append(digits, length);
+        appendField(out, prefix, body.data(), body.size(), body.size(), d, false);
+        return;
+    }
+    appendField(out, prefix, digits, length, length, d, d.zeroPad && d.precision < 0);
+}
+
+ALISP_INLINE void FormatString::appendFloat(std::string& out,
+                                            const Object& arg,
+                                            const Directive& d) const
+{
+    if (!arg.isInt() && !arg.isFloat()) {
+        throw exceptions::Error("Format specifier doesn’t match argument type");
+    }
+    const double value = arg.isFloat() ? arg.value<double>() :
+        static_cast<double>(arg.value<std::int64_t>());
+    const auto style = d.conversion == 'f' ? std::chars_format::fixed :
+        d.conversion == 'e' ? std::chars_format::scientific : std::chars_format::general;
+    const int precision = d.precision < 0 ? 6 : d.precision;
+
+    // Most numbers fit the first buffer. Huge ones in fixed notation and long precisions grow it.
+    std::string body(64, '\0');
+    for (;;) {
+        const auto result = std::to_chars(body.data(), body.data() + body.size(),
+                                          std::fabs(value), style, precision);
+        if (result.ec == std::errc()) {
+            body.resize(result.ptr - body.data());
+            break;
+        }
+        body.resize(body.size() * 2);
+    }
+    if (d.alternate && std::isfinite(value)) {
+        // The point is always kept, and %g keeps the trailing zeros of its significant digits.
+        if (body.find('.') == std::string::npos) {
+            body.insert(std::min(body.find('e'), body.size()), 1, '.');
+        }
+        if (d.conversion == 'g') {
+            const size_t exponent = std::min(body.find('e'), body.size());
+            const int wanted = std::max(precision, 1);
+            int significant = 0;
+            bool leading = value != 0;
+            for (size_t i = 0; i < exponent; i++) {
+                if (body[i] != '.' && !(leading && body[i] == '0')) {
+                    leading = false;
+                    significant++;
+                }
+            }
+            body.insert(exponent, std::max(wanted - significant, 0), '0');
+        }
+    }
+
+    const std::string prefix = std::signbit(value) ? "-" : d.plus ? "+" : d.space ? " " : "";
+    appendField(out, prefix, body.data(), body.size(), body.size(), d,
+                d.zeroPad && std::isfinite(value));
+}
+
+ALISP_INLINE std::string FormatString::format(FArgs& args) const
+{
+    std::string out;
+    out.reserve(m_literalBytes + m_directives.size() * 8);
+    for (const Directive& d : m_directives) {
+        if (!d.conversion) {
+            out.append(m_text, d.offset, d.length);
+            continue;
+        }
+        if (!args.hasNext()) {
+            throw exceptions::Error("Not enough arguments for format string");
+        }
+        const Object& arg = *args.pop();
+        switch (d.conversion) {
+        case 's':
+        case 'S': {
+            // Strings are copied as they are, without making a flat copy of a rope first.
+            const auto str = dynamic_cast<const StringObject*>(&arg);
+            if (str && d.conversion == 's' && d.precision < 0) {
+                const size_t chars = str->length();
+                const size_t padding = static_cast<size_t>(d.width) > chars ? d.width - chars : 0;
+                if (!d.leftAlign) {
+                    out.append(padding, ' ');
+                }
+                str->appendTo(out);
+                if (d.leftAlign) {
+                    out.append(padding, ' ');
+                }
+                break;
+            }
+            const std::string text = arg.toString(d.conversion == 's');
+            size_t bytes = text.size();
+            if (d.precision >= 0) {
+                bytes = 0;
+                for (int i = 0; i < d.precision && bytes < text.size(); i++) {
+                    bytes += std::max<size_t>(1, utf8::next(text.c_str() + bytes));
+                }
+                bytes = std::min(bytes, text.size());
+            }
+            appendField(out, "", text.data(), bytes, utf8::countChars(text.data(), bytes), d,
+                        false);
+            break;
+        }
+        case 'c': {
+            if (!arg.isCharacter()) {
+                throw exceptions::Error("Format specifier doesn’t match argument type");
+            }
+            const std::string c = utf8::encode(arg.value<std::uint32_t>());
+            appendField(out, "", c.data(), c.size(), 1, d, false);
+            break;
+        }
+        case 'e':
+        case 'f':
+        case 'g':
+            appendFloat(out, arg, d);
+            break;
+        default:
+            appendInteger(out, arg, d);
+        }
+    }
+    return out;
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace alisp
+{
+
+struct FArgs;
+struct Object;
+
+// A control string of format compiled into a list of directives, so that running it only
+// copies literal text and converts the arguments. The syntax is that of Emacs:
+// %[flags][width][.precision]conversion with the flags - + space 0 # and the conversions
+// s S d o x X c e f g and %.
+class FormatString
+{
+    struct Directive
+    {
+        char conversion = 0; // Zero for literal text
+        bool leftAlign = false;
+        bool plus = false;
+        bool space = false;
+        bool zeroPad = false;
+        bool alternate = false;
+        int width = 0;
+        int precision = -1;
+        size_t offset = 0; // Literal text in m_text
+        size_t length = 0;
+    };
+
+    std::string m_text;
+    std::vector<Directive> m_directives;
+    size_t m_literalBytes = 0;
+
+    void appendField(std::string& out, const std::string& prefix, const char* body, size_t bytes,
+                     size_t chars, const Directive& d, bool zeroPad) const;
+    void appendInteger(std::string& out, const Object& arg, const Directive& d) const;
+    void appendFloat(std::string& out, const Object& arg, const Directive& d) const;
+public:
+    FormatString(std::string text);
+
+    // Formats the remaining arguments.
+    std::string format(FArgs& args) const;
+};
+
+}
@@ -12,20 +12,20 @@
 namespace alisp
 {
 
-ALISP_INLINE FuncParams getFuncParams(const ConsCellObject& closure)
+ALISP_INLINE FuncParams getFuncParams(const ConsCell& closure)
 {
     FuncParams fp;
     std::vector<std::string>& argList = fp.names;
     bool opt = false;
     fp.rest = false;
-    for (auto& arg : *closure.cc->car->asList()) {
+    for (auto& arg : *closure.car->asList()) {
         const auto sym = dynamic_cast<const SymbolObject*>(&arg);
         if (!sym) {
-            throw exceptions::Error("Malformed arglist: " + closure.cc->car->toString());
+            throw exceptions::Error("Malformed arglist: " + closure.car->toString());
         }
         if (sym->name == OptionalName) {
             if (opt) {
-                throw exceptions::Error("Malformed arglist: " + closure.cc->car->toString());
+                throw exceptions::Error("Malformed arglist: " + closure.car->toString());
             }
             opt = true;
             continue;
@@ -36,6 +36,7 @@ ALISP_INLINE FuncParams getFuncParams(const ConsCellObject& closure)
             continue;
         }
         argList.push_back(sym->name);
+        fp.symbols.push_back(sym);
         if (fp.rest) {
             break;
         }
@@ -50,34 +51,29 @@ ALISP_INLINE FuncParams getFuncParams(const ConsCellObject& closure)
 ObjectPtr Machine::execute(const ConsCellObject& closure, FArgs& a)
 {
     ListBuilder builder(*this);
-    const auto fp = getFuncParams(closure);
-    const auto& argList = fp.names;
-    size_t i = 0;
+    const auto fp = getFuncParams(*closure.cc);
+    const auto& argList = fp.symbols;
+    const size_t depth = bindingDepth();
+    AtScopeExit onExit([this, depth]() { unbindVariables(depth); });
     for (size_t i = 0; i < argList.size(); i++) {
         if (!a.hasNext()) {
-            pushLocalVariable(argList[i], a.m.makeNil());
+            bindVariable(*argList[i], a.m.makeNil());
         }
         else {
             if (fp.rest && i + 1 == argList.size()) {
                 while (a.hasNext()) {
                     builder.append(a.pop()->clone());
                 }
-                pushLocalVariable(argList[i], builder.get());
+                bindVariable(*argList[i], builder.get());
             }
             else {
-                pushLocalVariable(argList[i], a.pop()->clone());
+                bindVariable(*argList[i], a.pop()->clone());
             }
         }
     }
-    AtScopeExit onExit([this, argList, &closure]() {
-        for (auto it = argList.rbegin(); it != argList.rend(); ++it) {
-            popLocalVariable(*it);
-        }
-    });
     std::unique_ptr<Object> ret = makeNil();
-    assert(closure.cdr() && closure.cdr()->isList());
-    for (auto& obj : *closure.cdr()->asList()) {
-        ret = obj.eval();
+    for (const ConsCell* body = closure.cc->next(); body; body = body->next()) {
+        ret = body->car->eval();
     }
     return ret;
 }
@@ -139,11 +135,12 @@ void Machine::initFunctionFunctions()
         builder.append(makeSymbol("lambda", true));
         args.skip();
         auto cc = args.cc;
-        while (cc && cc->car) {
-            builder.append(cc->car->clone());
-            cc = cc->next();
+        const bool eager = expandsMacrosEagerly();
+        for (bool params = true; cc && cc->car; cc = cc->next(), params = false) {
+            builder.append(eager && !params ? macroExpandAll(*cc->car) : cc->car->clone());
         }
-        getSymbol(funcName)->function = builder.get();
+        const auto sym = getSymbol(funcName);
+        sym->setFunction(eager ? optimize(*builder.get()) : ObjectPtr(builder.get()));
         return makeSymbol(funcName, false);
     });
     defun("functionp", [](const Object& obj) {
@@ -168,7 +165,7 @@ void Machine::initFunctionFunctions()
         return sym.function->clone();
     });
     defun("fset", [](Symbol& sym, const Object& definition) {
-        sym.function = definition.isNil() ? nullptr : definition.clone();
+        sym.setFunction(definition.isNil() ? nullptr : definition.clone());
         return definition.clone();
     });
     defun("fboundp", [this](const Object& obj) {
@@ -176,13 +173,7 @@ void Machine::initFunctionFunctions()
         if (obj.asSymbol()->sym) {
             return obj.asSymbol()->sym->function != nullptr;
         }
-        if (getSymbol(obj.asSymbol()->name)->function) {
-            return true;
-        }
-        if (getSymbol(obj.asSymbol()->name, true)->function) {
-            return true;
-        }
-        return false;
+        return getSymbol(obj.asSymbol()->name)->function != nullptr;
     });
 }
 
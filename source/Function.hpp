@@ -4,15 +4,17 @@
 
 namespace alisp {
 
-struct ConsCellObject;
+struct ConsCell;
+struct SymbolObject;
 
 struct FuncParams {
     int min = 0;
     int max = 0;
     bool rest = false;
     std::vector<std::string> names;
+    std::vector<const SymbolObject*> symbols; // Of the names, owned by the argument list
 };
 
-FuncParams getFuncParams(const ConsCellObject& closure);
+FuncParams getFuncParams(const ConsCell& closure);
 
 }
@@ -77,9 +77,17 @@ namespace alisp { inline const char* getInitCode() { return R"code(
   "If COND yields nil, do BODY, else return nil."
   (cons 'if (cons cond (cons nil body))))
 
+(defvar eager-macroexpand nil
+  "Non-nil means that defun, defmacro and lambda expand the macros of their bodies
+right away instead of each time a call in them is evaluated. Defun then also folds
+the constant expressions of the body.")
+
 (defmacro lambda (&rest cdr)
   "Return an anonymous function."
-  (list 'function (cons 'lambda cdr)))
+  (let ((fn (list 'function (cons 'lambda cdr))))
+    (if eager-macroexpand
+        (macroexpand-all fn)
+      fn)))
 
 (defun indirect-function (function)
   (if (symbolp function)
@@ -113,8 +121,12 @@ namespace alisp { inline const char* getInitCode() { return R"code(
 (define-error 'void-function "Void function")
 (define-error 'void-variable "Void variable")
 (define-error 'invalid-function "Invalid function")
-(define-error 'setting-costant "Setting constant")
+(define-error 'setting-constant "Setting constant")
 (define-error 'wrong-number-of-arguments "Wrong number of arguments")
+(define-error 'invalid-regexp "Invalid regexp")
+(define-error 'args-out-of-range "Args out of range")
+(define-error 'search-failed "Search failed")
+(define-error 'no-catch "No catch for tag")
 
 (defvar gensym-counter 0)
 (defun gensym (&optional prefix)
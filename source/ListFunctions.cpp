@@ -1,6 +1,5 @@
 #include "ConsCell.hpp"
 #include "Error.hpp"
-#include "AtScopeExit.hpp"
 #include "Object.hpp"
 #include "SymbolObject.hpp"
 #include "alisp.hpp"
@@ -30,10 +29,11 @@ void Machine::initListFunctions()
                 }
                 next = args.pop();
             }
-            while (list->asList()->next()) {
-                list = list->asList()->next();
+            ConsCell* last = list->asList()->cc.get();
+            while (last->next()) {
+                last = last->next();
             }
-            list->asList()->setCdr(next->clone());
+            last->setCdr(next->clone());
             list = next;
         }
         return origList->clone();
@@ -63,7 +63,7 @@ void Machine::initListFunctions()
                 }
                 builder.append(obj->clone());
                 if (dotcdr) {
-                    builder.tail()->cdr = dotcdr->clone();
+                    builder.dot(dotcdr->clone());
                 }
                 return true;
             });
@@ -75,11 +75,14 @@ void Machine::initListFunctions()
     });
     defun("last", [this](const Object& obj) {
         requireType<ConsCellObject>(obj);
-        auto ptr = dynamic_cast<const ConsCellObject*>(&obj);
-        while (ptr->cdr() && ptr->cdr()->isList()) {
-            ptr = ptr->cdr()->asList();
+        ConsCell* p = obj.asList()->cc.get();
+        if (!p) {
+            return obj.clone();
         }
-        return ptr->clone();
+        while (p->next()) {
+            p = p->next();
+        }
+        return ObjectPtr(std::make_unique<ConsCellObject>(ConsCellPtr(p), this));
     });
     makeFunc("list", 0, std::numeric_limits<int>::max(), [](FArgs& args) {
         ListBuilder builder(args.m);
@@ -104,38 +107,22 @@ void Machine::initListFunctions()
         }
         return builder.get();
     });
-    makeFunc("dolist", 2, std::numeric_limits<int>::max(), [this](FArgs& args) {
-        const auto p1 = args.pop(false)->asList();
-        const std::string varName = p1->car()->asSymbol()->name;
-        auto evaluated = p1->cdr()->asList()->car()->eval();
-        auto codestart = args.cc;
-        for (const auto& obj : *evaluated->asList()) {
-            pushLocalVariable(varName, obj.clone());
-            AtScopeExit onExit([this, varName](){ popLocalVariable(varName); });
-            auto code = codestart;
-            while (code) {
-                code->car->eval();
-                code = code->next();
-            }
-        }
-        return makeNil();
-    });
-    defun("rplaca", [&](std::shared_ptr<ConsCell> cc, const Object& obj) {
+    defun("rplaca", [&](ConsCellPtr cc, const Object& obj) {
         cc->car = obj.clone();
         return std::make_unique<ConsCellObject>(cc, this);
     });
-    defun("rplacd", [&](std::shared_ptr<ConsCell> cc, const Object& obj) {
-        cc->cdr = obj.clone();
+    defun("rplacd", [&](ConsCellPtr cc, const Object& obj) {
+        cc->setCdr(obj.clone());
         return std::make_unique<ConsCellObject>(cc, this);
     });
     defun("setcar", [](ConsCell& cc, ObjectPtr newcar) {
         return cc.car = newcar->clone(), std::move(newcar);
     });
     defun("setcdr", [](ConsCell& cc, ObjectPtr newcdr) {
-        return cc.cdr = newcdr->clone(), std::move(newcdr);
+        return cc.setCdr(newcdr->clone()), std::move(newcdr);
     });
     defun("car", [&](const ConsCell* cc) { return cc && cc->car ? cc->car->clone() : makeNil(); });
-    defun("cdr", [&](const ConsCell* cc) { return cc && cc->cdr ? cc->cdr->clone() : makeNil(); });
+    defun("cdr", [&](const ConsCell* cc) { return cc ? cc->cdr(*this) : makeNil(); });
     defun("consp", [](const Object& obj) { return obj.isList() && !obj.isNil(); });
     defun("listp", [](const Object& obj) { return obj.isList(); });
     defun("nlistp", [](const Object& obj) { return !obj.isList(); });
@@ -144,41 +131,40 @@ void Machine::initListFunctions()
         if (obj.isNil()) return makeInt(0);
         ConsCell* cc = obj.value<ConsCell*>();
         assert(cc);
-        if (cc->isCyclical()) {
+        if (cc->chain().circular) {
             return makeNil();
         }
-        auto p = cc;
-        std::int64_t count = p->car ? 1 : 0;
-        while (p->cdr && p->cdr->isList()) {
-            count++;
-            p = p->cdr->value<ConsCell*>();
-            if (p->cdr && !p->cdr->isList()) {
+        std::int64_t count = 0;
+        for (const ConsCell* p = cc; p; p = p->next()) {
+            if (p->dotted()) {
                 return makeNil();
             }
+            count++;
         }
         return makeInt(count);
     });
     defun("make-list", [this](std::int64_t n, const Object& ptr) {
-        std::unique_ptr<Object> r = makeNil();
+        ConsCellPtr list;
         for (std::int64_t i=0; i < n; i++) {
-            r = std::make_unique<ConsCellObject>(ptr.clone(), r->clone(), this);
+            auto cell = ConsCellPtr::make();
+            cell->car = ptr.clone();
+            cell->setNext(std::move(list));
+            list = std::move(cell);
         }
-        return r;
+        return std::make_unique<ConsCellObject>(std::move(list), this);
     });
     defun("memq", [this](const Object& object, const Object& listObj) {
         requireType<ConsCellObject>(listObj);
         if (listObj.isNil()) {
             return makeNil();
         }
-        auto p = &listObj;
-        while (p) {
-            if (!p->isList()) {
-                throw exceptions::WrongTypeArgument(ListpName + (", " + listObj.toString()));
+        for (ConsCell* p = listObj.asList()->cc.get(); p; p = p->next()) {
+            if (p->car->eq(object)) {
+                return ObjectPtr(std::make_unique<ConsCellObject>(ConsCellPtr(p), this));
             }
-            if (p->asList()->car()->eq(object)) {
-                return p->asList()->clone();
+            if (p->dotted()) {
+                throw exceptions::WrongTypeArgument(ListpName + (", " + listObj.toString()));
             }
-            p = p->asList()->cdr();
         }
         return makeNil();
     });
@@ -189,19 +175,23 @@ void Machine::initListFunctions()
         }
         ConsCellObject ret(listObj.asList()->cc, this);
         while (ret.car() && ret.car()->eq(object)) {
-            assert(!ret.cdr() || ret.cdr()->asList());
-            ret.cc = ret.cdr() ? ret.cdr()->asList()->cc : nullptr;
+            if (ret.cc->dotted()) {
+                throw exceptions::WrongTypeArgument(ret.cc->dotted()->toString());
+            }
+            ret.cc = ret.cc->nextCell();
         }
         if (!ret.cc) {
             return makeNil();
         }
         auto cc = ret.cc.get();
         assert(cc && !ret.cc->car->eq(object));
-        while (cc && cc->cdr) {
-            requireType<ConsCellObject>(*cc->cdr);
-            assert(cc->cdr->asList()->car());
-            if (cc->cdr->asList()->car()->eq(object)) {
-                cc->cdr = std::move(cc->next()->cdr);
+        while (cc && cc->hasCdr()) {
+            if (cc->dotted()) {
+                throw exceptions::WrongTypeArgument(cc->dotted()->toString());
+            }
+            assert(cc->next()->car);
+            if (cc->next()->car->eq(object)) {
+                cc->copyCdr(*cc->next());
             }
             else {
                 cc = cc->next();
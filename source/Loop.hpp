@@ -0,0 +1,49 @@
+#pragma once
+#include "Object.hpp"
+#include <string>
+#include <vector>
+
+namespace alisp
+{
+
+class Machine;
+struct ConsCell;
+struct SymbolObject;
+
+// The clauses of a cl-loop form, taken apart once. The forms are those of the cl-loop form,
+// which must outlive the plan.
+struct LoopPlan
+{
+    struct For
+    {
+        const SymbolObject* var = nullptr;
+        Object* list = nullptr; // for VAR in LIST
+        Object* from = nullptr; // for VAR from FROM [to|below TO] [by BY]
+        Object* to = nullptr;
+        Object* by = nullptr;
+        bool below = false;
+    };
+
+    enum class Action
+    {
+        Do,
+        Collect,
+        Append,
+        Sum
+    };
+
+    struct Clause
+    {
+        Action action;
+        Object* form;
+    };
+
+    std::vector<For> fors;
+    std::vector<Clause> body;
+    bool sums = false; // The loop returns a sum rather than a list
+    bool accumulates = false;
+
+    LoopPlan(Machine& m, const ConsCell* clauses);
+};
+
+}
@@ -0,0 +1,313 @@
+#include "ConsCellObject.hpp"
+#include "Error.hpp"
+#include "Loop.hpp"
+#include "Machine.hpp"
+#include "SymbolObject.hpp"
+#include "ValueObject.hpp"
+#include "alisp.hpp"
+#include <limits>
+
+namespace alisp
+{
+
+// A variable bound for a whole loop. Its value is replaced on every iteration instead of the
+// variable being bound again, and an integer counter is updated in place, so that counting
+// does not allocate.
+class Machine::LoopVariable
+{
+    Machine& m_machine;
+    size_t m_depth;
+    Symbol* m_symbol; // Kept by the binding
+    IntObject* m_counter = nullptr;
+public:
+    LoopVariable(Machine& machine, const SymbolObject& var) :
+        m_machine(machine),
+        m_depth(machine.bindingDepth()),
+        m_symbol(var.getSymbolOrNull())
+    {
+        if (!m_symbol) {
+            m_symbol = var.getSymbol().get();
+        }
+        m_machine.bindVariable(*m_symbol, m_machine.makeNil());
+    }
+
+    LoopVariable(const LoopVariable&) = delete;
+    ~LoopVariable() { m_machine.unbindVariables(m_depth); }
+
+    void set(ObjectPtr value) { m_symbol->variable = std::move(value); }
+
+    void set(std::int64_t value)
+    {
+        // Unless the body has set the variable to something else, it still owns the counter.
+        if (m_counter && m_symbol->variable.get() == m_counter && !m_counter->isShared()) {
+            m_counter->value = value;
+            return;
+        }
+        auto counter = std::make_unique<IntObject>(value);
+        m_counter = counter.get();
+        m_symbol->variable = std::move(counter);
+    }
+};
+
+ALISP_STATIC std::int64_t loopInt(const Object& obj)
+{
+    if (!obj.isInt()) {
+        throw exceptions::WrongTypeArgument(obj.toString());
+    }
+    return obj.value<std::int64_t>();
+}
+
+ALISP_STATIC const ConsCell& loopSpec(const Object& spec, int min)
+{
+    int n = 0;
+    if (spec.isList() && !spec.isNil()) {
+        for (const auto& obj : *spec.asList()) {
+            (void)obj;
+            n++;
+        }
+    }
+    if (n < min || n > 3 || !spec.asList()->car()->isSymbol()) {
+        throw exceptions::WrongTypeArgument(spec.toString());
+    }
+    return *spec.asList()->cc;
+}
+
+ALISP_INLINE LoopPlan::LoopPlan(Machine& m, const ConsCell* clauses)
+{
+    auto keyword = [](const ConsCell* cc) {
+        return cc && cc->car->isSymbol() ? cc->car->asSymbol()->getSymbolName() : std::string();
+    };
+    auto is = [&m](const std::string& name, const char* keyword) {
+        return name == m.parsedSymbolName(keyword);
+    };
+    auto unsupported = [](const ConsCell* cc) {
+        return exceptions::Error("Unsupported cl-loop clause: " + cc->car->toString());
+    };
+    auto next = [](const ConsCell* cc) {
+        if (!cc->next()) {
+            throw exceptions::Error("Missing form after cl-loop keyword: " + cc->car->toString());
+        }
+        return cc->next();
+    };
+
+    for (const ConsCell* cc = clauses; cc; cc = cc->next()) {
+        const std::string name = keyword(cc);
+        if (is(name, "for")) {
+            cc = next(cc);
+            if (!cc->car->isSymbol()) {
+                throw unsupported(cc);
+            }
+            For f;
+            f.var = cc->car->asSymbol();
+            cc = next(cc);
+            const std::string how = keyword(cc);
+            if (is(how, "in")) {
+                cc = next(cc);
+                f.list = cc->car.get();
+            }
+            else if (is(how, "from")) {
+                cc = next(cc);
+                f.from = cc->car.get();
+                for (std::string bound = keyword(cc->next()); ; bound = keyword(cc->next())) {
+                    if (is(bound, "to") || is(bound, "below")) {
+                        f.below = is(bound, "below");
+                        cc = next(cc->next());
+                        f.to = cc->car.get();
+                    }
+                    else if (is(bound, "by")) {
+                        cc = next(cc->next());
+                        f.by = cc->car.get();
+                    }
+                    else {
+                        break;
+                    }
+                }
+            }
+            else {
+                throw unsupported(cc);
+            }
+            fors.push_back(f);
+            continue;
+        }
+
+        Action action;
+        if (is(name, "do")) {
+            // Any number of forms, up to the next keyword.
+            while (cc->next() && cc->next()->car->isList()) {
+                cc = cc->next();
+                body.push_back({Action::Do, cc->car.get()});
+            }
+            continue;
+        }
+        else if (is(name, "collect")) {
+            action = Action::Collect;
+        }
+        else if (is(name, "append")) {
+            action = Action::Append;
+        }
+        else if (is(name, "sum")) {
+            action = Action::Sum;
+        }
+        else {
+            throw unsupported(cc);
+        }
+        if (accumulates && (action == Action::Sum) != sums) {
+            throw exceptions::Error("Conflicting cl-loop accumulations");
+        }
+        accumulates = true;
+        sums = action == Action::Sum;
+        cc = next(cc);
+        body.push_back({action, cc->car.get()});
+    }
+}
+
+void Machine::initLoopFunctions()
+{
+    makeSpecialForm("dotimes", 1, std::numeric_limits<int>::max(), [this](FArgs& args) {
+        const ConsCell& spec = loopSpec(*args.current(), 2);
+        const std::int64_t count = loopInt(*spec.next()->car->eval());
+        LoopVariable var(*this, *spec.car->asSymbol());
+        for (std::int64_t i = 0; i < count; i++) {
+            var.set(i);
+            for (const ConsCell* body = args.cc->next(); body; body = body->next()) {
+                body->car->eval();
+            }
+        }
+        const ConsCell* result = spec.next()->next();
+        if (!result) {
+            return makeNil();
+        }
+        var.set(count);
+        return result->car->eval();
+    });
+    makeSpecialForm("dolist", 1, std::numeric_limits<int>::max(), [this](FArgs& args) {
+        const ConsCell& spec = loopSpec(*args.current(), 2);
+        const ObjectPtr list = spec.next()->car->eval();
+        if (!list->isList()) {
+            throw exceptions::WrongTypeArgument(list->toString());
+        }
+        LoopVariable var(*this, *spec.car->asSymbol());
+        for (const auto& obj : *list->asList()) {
+            var.set(obj.clone());
+            for (const ConsCell* body = args.cc->next(); body; body = body->next()) {
+                body->car->eval();
+            }
+        }
+        const ConsCell* result = spec.next()->next();
+        if (!result) {
+            return makeNil();
+        }
+        var.set(makeNil());
+        return result->car->eval();
+    });
+    makeSpecialForm("cl-loop", 0, std::numeric_limits<int>::max(), [this](FArgs& args) {
+        if (!args.cc) {
+            throw exceptions::Error("cl-loop without clauses would loop forever");
+        }
+        // The arguments are the rest of the form, which identifies the loop.
+        auto* cached = m_loopCache.find(*args.cc);
+        if (!cached) {
+            cached = &m_loopCache.insert(ConsCellPtr(args.cc),
+                                         std::make_shared<LoopPlan>(*this, args.cc));
+        }
+        const std::shared_ptr<const LoopPlan> plan = *cached;
+
+        struct Iteration
+        {
+            std::unique_ptr<LoopVariable> var;
+            ObjectPtr list;
+            const ConsCell* cell = nullptr;
+            std::int64_t i = 0;
+            std::int64_t to = 0;
+            std::int64_t by = 1;
+        };
+        std::vector<Iteration> iterations(plan->fors.size());
+        for (size_t n = 0; n < plan->fors.size(); n++) {
+            const LoopPlan::For& f = plan->fors[n];
+            Iteration& it = iterations[n];
+            if (f.list) {
+                it.list = f.list->eval();
+                if (!it.list->isList()) {
+                    throw exceptions::WrongTypeArgument(it.list->toString());
+                }
+                it.cell = it.list->isNil() ? nullptr : it.list->asList()->cc.get();
+            }
+            else {
+                it.i = loopInt(*f.from->eval());
+                it.to = f.to ? loopInt(*f.to->eval()) : 0;
+                it.by = f.by ? loopInt(*f.by->eval()) : 1;
+                if (it.by <= 0) {
+                    throw exceptions::ArgsOutOfRange(std::to_string(it.by));
+                }
+            }
+            it.var = std::make_unique<LoopVariable>(*this, *f.var);
+        }
+
+        // Steps every for clause, and tells if none of them has run out.
+        auto advance = [&plan, &iterations]() {
+            for (size_t n = 0; n < plan->fors.size(); n++) {
+                const LoopPlan::For& f = plan->fors[n];
+                Iteration& it = iterations[n];
+                if (f.list) {
+                    if (!it.cell) {
+                        return false;
+                    }
+                    it.var->set(it.cell->car->clone());
+                    it.cell = it.cell->next();
+                    continue;
+                }
+                if (f.to && (f.below ? it.i >= it.to : it.i > it.to)) {
+                    return false;
+                }
+                it.var->set(it.i);
+                it.i += it.by;
+            }
+            return true;
+        };
+
+        ListBuilder collected(*this);
+        Number sum(std::int64_t(0));
+        while (advance()) {
+            for (const LoopPlan::Clause& clause : plan->body) {
+                switch (clause.action) {
+                case LoopPlan::Action::Do:
+                    clause.form->eval();
+                    break;
+                case LoopPlan::Action::Collect:
+                    collected.append(clause.form->eval());
+                    break;
+                case LoopPlan::Action::Append: {
+                    const ObjectPtr list = clause.form->eval();
+                    if (!list->isList()) {
+                        throw exceptions::WrongTypeArgument(list->toString());
+                    }
+                    for (const auto& obj : *list->asList()) {
+                        collected.append(obj.clone());
+                    }
+                    break;
+                }
+                case LoopPlan::Action::Sum: {
+                    const ObjectPtr value = clause.form->eval();
+                    if (!value->isInt() && !value->isFloat()) {
+                        throw exceptions::WrongTypeArgument(value->toString());
+                    }
+                    const Number n = value->value<Number>();
+                    if (sum.isFloat || n.isFloat) {
+                        sum = Number((sum.isFloat ? sum.f : sum.i) + (n.isFloat ? n.f : n.i));
+                    }
+                    else {
+                        sum = Number(sum.i + n.i);
+                    }
+                    break;
+                }
+                }
+            }
+        }
+        if (plan->sums) {
+            return makeObject(sum);
+        }
+        return plan->accumulates ? ObjectPtr(collected.get()) : makeNil();
+    });
+}
+
+}
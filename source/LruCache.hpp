@@ -0,0 +1,46 @@
+#pragma once
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace alisp
+{
+
+// Values compiled from strings, least recently used ones dropped first once the capacity is
+// reached.
+template<typename T>
+class LruCache
+{
+    using Entry = std::pair<std::string, std::shared_ptr<const T>>;
+
+    size_t m_capacity;
+    std::list<Entry> m_entries; // Most recently used first
+    std::unordered_map<std::string, typename std::list<Entry>::iterator> m_index;
+public:
+    LruCache(size_t capacity = 64) : m_capacity(capacity) {}
+
+    // Returns the value stored for the key, or creates it with make() if there is none.
+    template<typename F>
+    std::shared_ptr<const T> get(const std::string& key, F&& make)
+    {
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+            return it->second->second;
+        }
+        std::shared_ptr<const T> value = make();
+        m_entries.emplace_front(key, value);
+        m_index[key] = m_entries.begin();
+        if (m_entries.size() > m_capacity) {
+            m_index.erase(m_entries.back().first);
+            m_entries.pop_back();
+        }
+        return value;
+    }
+
+    size_t size() const { return m_entries.size(); }
+};
+
+}
@@ -1,3 +1,6 @@
+#include <charconv>
+#include <cmath>
+#include <cstring>
 #include <istream>
 #include <limits>
 #include <memory>
@@ -17,6 +20,9 @@
 #include "SymbolObject.hpp"
 #include "Init.hpp"
 #include "UTF8.hpp"
+#include "Unicode.hpp"
+#include "Backquote.hpp"
+#include "Loop.hpp"
 #include "StreamObject.hpp"
 
 namespace alisp {
@@ -31,11 +37,6 @@ ALISP_INLINE ObjectPtr Machine::set(bool quoted, FArgs& args)
     if (!name) {
         throw exceptions::WrongTypeArgument(p1->toString());
     }
-    if (!name->sym && m_locals.count(name->name) && m_locals[name->name].size()) {
-        auto& loc = m_locals[name->name].back()->variable;
-        loc = args.pop()->clone();
-        return loc->clone();
-    }
     auto sym = name->getSymbol();
     assert(sym);
     if (sym->constant) {
@@ -58,7 +59,7 @@ ALISP_INLINE Function* Machine::makeFunc(std::string name, int minArgs, int maxA
                                          const std::function<std::unique_ptr<Object>(FArgs &)>& f)
 {
     if (ConvertParsedNamesToUpperCase) {
-        name = utf8::toUpper(name);
+        name = unicode::upcase(name);
     }
     auto func = std::make_shared<Function>(*this);
     func->name = name;
@@ -66,37 +67,30 @@ ALISP_INLINE Function* Machine::makeFunc(std::string name, int minArgs, int maxA
     func->maxArgs = maxArgs;
     func->func = std::move(f);
     auto sym = getSymbol(name);
-    sym->function = std::make_unique<SubroutineObject>(func);
+    sym->setFunction(std::make_unique<SubroutineObject>(func));
     return func.get();
 }
 
-ALISP_INLINE std::shared_ptr<Symbol> Machine::getSymbolOrNull(std::string name, bool alwaysGlobal)
+ALISP_INLINE std::shared_ptr<Symbol> Machine::getSymbolOrNull(const std::string& name)
 {
-    if (!alwaysGlobal && m_locals.count(name)) {
-        return m_locals[name].back();
-    }
-    if (!m_syms.count(name)) {
-        return nullptr;
-    }
-    return m_syms[name];
+    const auto it = m_syms.find(name);
+    return it == m_syms.end() ? nullptr : it->second;
 }
 
-ALISP_INLINE std::shared_ptr<Symbol> Machine::getSymbol(std::string name, bool alwaysGlobal)
+ALISP_INLINE std::shared_ptr<Symbol> Machine::getSymbol(std::string name)
 {
-    if (!alwaysGlobal && m_locals.count(name)) {
-        return m_locals[name].back();
+    const auto it = m_syms.find(name);
+    if (it != m_syms.end()) {
+        return it->second;
     }
-    if (!m_syms.count(name)) {
-        auto newSym = std::make_shared<Symbol>(*this);
-        if (name.size() && name[0] == ':') {
-            newSym->constant = true;
-            newSym->variable = std::make_unique<SymbolObject>(this, nullptr, name);
-        }
-        m_syms[name] = newSym;
-        newSym->name = std::move(name);
-        return newSym;
+    auto newSym = std::make_shared<Symbol>(*this);
+    if (name.size() && name[0] == ':') {
+        newSym->constant = true;
+        newSym->variable = std::make_unique<SymbolObject>(this, nullptr, name);
     }
-    return m_syms[name];
+    m_syms[name] = newSym;
+    newSym->name = std::move(name);
+    return newSym;
 }
 
 ALISP_INLINE bool isWhiteSpace(const char c)
@@ -288,11 +282,18 @@ ALISP_INLINE std::unique_ptr<Object> Machine::parseNext(const char *&expr)
 
 ALISP_INLINE Machine::Machine(bool initStandardLibrary)
 {
+    m_nil = std::make_unique<ConsCellObject>(this);
+    m_nil->markShared();
+    m_t = std::make_unique<SymbolObject>(this, nullptr, TName);
+    m_t->markShared();
+    for (std::int64_t i = SmallIntMin; i <= SmallIntMax; i++) {
+        m_smallInts.push_back(alisp::makeInt(i));
+        m_smallInts.back()->markShared();
+    }
     setVariable(parsedSymbolName("&optional"),
                 std::make_unique<SymbolObject>(this, nullptr, parsedSymbolName("&optional")), true);
     setVariable(NilName, makeNil(), true);
-    setVariable(TName,
-                std::make_unique<SymbolObject>(this, nullptr, TName), true);
+    setVariable(TName, makeTrue(), true);
     if (!initStandardLibrary) {
         return;
     }
@@ -306,79 +307,20 @@ ALISP_INLINE Machine::Machine(bool initStandardLibrary)
                 makeInt(std::numeric_limits<std::int64_t>::max()));
     setVariable(parsedSymbolName("most-negative-fixnum"),
                 makeInt(std::numeric_limits<std::int64_t>::min()));
+    initSpecialForms();
     initFunctionFunctions();
     initErrorFunctions();
     initListFunctions();
+    initLoopFunctions();
     initMathFunctions();
     initMacroFunctions(*this);
     initSequenceFunctions();
     initStringFunctions();
     initSymbolFunctions();
+    initBufferFunctions();
     defun("atom", [](const Object& obj) { return !obj.isList() || obj.isNil(); });
     defun("null", [](bool isNil) { return !isNil; });
     defun("not", [](bool value) { return !value; });
-    makeFunc("if", 2, std::numeric_limits<int>::max(), [this](FArgs& args) {
-        if (!!*args.pop()) {
-            return args.pop()->clone();
-        }
-        args.skip();
-        while (auto res = args.pop()) {
-            if (!args.hasNext()) {
-                return res->clone();
-            }
-        }
-        return makeNil();
-    });
-    auto let = [this](FArgs& args, bool star) {
-        std::vector<std::string> varList;
-        std::vector<std::pair<std::string, std::unique_ptr<Object>>> pushList;
-        for (auto& arg : *args.cc->car->asList()) {
-            std::string name;
-            ObjectPtr value;
-            if (arg.isList()) {
-                auto list = arg.asList();
-                auto cc = list->cc.get();
-                const auto sym = dynamic_cast<const SymbolObject*>(cc->car.get());
-                assert(sym && sym->name.size());
-                name = sym->name;
-                value = cc->cdr->asList()->cc->car->eval();
-            }
-            else if (auto sym = dynamic_cast<const SymbolObject*>(&arg)) {
-                assert(sym->name.size());
-                name = sym->name;
-                value = makeNil();
-            }
-            else {
-                throw exceptions::WrongTypeArgument(arg.toString());
-            }
-            if (star) {
-                pushLocalVariable(name, std::move(value));
-                varList.push_back(name);
-            }
-            else {
-                pushList.emplace_back(name, std::move(value));
-            }
-        }
-        for (auto& push : pushList) {
-            pushLocalVariable(push.first, std::move(push.second));
-            varList.push_back(push.first);
-        }
-        AtScopeExit onExit([this, varList]() {
-            for (auto it = varList.rbegin(); it != varList.rend(); ++it) {
-                popLocalVariable(*it);
-            }
-        });
-        args.skip();
-        std::unique_ptr<Object> res = makeNil();
-        for (auto& obj : *args.cc) {
-            res = obj.eval();
-        }
-        return res;
-    };
-    makeFunc("let", 2, std::numeric_limits<int>::max(),
-             std::bind(let, std::placeholders::_1, false));
-    makeFunc("let*", 2, std::numeric_limits<int>::max(),
-             std::bind(let, std::placeholders::_1, true));
     makeFunc("quote", 1, 1, [this](FArgs& args) {
         return args.current() && !args.current()->isNil() ? args.current()->clone() : makeNil();
     });
@@ -390,60 +332,21 @@ ALISP_INLINE Machine::Machine(bool initStandardLibrary)
         if (!arg) {
             return makeNil();
         }
-        auto comma = getSymbol(",");
-        auto splice = getSymbol(",@");
-        auto backquote = [&](auto&& backquote, const Object& obj) -> ObjectPtr {
-            if (!obj.isList() || obj.isNil()) {
-                return obj.clone();
-            }
-            ListBuilder builder(*this);
-            for (const auto& obj : *obj.asList()) {
-                if (obj.isList() && !obj.isNil() && obj.asList()->car() == comma) {
-                    builder.append(obj.asList()->cadr()->eval());
-                }
-                else if (obj.isList() && !obj.isNil() && obj.asList()->car() == splice) {
-                    auto li = obj.asList()->cadr()->eval();
-                    if (li->isList()) {
-                        for (const auto& obj : *li->asList()) {
-                            builder.append(obj.clone());
-                        }
-                    }
-                    else {
-                        builder.append(std::move(li));
-                    }
-                }
-                else if (obj.isList()) {
-                    builder.append(backquote(backquote, obj));
-                }
-                else {
-                    builder.append(obj);                    
-                }
-            }
-            return builder.get();
-        };
-        return backquote(backquote, *arg);
-    });
-    defun("numberp", [](const Object& obj) { return obj.isInt() || obj.isFloat(); });
-    makeFunc("eval", 1, 1, [](FArgs& args) { return args.pop()->eval(); });
-    makeFunc("progn", 0, std::numeric_limits<int>::max(), [&](FArgs& args) {
-        std::unique_ptr<Object> ret;
-        for (auto obj : args) {
-            ret = std::move(obj);
+        if (!arg->isList() || arg->isNil()) {
+            return arg->clone();
         }
-        if (!ret) ret = makeNil();
-        return ret;
-    });
-    makeFunc("prog1", 0, std::numeric_limits<int>::max(), [&](FArgs& args) {
-        std::unique_ptr<Object> ret;
-        for (auto obj : args) {
-            assert(obj);
-            if (!ret) {
-                ret = std::move(obj);
-            }
+        const ConsCellPtr& form = arg->asList()->cc;
+        auto* cached = m_backquoteCache.find(*form);
+        if (!cached) {
+            cached = &m_backquoteCache.insert(form,
+                                              std::make_shared<BackquoteTemplate>(*this, *arg));
         }
-        if (!ret) ret = makeNil();
-        return ret;
+        // Filling in the template may evaluate code which purges the cache.
+        const std::shared_ptr<const BackquoteTemplate> plan = *cached;
+        return plan->fill();
     });
+    defun("numberp", [](const Object& obj) { return obj.isInt() || obj.isFloat(); });
+    makeFunc("eval", 1, 1, [](FArgs& args) { return args.pop()->eval(); });
     defun("prog2", [](const Object&, const Object& ret, Rest& rest) {
         rest.evalAll();
         return ret.clone();
@@ -462,8 +365,9 @@ ALISP_INLINE Machine::Machine(bool initStandardLibrary)
         if (!name || name->name.empty()) {
             throw exceptions::WrongTypeArgument(p1->toString());
         }
-        if (!m_syms.count(name->name)) {
-            auto sym = getSymbol(name->name);
+        // Binding a variable makes its symbol, so that is no sign of it having been defined.
+        auto sym = getSymbol(name->name);
+        if (!sym->variable) {
             if (args.hasNext()) {
                 sym->variable = args.pop(true)->clone();
             }
@@ -474,7 +378,27 @@ ALISP_INLINE Machine::Machine(bool initStandardLibrary)
                 }
             }
         }
-        return std::make_unique<SymbolObject>(this, m_syms[name->name], "");
+        return std::make_unique<SymbolObject>(this, sym, "");
+    });
+    makeFunc("defconst", 2, 3, [this](FArgs& args) {
+        const auto& p1 = args.pop(false);
+        const SymbolObject* name = dynamic_cast<SymbolObject*>(p1);
+        if (!name || name->name.empty()) {
+            throw exceptions::WrongTypeArgument(p1->toString());
+        }
+        if (name->name == TName || name->name[0] == ':') {
+            throw exceptions::SettingConstant(name->name);
+        }
+        auto sym = getSymbol(name->name);
+        sym->variable = args.pop()->clone();
+        sym->constant = true;
+        if (args.hasNext()) {
+            auto docString = args.pop();
+            if (docString->isString()) {
+                sym->description = docString->value<std::string>();
+            }
+        }
+        return std::make_unique<SymbolObject>(this, sym, "");
     });
     defun("eq", [this](const Object& obj1, const Object& obj2) { return obj1.eq(obj2); });
     defun("equal", [this](const Object& obj1, const Object& obj2) { return obj1.equal(obj2); });
@@ -520,17 +444,20 @@ ALISP_INLINE Machine::Machine(bool initStandardLibrary)
     });
     defun("nthcdr", [&](std::int64_t index, const Object& obj) {
         requireType<ConsCellObject>(obj);
-        const Object* p = obj.asList();
+        ConsCell* p = obj.asList()->cc.get();
         for (size_t i = 0; i < index; i++) {
-            if (!p || !p->asList()) {
-                if (p && !p->asList()) {
-                    throw exceptions::WrongTypeArgument(p->toString());
-                }
+            if (!p) {
                 return makeNil();
             }
-            p = p->asList()->cdr();
+            if (!p->next() && p->dotted()) {
+                if (i + 1 < static_cast<size_t>(index)) {
+                    throw exceptions::WrongTypeArgument(p->dotted()->toString());
+                }
+                return p->dotted()->clone();
+            }
+            p = p->next();
         }
-        return p->clone();
+        return ObjectPtr(std::make_unique<ConsCellObject>(ConsCellPtr(p), this));
     });
     defun("mapatoms", [this](const Function& func) {
         ConsCell cc;
@@ -541,50 +468,24 @@ ALISP_INLINE Machine::Machine(bool initStandardLibrary)
         }
         return makeNil();
     });
-    defun("xor", [](const Object& cond1, const Object& cond2) {
-        return (((!cond1 ? 1 : 0) + (!cond2 ? 1 : 0)) % 2) == 1;
+    defun("memory-use-counts", [this]() {
+        // Like in Emacs, these are cumulative counts of cons cells, objects and symbols created.
+        ListBuilder builder(*this);
+        builder.append(makeInt(memoryStats().total(MemoryKind::ConsCell)));
+        builder.append(makeInt(memoryStats().total(MemoryKind::Object)));
+        builder.append(makeInt(memoryStats().total(MemoryKind::Symbol)));
+        return builder.get();
     });
-    defun("and", [](Rest& args) -> ObjectPtr {
-        ObjectPtr ret = args.m.makeTrue();
-        while (args.cc) {
-            ret = args.pop()->clone();
-            if (ret->isNil()) {
-                break;
-            }
-        }
-        return ret;
+    defun("xor",[](const Object& cond1, const Object& cond2) {
+        return (((!cond1 ? 1 : 0) + (!cond2 ? 1 : 0)) % 2) == 1;
     });
     defun("type-of", [this](const Object& obj) {
         return makeSymbol(obj.typeOf(), true);
     });
-    defun("or", [this](Rest& args) {
-        for (const auto& obj : args) {
-            if (!obj->isNil()) {
-                return obj->clone();
-            }
-        }
-        return makeNil();
-    });
-    makeFunc("while", 1, std::numeric_limits<int>::max(), [this](FArgs& args) {
-        while (!args.current()->eval()->isNil()) {
-            args.evalAll(args.cc->next());
-        }
-        return makeNil();
-    });
     defun("integerp", [](const Object& obj) { return obj.isInt(); });
     defun("floatp", [](const Object& obj) { return obj.isFloat(); });
     defun("zerop", [](Number obj) { return obj.isFloat ? (obj.f == 0) : (obj.i == 0); });
-    defun("cond", [this](Rest& args) {
-        while (args.current()) {
-            const Object& obj = *args.current();
-            requireType<ConsCellObject>(obj);
-            if (!obj.asList()->car()->eval()->isNil()) {
-                return obj.asList()->cadr()->eval();
-            }
-            args.skip();
-        }
-        return makeNil();
-    });
+    initOptimizer();
     evaluate(getInitCode());
 }
 
@@ -593,7 +494,7 @@ ALISP_INLINE std::string Machine::parsedSymbolName(std::string name)
     if (!ConvertParsedNamesToUpperCase) {
         return name;
     }
-    return utf8::toUpper(name);
+    return unicode::upcase(name);
 }
 
 ALISP_INLINE std::unique_ptr<Object> Machine::parse(const char *expr)
@@ -646,8 +547,17 @@ ALISP_INLINE std::unique_ptr<Object> Machine::makeObject(const Object& obj)
     return obj.clone();
 }
 
-ALISP_INLINE
-std::unique_ptr<Object> Machine::makeNil() { return alisp::makeNil(this); }
+ALISP_INLINE Machine::~Machine() {}
+
+ALISP_INLINE std::unique_ptr<Object> Machine::makeNil() { return ObjectPtr(m_nil.get()); }
+
+ALISP_INLINE std::unique_ptr<Object> Machine::makeInt(std::int64_t value) const
+{
+    if (value >= SmallIntMin && value <= SmallIntMax) {
+        return ObjectPtr(m_smallInts[value - SmallIntMin].get());
+    }
+    return alisp::makeInt(value);
+}
 
 ALISP_INLINE std::unique_ptr<Object> Machine::makeObject(std::unique_ptr<Object> o)
 {
@@ -700,7 +610,7 @@ ALISP_INLINE std::unique_ptr<Object> Machine::parseNamedObject(const char*& str)
         return num;
     }
     if (ConvertParsedNamesToUpperCase) {
-        next = utf8::toUpper(next);
+        next = unicode::upcase(next);
     }
     if (next == parsedSymbolName("nil")) {
         // It's optimal to return nil already at this point.
@@ -714,31 +624,36 @@ ALISP_INLINE std::unique_ptr<Object> Machine::parseNamedObject(const char*& str)
 
 ALISP_INLINE std::unique_ptr<StringObject> Machine::parseString(const char*& str)
 {
-    bool escape = false;
-    auto sym = std::make_unique<StringObject>("");
-    while (*str && ((*str != '"' && !escape) || (*str == '"' && escape))) {
-        escape = false;
-        std::uint32_t encoding;
-        const size_t proceed = utf8::next(str, &encoding);
-        if (!proceed) {
-            throw std::runtime_error("UTF8-error");
-        }
-        const std::uint32_t codepoint = utf8::decode(encoding);
-        if (codepoint == '\\') {
-            escape = true;
-            str += 1;
-            continue;
+    std::string parsed;
+    for (;;) {
+        // Bytes of multibyte characters are never quotes or backslashes, so everything up to
+        // the next one of those is copied as it is.
+        const size_t run = std::strcspn(str, "\"\\");
+        parsed.append(str, run);
+        str += run;
+        if (!*str || (*str == '\\' && !str[1])) {
+            throw std::runtime_error("Unexpected EOF");
         }
-        for (size_t i = 0; i < proceed; i++) {
-            *sym->value += *str;
-            str += 1;
+        if (*str == '"') {
+            str++;
+            break;
+        }
+        const char c = str[1];
+        str += 2;
+        switch (c) {
+        case 'n': parsed += '\n'; break;
+        case 't': parsed += '\t'; break;
+        case 'r': parsed += '\r'; break;
+        case 'f': parsed += '\f'; break;
+        case 'v': parsed += '\v'; break;
+        case 'a': parsed += '\a'; break;
+        case 'e': parsed += '\x1b'; break;
+        case 'd': parsed += '\x7f'; break;
+        case '\n': break; // An escaped newline is ignored
+        default: parsed += c; break;
         }
     }
-    if (!*str) {
-        throw std::runtime_error("Unexpected EOF");
-    }
-    str++;
-    return sym;
+    return std::make_unique<StringObject>(m_strings.intern(std::move(parsed)));
 }
 
 ALISP_INLINE
@@ -800,13 +715,9 @@ std::unique_ptr<Object> Machine::getNumericConstant(const std::string& str) cons
                 return nullptr;
             }
         }
-        else if (c == '+') {
-            if (i > 0) {
-                return nullptr;
-            }
-        }
-        else if (c == '-') {
-            if (i > 0) {
+        else if (c == '+' || c == '-') {
+            // A sign can start the number or its exponent.
+            if (i > 0 && str[i - 1] != 'e') {
                 return nullptr;
             }
         }
@@ -820,53 +731,97 @@ std::unique_ptr<Object> Machine::getNumericConstant(const std::string& str) cons
     if (!digits) {
         return nullptr;
     }
-    std::stringstream ss(str);
+    const char* begin = str.c_str() + (str[0] == '+');
+    const char* end = str.c_str() + str.size();
     if (dotCount || exps) {
-        double value;
-        ss >> value;
+        double value = 0;
+        if (std::from_chars(begin, end, value).ptr != end) {
+            return nullptr;
+        }
         return makeFloat(value);
     }
-    else {
-        std::int64_t value;
-        ss >> value;
-        return makeInt(value);
+    std::int64_t value = 0;
+    const auto result = std::from_chars(begin, end, value);
+    if (result.ptr != end) {
+        return nullptr;
+    }
+    if (result.ec == std::errc::result_out_of_range) {
+        // Without bignums an integer which does not fit is read as a float.
+        double f = 0;
+        std::from_chars(begin, end, f);
+        return makeFloat(f);
     }
+    return makeInt(value);
 }
 
 ALISP_INLINE std::unique_ptr<Object> Machine::makeTrue() 
 {
-    return std::make_unique<SymbolObject>(this, nullptr, TName);
+    return ObjectPtr(m_t.get());
 }
 
-ALISP_INLINE void Machine::pushLocalVariable(std::string name, ObjectPtr obj)
+ALISP_INLINE void Machine::bindVariable(Symbol& sym, ObjectPtr value)
 {
-    auto sym = std::make_shared<Symbol>(*this);
-    m_locals[name].push_back(sym);
-    sym->name = std::move(name);
-    sym->variable = std::move(obj);
-    sym->local = true;
+    // Constants cannot be bound any more than set, which lets their values be folded into
+    // code. Whether the symbol is constant is still restored, as defconst may be evaluated
+    // while the binding lasts.
+    if (sym.constant) {
+        throw exceptions::SettingConstant(sym.name);
+    }
+    m_specpdl.push_back(SpecBinding{sym.shared_from_this(), std::move(sym.variable), sym.constant});
+    sym.variable = std::move(value);
+}
+
+ALISP_INLINE void Machine::bindVariable(const SymbolObject& var, ObjectPtr value)
+{
+    Symbol* sym = var.getSymbolOrNull();
+    bindVariable(sym ? *sym : *var.getSymbol(), std::move(value));
+}
+
+ALISP_INLINE void Machine::bindVariable(const std::string& name, ObjectPtr value)
+{
+    bindVariable(*getSymbol(name), std::move(value));
 }
 
-ALISP_INLINE bool Machine::popLocalVariable(std::string name)
+ALISP_INLINE void Machine::unbindVariables(size_t depth)
 {
-    assert(m_locals[name].size());
-    m_locals[name].pop_back();
-    if (m_locals[name].empty()) {
-        m_locals.erase(name);
+    while (m_specpdl.size() > depth) {
+        SpecBinding& binding = m_specpdl.back();
+        binding.symbol->variable = std::move(binding.value);
+        binding.symbol->constant = binding.constant;
+        m_specpdl.pop_back();
     }
-    return true;
 }
 
 ALISP_INLINE std::unique_ptr<Object> Machine::evaluate(const char *expr)
 {
+    // Once the code is gone, so are the expansions of the macro calls in it.
+    const AtScopeExit purge([this]{
+        m_macroCache.purge();
+        m_backquoteCache.purge();
+        m_loopCache.purge();
+    });
     auto obj = parse(expr);
-    return obj ? obj->eval() : nullptr;
+    const size_t frames = m_unwoundFrames.size();
+    try {
+        return obj ? obj->eval() : nullptr;
+    }
+    catch (exceptions::Error& err) {
+        err.frames.assign(m_unwoundFrames.begin() + frames, m_unwoundFrames.end());
+        err.machine = this;
+        m_unwoundFrames.resize(frames);
+        err.formatFrames();
+        throw;
+    }
+    catch (...) {
+        m_unwoundFrames.resize(frames);
+        throw;
+    }
 }
 
 ALISP_INLINE Machine::SymbolRef Machine::operator[](const char* name)
 {
     SymbolRef ref;
-    ref.symbol = getSymbol(name, true);
+    ref.symbol = getSymbol(name);
     return ref;
 }
 
@@ -1,4 +1,5 @@
 #pragma once
+#include <iosfwd>
 #include <map>
 #include <type_traits>
 #include "Error.hpp"
@@ -8,12 +9,21 @@
 #include "Symbol.hpp"
 #include "FArgs.hpp"
 #include "String.hpp"
+#include "Regex.hpp"
+#include "Buffer.hpp"
+#include "Format.hpp"
+#include "LruCache.hpp"
+#include "FormCache.hpp"
 
 namespace alisp {
 
+class BackquoteTemplate;
+struct LoopPlan;
 struct Closure;
 struct ConsCellObject;
 struct StringObject;
+struct SymbolObject;
+struct IntObject;
 struct Number;
 
 template<typename T, typename O>
@@ -26,11 +36,65 @@ void requireType(const O& obj)
 
 class Machine
 {
+    // Canonical objects which are handed out instead of allocating new ones. These are declared
+    // first so that they outlive everything which may still point to them.
+    std::unique_ptr<ConsCellObject> m_nil;
+    std::unique_ptr<SymbolObject> m_t;
+    std::vector<std::unique_ptr<IntObject>> m_smallInts;
+
     std::map<std::string, std::shared_ptr<Symbol>> m_syms;
-    std::map<std::string, std::vector<std::shared_ptr<Symbol>>> m_locals;
 
-    void pushLocalVariable(std::string name, std::unique_ptr<Object> obj);
-    bool popLocalVariable(std::string name);
+    // Variables are bound dynamically by giving the symbol the new value and keeping the old
+    // one here until the binding ends, like the specpdl of Emacs. The value of a variable is
+    // then always in its symbol, whether the variable is bound or not.
+    struct SpecBinding
+    {
+        std::shared_ptr<Symbol> symbol;
+        ObjectPtr value;
+        bool constant;
+    };
+    std::vector<SpecBinding> m_specpdl;
+    std::vector<const Object*> m_catchTags; // Of the catch forms being evaluated, innermost last
+
+    std::vector<ConsCell*> m_evalStack; // Forms being evaluated, innermost last
+    std::uint32_t m_symbolTableVersion = 0; // See symbolTableVersion()
+
+    // Forms whose evaluation an error or a throw has left, innermost first. A handler drops the
+    // frames unwound since it was entered, and frames which reach Machine::evaluate go to the
+    // error. Recording them as the stack unwinds instead of catching and throwing again in
+    // every frame keeps non-local exits from deep code cheap.
+    std::vector<ConsCellPtr> m_unwoundFrames;
+
+    StringTable m_strings; // Text of string literals and symbol names
+
+    regex::Cache m_regexCache;
+    std::vector<std::int64_t> m_matchData; // Character positions of the last match, -1 if none
+    std::optional<String> m_matchString;
+    std::shared_ptr<Buffer> m_matchBuffer; // Set instead of m_matchString after a buffer search
+
+    LruCache<FormatString> m_formatCache;
+
+    // The definition of the macro a call was expanded with is kept to notice redefinitions.
+    struct MacroExpansion
+    {
+        ConsCellPtr definition;
+        ObjectPtr expansion;
+    };
+    FormCache<MacroExpansion> m_macroCache;
+    FormCache<std::shared_ptr<const BackquoteTemplate>> m_backquoteCache;
+    FormCache<std::shared_ptr<const LoopPlan>> m_loopCache;
+
+    std::map<std::string, std::shared_ptr<Buffer>> m_buffers;
+    std::shared_ptr<Buffer> m_currentBuffer;
+
+    // Binds a variable until unbindVariables() ends the bindings made after a depth of the
+    // specpdl, which bindingDepth() tells. Binding through the symbol, or through a symbol
+    // object which has found it before, does not look the name up.
+    void bindVariable(Symbol& sym, ObjectPtr value);
+    void bindVariable(const SymbolObject& var, ObjectPtr value);
+    void bindVariable(const std::string& name, ObjectPtr value);
+    void unbindVariables(size_t depth);
+    size_t bindingDepth() const { return m_specpdl.size(); }
     
     std::unique_ptr<Object> makeObject(Number num);
     std::unique_ptr<Object> makeObject(double value);
@@ -62,15 +126,19 @@ class Machine
     std::function<ObjectPtr(FArgs&)> genCaller(std::function<R(Args...)> f,
                                                std::index_sequence<Is...>)
     {
+        // Parameters are popped inside a braced initializer so that they are evaluated from
+        // left to right regardless of the compiler's function argument evaluation order.
         if constexpr (std::is_same_v<R, void>) {
             return [=](FArgs& args) {
-                f((getFuncParam<typename std::tuple_element_t<Is, std::tuple<Args...>>>(args))...);
+                std::tuple<Args...> params{getFuncParam<Args>(args)...};
+                std::apply(f, std::move(params));
                 return makeNil();
             };
         }
         else {
             return [=](FArgs& args) {
-                return makeObject(f((getFuncParam<std::tuple_element_t<Is, std::tuple<Args...>>>(args))...));
+                std::tuple<Args...> params{getFuncParam<Args>(args)...};
+                return makeObject(std::apply(f, std::move(params)));
             };
         }
     }
@@ -95,8 +163,22 @@ class Machine
     void initStringFunctions();
     void initSymbolFunctions();
     void initSequenceFunctions();
+    void initBufferFunctions();
+    void initSpecialForms();
+    void initLoopFunctions();
+
+    void initOptimizer();
+
+    class LoopVariable;
+    class Optimizer;
+
+    ObjectPtr let(const ConsCell* args, bool star);
 public:
+    static constexpr std::int64_t SmallIntMin = -128;
+    static constexpr std::int64_t SmallIntMax = 1023;
+
     std::unique_ptr<Object> makeNil();
+    std::unique_ptr<Object> makeInt(std::int64_t value) const;
     std::unique_ptr<ConsCellObject> makeConsCell(ObjectPtr car, ObjectPtr cdr = nullptr);
     std::unique_ptr<SymbolObject> makeSymbol(std::string name, bool parsedName);
     std::unique_ptr<Object> quote(std::unique_ptr<Object> obj, const char* quoteFunc = "quote");
@@ -107,6 +189,44 @@ public:
     ObjectPtr set(bool quoted, FArgs& args);
     ObjectPtr execute(const ConsCellObject& lambda, FArgs& a);
 
+    // Called by the evaluator around evaluating a form. enterFrame returns the number of forms
+    // being evaluated, the new one included. A form which is left because of an error or a
+    // throw is recorded for the stack trace.
+    size_t enterFrame(ConsCell* form)
+    {
+        m_evalStack.push_back(form);
+        return m_evalStack.size();
+    }
+
+    void leaveFrame(bool unwinding)
+    {
+        if (unwinding) {
+            m_unwoundFrames.emplace_back(m_evalStack.back());
+        }
+        m_evalStack.pop_back();
+    }
+
+    // Evaluates a control form which the evaluator handles itself, given the forms after the
+    // symbol it starts with.
+    ObjectPtr evalSpecialForm(SpecialForm form, const ConsCell* args);
+
+    // Evaluates a call to a macro. The call is expanded the first time and the same expansion
+    // is evaluated from then on, until the macro is redefined.
+    ObjectPtr evalMacroCall(const ConsCellObject& form, const ConsCellObject& definition);
+
+    // Expands all macro calls in a form and in the forms inside it, which leaves code which
+    // does not call any macros.
+    ObjectPtr macroExpandAll(const Object& form);
+
+    // Whether defun, defmacro and lambda expand the macros of a body when they are defined,
+    // which they do when eager-macroexpand is non-nil.
+    bool expandsMacrosEagerly();
+
+    // Folds the calls of pure functions with constant arguments in a form whose macros have
+    // been expanded, replaces constant variables with their values and drops the branches of
+    // if which a constant condition never takes. A lambda expression has its body folded.
+    ObjectPtr optimize(const Object& form);
+
     Function* makeFunc(std::string name, int minArgs, int maxArgs,
                        const std::function<std::unique_ptr<Object>(FArgs &)>& f);
     Function* makeSpecialForm(std::string name, int minArgs, int maxArgs,
@@ -114,6 +234,7 @@ public:
 
     Machine(bool initStandardLibrary = true);
     Machine(const Machine&) = delete;
+    ~Machine();
 
     template<typename F>
     void defun(const char* name, F&& f)
@@ -122,10 +243,18 @@ public:
     }
 
     void setVariable(std::string name, std::unique_ptr<Object> obj, bool constant = false);
-    std::shared_ptr<Symbol> getSymbolOrNull(std::string name, bool alwaysGlobal = false);
-    std::shared_ptr<Symbol> getSymbol(std::string name, bool alwaysGlobal = false);
+    std::shared_ptr<Symbol> getSymbolOrNull(const std::string& name);
+    std::shared_ptr<Symbol> getSymbol(std::string name);
     std::unique_ptr<Object> makeTrue();
 
+    // Changes when a symbol is uninterned, after which its name may come to mean another
+    // symbol. Symbol objects which only have a name cache their symbol until this changes.
+    std::uint32_t symbolTableVersion() const { return m_symbolTableVersion; }
+    void symbolTableChanged() { m_symbolTableVersion++; }
+
+    // Where printing goes unless a stream is given: the value of *standard-output*.
+    std::ostream& standardOutput();
+
     struct SymbolRef
     {
         std::shared_ptr<Symbol> symbol;
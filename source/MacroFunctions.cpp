@@ -31,8 +31,9 @@ ALISP_STATIC std::pair<bool, ConsCellObject*> isMacroCall(const ConsCellObject*
     if (form && form->car() && form->car()->isSymbol()) {
         const SymbolObject* sym = dynamic_cast<const SymbolObject*>(form->car());
         assert(sym);
-        if (sym->getSymbol()->function->isList()) {
-            auto list = sym->getSymbol()->function->asList();
+        const auto& function = sym->getSymbol()->function;
+        if (function && function->isList()) {
+            auto list = function->asList();
             if (list->car() && list->car()->isSymbol() &&
                 list->car() == form->parent->getSymbol(MacroName))
             {
@@ -47,8 +48,9 @@ ObjectPtr expand(Machine& m,
                  ConsCellObject* code,
                  std::function<Object*()> paramSource)
 {
-    const auto params = getFuncParams(*code->cdr()->asList());
-    code = code->cdr()->asList()->cdr()->asList();
+    const ConsCell* lambda = code->cc->next();
+    const auto params = getFuncParams(*lambda);
+    const ConsCellObject body(lambda->nextCell(), &m);
     ListBuilder builder(m);
     ObjectPtr restList;
     std::map<std::string, Object*> conv;
@@ -67,7 +69,7 @@ ObjectPtr expand(Machine& m,
             conv[params.names[i]] = paramSource();
         }
     }
-    auto copied = code->deepCopy();
+    auto copied = body.deepCopy();
     renameSymbols(m, *copied, conv);
     ObjectPtr ret;
     for (const auto& obj : *copied) {
@@ -76,6 +78,32 @@ ObjectPtr expand(Machine& m,
     return ret;
 }
 
+ALISP_INLINE ObjectPtr Machine::evalMacroCall(const ConsCellObject& form,
+                                             const ConsCellObject& definition)
+{
+    MacroExpansion* cached = m_macroCache.find(*form.cc);
+    if (!cached || cached->definition.get() != definition.cc.get()) {
+        ConsCellObject lambda(definition.cc->nextCell(), this);
+        const FuncParams params = getFuncParams(*lambda.cc->next());
+        int argc = 0;
+        for (const ConsCell* arg = form.cc->next(); arg; arg = arg->next()) {
+            argc++;
+        }
+        if (argc < params.min || argc > params.max) {
+            throw exceptions::WrongNumberOfArguments(argc);
+        }
+        const ConsCell* arg = form.cc.get();
+        ObjectPtr expanded = expand(*this, &lambda, [&arg]() {
+            arg = arg->next();
+            return arg ? arg->car.get() : nullptr;
+        });
+        cached = &m_macroCache.insert(form.cc, MacroExpansion{definition.cc, std::move(expanded)});
+    }
+    // Evaluating the expansion may redefine the macro and replace the expansion in the cache,
+    // so it is a reference of its own which is evaluated.
+    return cached->expansion->clone()->eval();
+}
+
 ObjectPtr macroExpand(bool once,
                       ObjectPtr obj)
 {
@@ -88,10 +116,10 @@ ObjectPtr macroExpand(bool once,
         if (!macroCall.first) {
             break;
         }
-        auto code = macroCall.second->cdr()->asList();
+        ConsCellObject code(macroCall.second->cc->nextCell(), form->parent);
         auto cc = form->cc.get();
         obj = expand(*form->parent,
-                     code,
+                     &code,
                      [&cc](){ cc = cc->next(); return cc ? cc->car.get() : nullptr; });
         if (once) {
             break;
@@ -100,6 +128,175 @@ ObjectPtr macroExpand(bool once,
     return obj->clone();
 }
 
+// Copies the forms from a cell to the end of its list, each with its macros expanded.
+ALISP_STATIC void expandForms(Machine& m, ListBuilder& builder, const ConsCell* cc)
+{
+    for (; cc; cc = cc->next()) {
+        builder.append(m.macroExpandAll(*cc->car));
+        if (cc->dotted()) {
+            builder.dot(cc->dotted()->clone());
+        }
+    }
+}
+
+// Copies (lambda ARGS . BODY) with the macros of the body expanded.
+ALISP_STATIC ObjectPtr expandLambda(Machine& m, const Object& lambda)
+{
+    const ConsCell* cc = lambda.asList()->cc.get();
+    ListBuilder builder(m);
+    builder.append(cc->car->clone());
+    if ((cc = cc->next())) {
+        builder.append(cc->car->clone());
+        expandForms(m, builder, cc->next());
+    }
+    return builder.get();
+}
+
+ALISP_STATIC bool isUnquote(const Object& obj)
+{
+    const SymbolObject* sym = obj.asSymbol();
+    const std::string* name = sym ? &(sym->sym ? sym->sym->name : sym->name) : nullptr;
+    return name && (*name == "," || *name == ",@");
+}
+
+// Copies a backquote template with the macros of its unquoted forms expanded. Returns null if
+// there are none, in which case the template is left as it is.
+ALISP_STATIC ObjectPtr expandTemplate(Machine& m, const Object& templ)
+{
+    if (!templ.isList() || templ.isNil()) {
+        return nullptr;
+    }
+    ListBuilder builder(m);
+    bool unquoted = false;
+    for (const ConsCell* cc = templ.asList()->cc.get(); cc; cc = cc->next()) {
+        if (isUnquote(*cc->car) && cc->next()) {
+            // Both (\, form) and `(a . ,b), which is read as (a \, b).
+            builder.append(cc->car->clone());
+            expandForms(m, builder, cc->next());
+            unquoted = true;
+            break;
+        }
+        ObjectPtr element = expandTemplate(m, *cc->car);
+        unquoted = unquoted || element;
+        builder.append(element ? std::move(element) : cc->car->clone());
+        if (cc->dotted()) {
+            ObjectPtr tail = expandTemplate(m, *cc->dotted());
+            unquoted = unquoted || tail;
+            builder.dot(tail ? std::move(tail) : cc->dotted()->clone());
+        }
+    }
+    return unquoted ? builder.get() : nullptr;
+}
+
+ALISP_INLINE ObjectPtr Machine::macroExpandAll(const Object& form)
+{
+    ObjectPtr expanded = macroExpand(false, form.clone());
+    if (!expanded->isList() || expanded->isNil()) {
+        return expanded;
+    }
+    const ConsCell* cc = expanded->asList()->cc.get();
+    const SymbolObject* head = cc->car->asSymbol();
+    const std::string name = head ? (head->sym ? head->sym->name : head->name) : "";
+    auto is = [this, &name](const char* special) { return name == parsedSymbolName(special); };
+    auto isLambda = [&is](const Object& obj) {
+        const SymbolObject* car = obj.isList() && !obj.isNil() ? obj.asList()->car()->asSymbol() :
+            nullptr;
+        return car && (car->sym ? car->sym->name : car->name) == LambdaName;
+    };
+    if (is("quote")) {
+        return expanded;
+    }
+    if (is("backquote")) {
+        ObjectPtr templ = cc->next() ? expandTemplate(*this, *cc->next()->car) : nullptr;
+        if (!templ) {
+            return expanded;
+        }
+        ListBuilder builder(*this);
+        builder.append(cc->car->clone());
+        builder.append(std::move(templ));
+        return builder.get();
+    }
+
+    // Most special forms only have forms as their arguments, like function calls. Those which
+    // also take other things are taken apart.
+    ListBuilder builder(*this);
+    builder.append(isLambda(*cc->car) ? expandLambda(*this, *cc->car) : cc->car->clone());
+    cc = cc->next();
+    if (!cc) {
+        return builder.get();
+    }
+    if (is("function")) {
+        builder.append(isLambda(*cc->car) ? expandLambda(*this, *cc->car) : cc->car->clone());
+        cc = cc->next();
+    }
+    else if (is("let") || is("let*")) {
+        ListBuilder bindings(*this);
+        for (const Object& binding : *cc->car->asList()) {
+            if (binding.isList() && !binding.isNil()) {
+                ListBuilder expandedBinding(*this);
+                expandedBinding.append(binding.asList()->car()->clone());
+                expandForms(*this, expandedBinding, binding.asList()->cc->next());
+                bindings.append(expandedBinding.get());
+            }
+            else {
+                bindings.append(binding.clone());
+            }
+        }
+        builder.append(bindings.get());
+        cc = cc->next();
+    }
+    else if (is("cond")) {
+        for (; cc; cc = cc->next()) {
+            ListBuilder clause(*this);
+            if (cc->car->isList() && !cc->car->isNil()) {
+                expandForms(*this, clause, cc->car->asList()->cc.get());
+                builder.append(clause.get());
+            }
+            else {
+                builder.append(cc->car->clone());
+            }
+        }
+    }
+    else if (is("condition-case")) {
+        builder.append(cc->car->clone());
+        if ((cc = cc->next())) {
+            builder.append(macroExpandAll(*cc->car));
+            for (cc = cc->next(); cc; cc = cc->next()) {
+                if (!cc->car->isList() || cc->car->isNil()) {
+                    builder.append(cc->car->clone());
+                    continue;
+                }
+                ListBuilder handler(*this);
+                handler.append(cc->car->asList()->car()->clone());
+                expandForms(*this, handler, cc->car->asList()->cc->next());
+                builder.append(handler.get());
+            }
+        }
+    }
+    else if (is("defun") || is("defmacro")) {
+        builder.append(cc->car->clone());
+        if ((cc = cc->next())) {
+            builder.append(cc->car->clone());
+            cc = cc->next();
+        }
+    }
+    else if ((is("dolist") || is("dotimes")) && cc->car->isList() && !cc->car->isNil()) {
+        ListBuilder spec(*this);
+        spec.append(cc->car->asList()->car()->clone());
+        expandForms(*this, spec, cc->car->asList()->cc->next());
+        builder.append(spec.get());
+        cc = cc->next();
+    }
+    expandForms(*this, builder, cc);
+    return builder.get();
+}
+
+ALISP_INLINE bool Machine::expandsMacrosEagerly()
+{
+    const auto eager = getSymbolOrNull(parsedSymbolName("eager-macroexpand"));
+    return eager && eager->variable && !eager->variable->isNil();
+}
+
 void initMacroFunctions(Machine& m)
 {
     m.makeFunc("defmacro", 2, std::numeric_limits<int>::max(), [&m](FArgs& args) {
@@ -113,11 +310,12 @@ void initMacroFunctions(Machine& m)
         builder.append(m.makeSymbol("lambda", true));
         args.skip();
         auto cc = args.cc;
-        while (cc && cc->car) {
-            builder.append(cc->car->clone());
-            cc = cc->next();
+        const bool eager = m.expandsMacrosEagerly();
+        for (bool params = true; cc && cc->car; cc = cc->next(), params = false) {
+            builder.append(eager && !params ? m.macroExpandAll(*cc->car) : cc->car->clone());
         }
-        m.getSymbol(macroName)->function = builder.get();
+        const auto sym = m.getSymbol(macroName);
+        sym->setFunction(builder.get());
         return std::make_unique<SymbolObject>(&m, nullptr, std::move(macroName));
     });
     m.defun("macroexpand", [](ObjectPtr obj) { 
@@ -126,6 +324,7 @@ void initMacroFunctions(Machine& m)
     m.defun("macroexpand-1", [](ObjectPtr obj) {
         return macroExpand(true, std::move(obj));
     });
+    m.defun("macroexpand-all", [&m](const Object& obj) { return m.macroExpandAll(obj); });
 }
 
 }
@@ -147,7 +147,7 @@ ALISP_INLINE void Machine::initMathFunctions()
         num.i -= 1;
         return num;
     });
-    makeFunc("+", 0, 0xffff, [](FArgs& args) {
+    makeFunc("+", 0, 0xffff, [this](FArgs& args) {
         std::int64_t i = 0;
         double f = 0;
         bool fp = false;
@@ -170,7 +170,7 @@ ALISP_INLINE void Machine::initMathFunctions()
         return fp ? static_cast<std::unique_ptr<Object>>(makeFloat(f))
             : static_cast<std::unique_ptr<Object>>(makeInt(i));
     });
-    makeFunc("*", 0, 0xffff, [](FArgs& args) {
+    makeFunc("*", 0, 0xffff, [this](FArgs& args) {
         std::int64_t i = 1;
         double f = 1;
         bool fp = false;
@@ -193,7 +193,7 @@ ALISP_INLINE void Machine::initMathFunctions()
         return fp ? static_cast<std::unique_ptr<Object>>(makeFloat(f))
             : static_cast<std::unique_ptr<Object>>(makeInt(i));
     });
-    makeFunc("/", 1, 0xffff, [](FArgs& args) {
+    makeFunc("/", 1, 0xffff, [this](FArgs& args) {
         std::int64_t i = 0;
         double f = 0;
         bool first = true;
@@ -0,0 +1,105 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+
+namespace alisp
+{
+
+struct Object;
+
+enum class MemoryKind
+{
+    Object,
+    ConsCell,
+    Symbol,
+    Count
+};
+
+// Allocation accounting which is cheap enough to leave on. Creating or destroying an object,
+// cons cell or symbol costs a couple of relaxed atomic increments. For leak hunting every Nth
+// object can also be sampled; only the sampled ones are remembered so that they can be listed.
+class MemoryStats
+{
+    struct Counter
+    {
+        std::atomic<std::int64_t> live{0};
+        std::atomic<std::int64_t> total{0};
+        std::atomic<std::int64_t> bytes{0};
+    };
+
+    Counter m_counters[static_cast<size_t>(MemoryKind::Count)];
+    std::atomic<std::uint64_t> m_sampleInterval{0};
+    std::atomic<std::uint64_t> m_untilSample{0};
+    std::mutex m_sampleMutex;
+    std::unordered_set<const Object*> m_sampled;
+
+    Counter& counter(MemoryKind kind) { return m_counters[static_cast<size_t>(kind)]; }
+    const Counter& counter(MemoryKind kind) const { return m_counters[static_cast<size_t>(kind)]; }
+public:
+    void created(MemoryKind kind)
+    {
+        counter(kind).live.fetch_add(1, std::memory_order_relaxed);
+        counter(kind).total.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void destroyed(MemoryKind kind) { counter(kind).live.fetch_sub(1, std::memory_order_relaxed); }
+
+    void allocated(MemoryKind kind, size_t bytes)
+    {
+        counter(kind).bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void freed(MemoryKind kind, size_t bytes)
+    {
+        counter(kind).bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    // Number of instances alive right now, number created so far and heap bytes in use.
+    std::int64_t live(MemoryKind kind) const { return counter(kind).live; }
+    std::int64_t total(MemoryKind kind) const { return counter(kind).total; }
+    std::int64_t bytes(MemoryKind kind) const { return counter(kind).bytes; }
+
+    // Samples every Nth object created from now on. Zero turns sampling off.
+    void setSampleInterval(std::uint64_t interval)
+    {
+        m_sampleInterval = interval;
+        m_untilSample = interval;
+    }
+
+    bool sampleCreated(const Object* obj)
+    {
+        if (!m_sampleInterval.load(std::memory_order_relaxed) ||
+            m_untilSample.fetch_sub(1, std::memory_order_relaxed) != 1) {
+            return false;
+        }
+        m_untilSample = m_sampleInterval.load();
+        std::lock_guard<std::mutex> lock(m_sampleMutex);
+        m_sampled.insert(obj);
+        return true;
+    }
+
+    void sampleDestroyed(const Object* obj)
+    {
+        std::lock_guard<std::mutex> lock(m_sampleMutex);
+        m_sampled.erase(obj);
+    }
+
+    void forEachSampled(const std::function<void(const Object&)>& f)
+    {
+        std::lock_guard<std::mutex> lock(m_sampleMutex);
+        for (auto obj : m_sampled) {
+            f(*obj);
+        }
+    }
+};
+
+inline MemoryStats& memoryStats()
+{
+    static MemoryStats stats;
+    return stats;
+}
+
+}
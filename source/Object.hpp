@@ -1,11 +1,14 @@
 #pragma once
+#include <functional>
+#include <memory>
 #include <optional>
-#include <set>
 #include <stdexcept>
 #include <string>
 #include <iostream>
 #include <type_traits>
 #include <variant>
+#include "MemoryStats.hpp"
+#include "ObjectPtr.hpp"
 #include "Template.hpp"
 
 namespace alisp
@@ -15,16 +18,6 @@ struct Function;
 struct ConsCellObject;
 struct SymbolObject;
 
-#ifdef ENABLE_DEBUG_REFCOUNTING
-
-inline int changeRefCount(int i) {
-    static int refcnt = 0;
-    refcnt += i;
-    return refcnt;
-}
-
-#endif
-
 template<typename T>
 struct ConvertibleTo
 {
@@ -69,44 +62,29 @@ struct Object :
         return clone();
     }
     
-#ifdef ENABLE_DEBUG_REFCOUNTING
-    Object()
-    {
-        changeRefCount(1);
-        getAllObjects().insert(this);
-    }
-    
-    Object(const Object&)
-    {
-        changeRefCount(1);
-        getAllObjects().insert(this);
-    }
-    
+    Object() { created(); }
+    Object(const Object&) { created(); }
+
     virtual ~Object()
     {
-        changeRefCount(-1);
-        getAllObjects().erase(this);
-    }
-    static int getDebugRefCount() { return changeRefCount(0); }
-    static bool& destructionDebug()
-    {
-        static bool dbg = false;
-        return dbg;
+        if (m_lifetime.sampled) {
+            memoryStats().sampleDestroyed(this);
+        }
+        memoryStats().destroyed(MemoryKind::Object);
     }
-    static std::set<Object*>& getAllObjects()
+
+    static void* operator new(std::size_t size)
     {
-        static std::set<Object*> l;
-        return l;
+        memoryStats().allocated(MemoryKind::Object, size);
+        return ::operator new(size);
     }
-    static void printAllObjects()
+
+    static void operator delete(void* ptr, std::size_t size)
     {
-        for (auto p: getAllObjects()) {
-            std::cout << p->toString() << std::endl;
-        }
+        memoryStats().freed(MemoryKind::Object, size);
+        ::operator delete(ptr);
     }
-#else
-    virtual ~Object() {}
-#endif
+
     virtual std::string toString(bool aesthetic = false) const = 0;
     virtual bool isList() const { return false; }
     virtual bool isNil() const { return false; }
@@ -118,7 +96,35 @@ struct Object :
     virtual std::string typeOf() const = 0;
 
     virtual bool operator!() const { return false; }
-    virtual Object* trySelfEvaluate() { return nullptr; }
+
+    // Returns the value of this form without copying it when the value already exists, as with
+    // self-evaluating objects, variables and quoted constants. Otherwise returns nullptr and the
+    // value must be created with eval(). A borrowed value stays valid only until the next
+    // evaluation which might change it, unless it is pinned.
+    virtual Object* tryEvalBorrowed() { return nullptr; }
+
+    Object* evalBorrowed(std::unique_ptr<Object>& storage)
+    {
+        if (Object* value = tryEvalBorrowed()) {
+            return value;
+        }
+        storage = eval();
+        return storage.get();
+    }
+
+    void pin() const { m_lifetime.pins++; }
+
+    void unpin() const
+    {
+        if (--m_lifetime.pins == 0 && m_lifetime.released) {
+            delete this;
+        }
+    }
+
+    // Shared objects, like the nil of a machine, are handed out to many owners at once. Only the
+    // one who made them shared destroys them, through a pointer to the derived type.
+    void markShared() { m_lifetime.shared = true; }
+    bool isShared() const { return m_lifetime.shared; }
 
     virtual std::shared_ptr<Function> resolveFunction() const;
     virtual std::unique_ptr<Object> clone() const = 0;
@@ -166,11 +172,44 @@ struct Object :
 
     virtual std::unique_ptr<Object> eval() { return clone(); }    
     virtual void traverse(const std::function<bool(const Object&)>& f) const { f(*this); }
-};
 
-using ObjectPtr = std::unique_ptr<Object>;
+private:
+    friend struct std::default_delete<Object>;
+
+    // The lifetime state belongs to the object itself, so copies of an object start unpinned
+    // and unshared.
+    struct Lifetime
+    {
+        size_t pins = 0;
+        bool released = false;
+        bool shared = false;
+        bool sampled = false;
+        Lifetime() = default;
+        Lifetime(const Lifetime&) {}
+        Lifetime& operator=(const Lifetime&) { return *this; }
+    };
+    mutable Lifetime m_lifetime;
+
+    void created()
+    {
+        memoryStats().created(MemoryKind::Object);
+        m_lifetime.sampled = memoryStats().sampleCreated(this);
+    }
+};
 
 std::ostream &operator<<(std::ostream &os, const Object &sym);
 std::ostream &operator<<(std::ostream &os, const std::unique_ptr<Object> &sym);
 
 }
+
+inline void std::default_delete<alisp::Object>::operator()(alisp::Object* obj) const
+{
+    if (obj->m_lifetime.shared) {
+        return;
+    }
+    if (obj->m_lifetime.pins) {
+        obj->m_lifetime.released = true;
+        return;
+    }
+    delete obj;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <memory>
+
+namespace alisp
+{
+
+struct Object;
+
+}
+
+// Owning pointers to objects don't destroy an object which is pinned by a borrowed reference,
+// as the last borrower destroys it instead, nor shared objects. See Object::pin() and
+// Object::markShared(). This must be seen before anything uses std::unique_ptr<Object>.
+namespace std
+{
+
+template<>
+struct default_delete<alisp::Object>
+{
+    default_delete() = default;
+    template<typename U> default_delete(const default_delete<U>&) {}
+    void operator()(alisp::Object* obj) const;
+};
+
+}
+
+namespace alisp
+{
+
+using ObjectPtr = std::unique_ptr<Object>;
+
+}
@@ -0,0 +1,329 @@
+#include "ConsCellObject.hpp"
+#include "Error.hpp"
+#include "Machine.hpp"
+#include "SubroutineObject.hpp"
+#include "SymbolObject.hpp"
+#include "alisp.hpp"
+#include <algorithm>
+
+namespace alisp
+{
+
+// Folds the constant parts of code whose macros have been expanded. The names bound by the
+// forms around the code being folded are tracked, since a local variable hides a constant of
+// the same name.
+class Machine::Optimizer
+{
+    Machine& m;
+    std::vector<std::string> m_bound; // Innermost last
+
+    static const std::string& nameOf(const SymbolObject& sym)
+    {
+        return sym.sym ? sym.sym->name : sym.name;
+    }
+
+    bool is(const std::string& name, const char* special) const
+    {
+        return name == m.parsedSymbolName(special);
+    }
+
+    bool isBound(const std::string& name) const
+    {
+        return std::find(m_bound.begin(), m_bound.end(), name) != m_bound.end();
+    }
+
+    void bind(const Object& var)
+    {
+        if (const SymbolObject* sym = var.asSymbol()) {
+            m_bound.push_back(nameOf(*sym));
+        }
+    }
+
+    // The value of a form when it is known without evaluating it: that of a literal, a quoted
+    // object or a constant variable. Null otherwise.
+    const Object* constantValue(const Object& form) const
+    {
+        if (const SymbolObject* sym = form.asSymbol()) {
+            if (isBound(nameOf(*sym))) {
+                return nullptr;
+            }
+            const Symbol* s = sym->getSymbolOrNull();
+            return s && s->constant && s->variable ? s->variable.get() : nullptr;
+        }
+        if (form.isList() && !form.isNil()) {
+            const ConsCell* cc = form.asList()->cc.get();
+            const SymbolObject* head = cc->car->asSymbol();
+            const bool quote = head && is(nameOf(*head), "quote") && cc->next() &&
+                !cc->next()->next();
+            return quote ? cc->next()->car.get() : nullptr;
+        }
+        return &form;
+    }
+
+    // A form which evaluates to a value.
+    ObjectPtr literal(const Object& value) const
+    {
+        if (const SymbolObject* sym = value.asSymbol()) {
+            const Symbol* s = sym->getSymbolOrNull();
+            if (s && s->constant && s->variable && s->variable->eq(value)) {
+                return value.clone();
+            }
+        }
+        else if (!value.isList() || value.isNil()) {
+            return value.clone();
+        }
+        return m.quote(value.clone());
+    }
+
+    void forms(ListBuilder& builder, const ConsCell* cc)
+    {
+        for (; cc; cc = cc->next()) {
+            builder.append(form(*cc->car));
+            if (cc->dotted()) {
+                builder.dot(cc->dotted()->clone());
+            }
+        }
+    }
+
+    // (PARAMS . BODY) of a lambda, with the parameters bound in the body.
+    void lambda(ListBuilder& builder, const ConsCell* cc)
+    {
+        const size_t depth = m_bound.size();
+        if (cc->car->isList()) {
+            for (const Object& param : *cc->car->asList()) {
+                bind(param);
+            }
+        }
+        builder.append(cc->car->clone());
+        forms(builder, cc->next());
+        m_bound.resize(depth);
+    }
+
+    ObjectPtr let(const SymbolObject& head, const ConsCell* cc, bool star)
+    {
+        ListBuilder builder(m);
+        builder.append(head.clone());
+        const size_t depth = m_bound.size();
+        ListBuilder bindings(m);
+        std::vector<const Object*> vars;
+        for (const Object& binding : *cc->car->asList()) {
+            if (!binding.isList() || binding.isNil()) {
+                bindings.append(binding.clone());
+                vars.push_back(&binding);
+                continue;
+            }
+            const ConsCell* b = binding.asList()->cc.get();
+            ListBuilder folded(m);
+            folded.append(b->car->clone());
+            forms(folded, b->next());
+            bindings.append(folded.get());
+            vars.push_back(b->car.get());
+            if (star) {
+                bind(*b->car);
+            }
+        }
+        builder.append(bindings.get());
+        if (!star) {
+            for (const Object* var : vars) {
+                bind(*var);
+            }
+        }
+        forms(builder, cc->next());
+        m_bound.resize(depth);
+        return builder.get();
+    }
+
+    // Drops the branch of an if which a constant condition never takes.
+    ObjectPtr branch(ObjectPtr folded)
+    {
+        const ConsCell* cc = folded->asList()->cc->next();
+        const Object* condition = cc && cc->next() ? constantValue(*cc->car) : nullptr;
+        if (!condition) {
+            return folded;
+        }
+        if (!condition->isNil()) {
+            return cc->next()->car->clone();
+        }
+        const ConsCell* otherwise = cc->next()->next();
+        if (!otherwise) {
+            return m.makeNil();
+        }
+        if (!otherwise->next()) {
+            return otherwise->car->clone();
+        }
+        ListBuilder progn(m);
+        progn.append(m.makeSymbol("progn", true));
+        forms(progn, otherwise);
+        return progn.get();
+    }
+
+    // Evaluates a call of a pure function whose arguments are all constant, and returns the
+    // value as a form. If the call signals an error, it is left for when the code runs.
+    ObjectPtr fold(ObjectPtr call)
+    {
+        for (const Object& arg : *call->asList()->cc->next()) {
+            if (!constantValue(arg)) {
+                return call;
+            }
+        }
+        const size_t frames = m.m_unwoundFrames.size();
+        try {
+            return literal(*call->eval());
+        }
+        catch (exceptions::Error&) {
+            m.m_unwoundFrames.resize(frames);
+            return call;
+        }
+    }
+public:
+    Optimizer(Machine& machine) : m(machine) {}
+
+    ObjectPtr form(const Object& form)
+    {
+        if (form.isSymbol()) {
+            const Object* value = constantValue(form);
+            return value ? literal(*value) : form.clone();
+        }
+        if (!form.isList() || form.isNil()) {
+            return form.clone();
+        }
+        const ConsCell* cc = form.asList()->cc.get();
+        const SymbolObject* head = cc->car->asSymbol();
+        if (!head || !cc->next() || cc->dotted()) {
+            return form.clone();
+        }
+        const std::string& name = nameOf(*head);
+        ListBuilder builder(m);
+        builder.append(head->clone());
+        cc = cc->next();
+        if (name == LambdaName) {
+            lambda(builder, cc);
+            return builder.get();
+        }
+        if (is(name, "function")) {
+            const SymbolObject* car = cc->car->isList() && !cc->car->isNil() ?
+                cc->car->asList()->car()->asSymbol() : nullptr;
+            if (!car || nameOf(*car) != LambdaName || !cc->car->asList()->cc->next()) {
+                return form.clone();
+            }
+            ListBuilder function(m);
+            function.append(car->clone());
+            lambda(function, cc->car->asList()->cc->next());
+            builder.append(function.get());
+            return builder.get();
+        }
+        if ((is(name, "let") || is(name, "let*")) && cc->car->isList()) {
+            return let(*head, cc, is(name, "let*"));
+        }
+        if (is(name, "setq")) {
+            for (bool var = true; cc; cc = cc->next(), var = !var) {
+                builder.append(var ? cc->car->clone() : this->form(*cc->car));
+            }
+            return builder.get();
+        }
+        if (is(name, "cond")) {
+            for (; cc; cc = cc->next()) {
+                if (!cc->car->isList() || cc->car->isNil()) {
+                    builder.append(cc->car->clone());
+                    continue;
+                }
+                ListBuilder clause(m);
+                forms(clause, cc->car->asList()->cc.get());
+                builder.append(clause.get());
+            }
+            return builder.get();
+        }
+        if (is(name, "condition-case")) {
+            builder.append(cc->car->clone());
+            if (!(cc = cc->next())) {
+                return builder.get();
+            }
+            builder.append(this->form(*cc->car));
+            const size_t depth = m_bound.size();
+            bind(*form.asList()->cc->next()->car);
+            for (cc = cc->next(); cc; cc = cc->next()) {
+                if (!cc->car->isList() || cc->car->isNil()) {
+                    builder.append(cc->car->clone());
+                    continue;
+                }
+                ListBuilder handler(m);
+                handler.append(cc->car->asList()->car()->clone());
+                forms(handler, cc->car->asList()->cc->next());
+                builder.append(handler.get());
+            }
+            m_bound.resize(depth);
+            return builder.get();
+        }
+        if ((is(name, "dolist") || is(name, "dotimes")) && cc->car->isList() &&
+            !cc->car->isNil()) {
+            const ConsCell* spec = cc->car->asList()->cc.get();
+            ListBuilder folded(m);
+            folded.append(spec->car->clone());
+            if (spec->next()) {
+                folded.append(this->form(*spec->next()->car));
+            }
+            const size_t depth = m_bound.size();
+            bind(*spec->car);
+            if (spec->next()) {
+                forms(folded, spec->next()->next());
+            }
+            builder.append(folded.get());
+            forms(builder, cc->next());
+            m_bound.resize(depth);
+            return builder.get();
+        }
+
+        // Forms which take apart other things than forms are left as they are, and so are calls
+        // of macros and of functions not defined yet, whose arguments may not be forms either.
+        static const char* const verbatim[] = {
+            "quote", "backquote", "defun", "defmacro", "defvar", "defconst", "cl-loop",
+            "dolist", "dotimes", "let", "let*"
+        };
+        const Symbol* sym = head->getSymbolOrNull();
+        const bool macro = sym && sym->function && sym->function->isList() &&
+            !sym->function->isNil() && sym->function->asList()->car()->asSymbol() &&
+            is(nameOf(*sym->function->asList()->car()->asSymbol()), "macro");
+        if (!sym || !sym->function || macro ||
+            std::any_of(std::begin(verbatim), std::end(verbatim),
+                        [&](const char* v) { return is(name, v); })) {
+            return form.clone();
+        }
+        forms(builder, cc);
+        if (is(name, "if")) {
+            return branch(builder.get());
+        }
+        const auto subr = dynamic_cast<const SubroutineObject*>(sym->function.get());
+        return subr && subr->value->pure ? fold(builder.get()) : builder.get();
+    }
+};
+
+ALISP_INLINE ObjectPtr Machine::optimize(const Object& form)
+{
+    return Optimizer(*this).form(form);
+}
+
+ALISP_INLINE void Machine::initOptimizer()
+{
+    // Builtins whose value depends on nothing but their arguments, and which do not change
+    // anything. Those which make new lists or strings are left out: a folded call would hand
+    // out the same object every time, which the caller could then modify.
+    static const char* const pure[] = {
+        "+", "*", "/", "%", "1+", "1-", "=", "<", "<=", ">", ">=", "abs", "ash", "lsh",
+        "logand", "logior", "logxor", "lognot", "logcount", "truncate", "floor", "ceiling",
+        "isnan", "evenp", "zerop", "sin", "cos", "tan", "numberp", "integerp", "floatp",
+        "atom", "null", "not", "consp", "listp", "nlistp", "symbolp", "stringp", "characterp",
+        "char-or-string-p", "string-or-null-p", "sequencep", "eq", "eql", "equal", "xor",
+        "type-of", "car", "cdr", "nth", "nthcdr", "elt", "length", "string-bytes",
+        "char-uppercase-p", "char-equal", "string=", "string-equal", "string<", "string-lessp",
+        "string-greaterp", "string-search", "string-to-number", "max-char"
+    };
+    for (const char* name : pure) {
+        const auto sym = getSymbolOrNull(parsedSymbolName(name));
+        const auto subr = sym ? dynamic_cast<SubroutineObject*>(sym->function.get()) : nullptr;
+        if (subr) {
+            subr->value->pure = true;
+        }
+    }
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+
+namespace alisp
+{
+
+// Base for data which keeps its reference count inside itself. The data and its count live
+// in a single allocation and a handle to it is just one pointer.
+struct RefCounted
+{
+    mutable size_t refCount = 0;
+};
+
+// Releases a reference. Types can provide their own overload which ADL finds instead of this.
+template<typename T>
+void releaseRef(T* ptr)
+{
+    if (--ptr->refCount == 0) {
+        delete ptr;
+    }
+}
+
+template<typename T>
+class RefPtr
+{
+    T* m_ptr = nullptr;
+public:
+    RefPtr() = default;
+    RefPtr(std::nullptr_t) {}
+    explicit RefPtr(T* ptr) : m_ptr(ptr) { if (m_ptr) m_ptr->refCount++; }
+    RefPtr(const RefPtr& o) : RefPtr(o.m_ptr) {}
+    RefPtr(RefPtr&& o) : m_ptr(o.m_ptr) { o.m_ptr = nullptr; }
+    ~RefPtr() { reset(); }
+
+    RefPtr& operator=(RefPtr o)
+    {
+        std::swap(m_ptr, o.m_ptr);
+        return *this;
+    }
+
+    void reset()
+    {
+        T* ptr = m_ptr;
+        m_ptr = nullptr;
+        if (ptr) {
+            releaseRef(ptr);
+        }
+    }
+
+    template<typename... Args>
+    static RefPtr make(Args&&... args)
+    {
+        return RefPtr(new T(std::forward<Args>(args)...));
+    }
+
+    T* get() const { return m_ptr; }
+    T& operator*() const { return *m_ptr; }
+    T* operator->() const { return m_ptr; }
+    explicit operator bool() const { return m_ptr != nullptr; }
+    size_t use_count() const { return m_ptr ? m_ptr->refCount : 0; }
+    bool operator==(const RefPtr& o) const { return m_ptr == o.m_ptr; }
+    bool operator!=(const RefPtr& o) const { return m_ptr != o.m_ptr; }
+};
+
+}
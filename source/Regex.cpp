@@ -0,0 +1,778 @@
+#include "alisp.hpp"
+#include "Regex.hpp"
+#include "Error.hpp"
+#include "UTF8.hpp"
+#include "Unicode.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace alisp
+{
+
+namespace regex
+{
+
+enum CharClass : std::uint32_t
+{
+    Alpha = 1 << 0,
+    Digit = 1 << 1,
+    XDigit = 1 << 2,
+    Alnum = 1 << 3,
+    Space = 1 << 4,
+    Blank = 1 << 5,
+    Upper = 1 << 6,
+    Lower = 1 << 7,
+    Punct = 1 << 8,
+    Cntrl = 1 << 9,
+    Print = 1 << 10,
+    Graph = 1 << 11,
+    Ascii = 1 << 12,
+    NonAscii = 1 << 13,
+    Word = 1 << 14,
+    SymbolChar = 1 << 15
+};
+
+constexpr size_t MaxProgramSize = 100000;
+
+ALISP_STATIC std::uint32_t foldCase(std::uint32_t c)
+{
+    return unicode::toLower(c);
+}
+
+// Letters, marks and numbers are word constituents, like in the standard syntax table of Emacs.
+ALISP_STATIC bool isWordChar(std::uint32_t c)
+{
+    if (c < 128) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+    }
+    return unicode::isWord(c);
+}
+
+ALISP_STATIC bool isSpaceChar(std::uint32_t c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v' ||
+        (c >= 128 && unicode::isSpace(c));
+}
+
+// Digits are only the ASCII ones, and other characters are classified by their Unicode general
+// category.
+ALISP_STATIC bool inClass(std::uint32_t c, std::uint32_t classes)
+{
+    const bool ascii = c < 128;
+    const bool upper = ascii ? c >= 'A' && c <= 'Z' : unicode::isUpper(c);
+    const bool lower = ascii ? c >= 'a' && c <= 'z' : unicode::isLower(c);
+    const bool digit = c >= '0' && c <= '9';
+    const bool alpha = ascii ? upper || lower : unicode::isAlpha(c);
+    const bool cntrl = c < 32 || c == 127;
+    const bool graph = ascii ? (c > 32 && c < 127) : unicode::isGraphic(c);
+    const bool punct = ascii ? graph && !upper && !lower && !digit : !isWordChar(c) && graph;
+    return ((classes & Alpha) && alpha) ||
+        ((classes & Digit) && digit) ||
+        ((classes & XDigit) && (digit || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f'))) ||
+        ((classes & Alnum) && (alpha || digit || (!ascii && unicode::isDecimal(c)))) ||
+        ((classes & Space) && isSpaceChar(c)) ||
+        ((classes & Blank) &&
+         (c == ' ' || c == '\t' || (!ascii && unicode::category(c) == unicode::Zs))) ||
+        ((classes & Upper) && upper) ||
+        ((classes & Lower) && lower) ||
+        ((classes & Punct) && punct) ||
+        ((classes & Cntrl) && cntrl) ||
+        ((classes & Print) && (graph || c == ' ' || (!ascii && unicode::isPrint(c)))) ||
+        ((classes & Graph) && graph) ||
+        ((classes & Ascii) && ascii) ||
+        ((classes & NonAscii) && !ascii) ||
+        ((classes & Word) && isWordChar(c)) ||
+        ((classes & SymbolChar) && (isWordChar(c) || c == '_'));
+}
+
+ALISP_INLINE bool Regex::CharSet::contains(std::uint32_t c, bool caseFold) const
+{
+    auto has = [this](std::uint32_t c) {
+        if (inClass(c, classes)) {
+            return true;
+        }
+        for (const auto& range : ranges) {
+            if (c >= range.first && c <= range.second) {
+                return true;
+            }
+        }
+        return false;
+    };
+    auto hasOtherCase = [&has](std::uint32_t c) {
+        const std::uint32_t lower = unicode::toLower(c);
+        const std::uint32_t upper = unicode::toUpper(c);
+        return (lower != c && has(lower)) || (upper != c && has(upper));
+    };
+    const bool found = has(c) || (caseFold && hasOtherCase(c));
+    return found != negated;
+}
+
+struct Node
+{
+    enum class Type
+    {
+        Empty,
+        Char,
+        Any,
+        Set,
+        Assert,
+        Group,
+        Concat,
+        Alternate,
+        Repeat
+    };
+
+    Type type;
+    std::uint32_t value = 0; // Character, set index, assertion or group number
+    int min = 0;
+    int max = -1;            // -1 for no upper limit
+    bool greedy = true;
+    bool capture = true;
+    std::vector<std::unique_ptr<Node>> children;
+
+    Node(Type type, std::uint32_t value = 0) : type(type), value(value) {}
+};
+
+using NodePtr = std::unique_ptr<Node>;
+
+// Parses a pattern in Emacs syntax into a tree and generates the program for it.
+class Compiler
+{
+    Regex& m_regex;
+    const std::string& m_pattern;
+    size_t m_pos = 0;
+
+    bool atEnd() const { return m_pos >= m_pattern.size(); }
+
+    bool lookingAt(const char* str) const
+    {
+        return m_pattern.compare(m_pos, std::strlen(str), str) == 0;
+    }
+
+    [[noreturn]] void fail(const std::string& message) const
+    {
+        throw exceptions::InvalidRegexp(message);
+    }
+
+    std::uint32_t nextChar()
+    {
+        std::uint32_t encoded;
+        const size_t length = utf8::next(m_pattern.c_str() + m_pos, &encoded);
+        m_pos += length ? length : 1;
+        return length ? utf8::decode(encoded) : 0;
+    }
+
+    NodePtr makeSet(std::uint32_t classes, bool negated)
+    {
+        Regex::CharSet set;
+        set.classes = classes;
+        set.negated = negated;
+        m_regex.m_sets.push_back(std::move(set));
+        return std::make_unique<Node>(Node::Type::Set, m_regex.m_sets.size() - 1);
+    }
+
+    NodePtr parseAlternation()
+    {
+        auto alternation = std::make_unique<Node>(Node::Type::Alternate);
+        alternation->children.push_back(parseBranch());
+        while (lookingAt("\\|")) {
+            m_pos += 2;
+            alternation->children.push_back(parseBranch());
+        }
+        if (alternation->children.size() == 1) {
+            return std::move(alternation->children[0]);
+        }
+        return alternation;
+    }
+
+    NodePtr parseBranch()
+    {
+        auto concat = std::make_unique<Node>(Node::Type::Concat);
+        bool repeatable = false;
+        while (!atEnd() && !lookingAt("\\|") && !lookingAt("\\)")) {
+            const char c = m_pattern[m_pos];
+            // Postfix operators with nothing to apply to stand for themselves.
+            if (repeatable && (c == '*' || c == '+' || c == '?')) {
+                m_pos++;
+                auto repeat = std::make_unique<Node>(Node::Type::Repeat);
+                repeat->min = c == '+' ? 1 : 0;
+                repeat->max = c == '?' ? 1 : -1;
+                if (!atEnd() && m_pattern[m_pos] == '?') {
+                    repeat->greedy = false;
+                    m_pos++;
+                }
+                repeat->children.push_back(std::move(concat->children.back()));
+                concat->children.back() = std::move(repeat);
+                continue;
+            }
+            if (lookingAt("\\{")) {
+                if (!repeatable) {
+                    fail("Invalid preceding regular expression");
+                }
+                m_pos += 2;
+                auto repeat = std::make_unique<Node>(Node::Type::Repeat);
+                repeat->min = parseCount(0);
+                repeat->max = repeat->min;
+                if (!atEnd() && m_pattern[m_pos] == ',') {
+                    m_pos++;
+                    repeat->max = parseCount(-1);
+                }
+                if (!lookingAt("\\}")) {
+                    fail("Invalid content of \\{\\}");
+                }
+                m_pos += 2;
+                if (repeat->max != -1 && repeat->max < repeat->min) {
+                    fail("Invalid content of \\{\\}");
+                }
+                repeat->children.push_back(std::move(concat->children.back()));
+                concat->children.back() = std::move(repeat);
+                continue;
+            }
+            const bool branchStart = concat->children.empty();
+            concat->children.push_back(parseAtom(branchStart));
+            repeatable = concat->children.back()->type != Node::Type::Assert;
+        }
+        return concat;
+    }
+
+    int parseCount(int empty)
+    {
+        if (atEnd() || m_pattern[m_pos] < '0' || m_pattern[m_pos] > '9') {
+            return empty;
+        }
+        int count = 0;
+        while (!atEnd() && m_pattern[m_pos] >= '0' && m_pattern[m_pos] <= '9') {
+            count = count * 10 + (m_pattern[m_pos++] - '0');
+            if (count > 0xffff) {
+                fail("Regular expression too big");
+            }
+        }
+        return count;
+    }
+
+    NodePtr parseAtom(bool branchStart)
+    {
+        const char c = m_pattern[m_pos];
+        if (c == '^' && branchStart) {
+            m_pos++;
+            return std::make_unique<Node>(Node::Type::Assert,
+                                          static_cast<std::uint32_t>(Regex::Assertion::LineStart));
+        }
+        if (c == '$') {
+            m_pos++;
+            if (atEnd() || lookingAt("\\)") || lookingAt("\\|")) {
+                return std::make_unique<Node>(Node::Type::Assert,
+                                              static_cast<std::uint32_t>(Regex::Assertion::LineEnd));
+            }
+            return std::make_unique<Node>(Node::Type::Char, '$');
+        }
+        if (c == '.') {
+            m_pos++;
+            return std::make_unique<Node>(Node::Type::Any);
+        }
+        if (c == '[') {
+            m_pos++;
+            return parseSet();
+        }
+        if (c == '\\') {
+            m_pos++;
+            return parseEscape();
+        }
+        return std::make_unique<Node>(Node::Type::Char, nextChar());
+    }
+
+    NodePtr parseEscape()
+    {
+        if (atEnd()) {
+            fail("Trailing backslash");
+        }
+        auto assertion = [](Regex::Assertion a) {
+            return std::make_unique<Node>(Node::Type::Assert, static_cast<std::uint32_t>(a));
+        };
+        const char c = m_pattern[m_pos++];
+        switch (c) {
+        case '(': {
+            auto group = std::make_unique<Node>(Node::Type::Group);
+            if (lookingAt("?:")) {
+                m_pos += 2;
+                group->capture = false;
+            }
+            else {
+                group->value = m_regex.m_groups++;
+            }
+            group->children.push_back(parseAlternation());
+            if (!lookingAt("\\)")) {
+                fail("Unmatched ( or \\(");
+            }
+            m_pos += 2;
+            return group;
+        }
+        case 'w': return makeSet(Word, false);
+        case 'W': return makeSet(Word, true);
+        case 's':
+        case 'S': {
+            if (atEnd()) {
+                fail("Invalid syntax designator");
+            }
+            const char syntax = m_pattern[m_pos++];
+            std::uint32_t classes;
+            if (syntax == '-' || syntax == ' ') classes = Space;
+            else if (syntax == 'w') classes = Word;
+            else if (syntax == '_') classes = SymbolChar;
+            else if (syntax == '.') classes = Punct;
+            else fail("Invalid syntax designator");
+            return makeSet(classes, c == 'S');
+        }
+        case 'b': return assertion(Regex::Assertion::WordBoundary);
+        case 'B': return assertion(Regex::Assertion::NotWordBoundary);
+        case '<': return assertion(Regex::Assertion::WordStart);
+        case '>': return assertion(Regex::Assertion::WordEnd);
+        case '`': return assertion(Regex::Assertion::StringStart);
+        case '\'': return assertion(Regex::Assertion::StringEnd);
+        case '_':
+            if (lookingAt("<")) {
+                m_pos++;
+                return assertion(Regex::Assertion::SymbolStart);
+            }
+            if (lookingAt(">")) {
+                m_pos++;
+                return assertion(Regex::Assertion::SymbolEnd);
+            }
+            fail("Invalid \\_ construct");
+        case ')':
+            fail("Unmatched ) or \\)");
+        case '{':
+            fail("Invalid preceding regular expression");
+        default:
+            break;
+        }
+        if (c >= '1' && c <= '9') {
+            fail("Back references are not supported");
+        }
+        m_pos--;
+        return std::make_unique<Node>(Node::Type::Char, nextChar());
+    }
+
+    NodePtr parseSet()
+    {
+        static const std::pair<const char*, std::uint32_t> classNames[] = {
+            {"alpha", Alpha}, {"digit", Digit}, {"xdigit", XDigit}, {"alnum", Alnum},
+            {"space", Space}, {"blank", Blank}, {"upper", Upper}, {"lower", Lower},
+            {"punct", Punct}, {"cntrl", Cntrl}, {"print", Print}, {"graph", Graph},
+            {"ascii", Ascii}, {"nonascii", NonAscii}, {"multibyte", NonAscii},
+            {"unibyte", Ascii}, {"word", Word}
+        };
+        Regex::CharSet set;
+        if (!atEnd() && m_pattern[m_pos] == '^') {
+            set.negated = true;
+            m_pos++;
+        }
+        for (bool first = true;; first = false) {
+            if (atEnd()) {
+                fail("Unmatched [ or [^");
+            }
+            if (m_pattern[m_pos] == ']' && !first) {
+                m_pos++;
+                break;
+            }
+            if (lookingAt("[:")) {
+                const size_t end = m_pattern.find(":]", m_pos + 2);
+                if (end == std::string::npos) {
+                    fail("Unmatched [ or [^");
+                }
+                const std::string name = m_pattern.substr(m_pos + 2, end - m_pos - 2);
+                std::uint32_t classes = 0;
+                for (const auto& p : classNames) {
+                    if (name == p.first) {
+                        classes = p.second;
+                    }
+                }
+                if (!classes) {
+                    fail("Invalid character class name");
+                }
+                set.classes |= classes;
+                m_pos = end + 2;
+                continue;
+            }
+            const std::uint32_t from = nextChar();
+            std::uint32_t to = from;
+            if (lookingAt("-") && m_pos + 1 < m_pattern.size() && m_pattern[m_pos + 1] != ']') {
+                m_pos++;
+                to = nextChar();
+            }
+            set.ranges.emplace_back(from, to);
+        }
+        m_regex.m_sets.push_back(std::move(set));
+        return std::make_unique<Node>(Node::Type::Set, m_regex.m_sets.size() - 1);
+    }
+
+    int emit(Regex::Op op, std::uint32_t arg = 0)
+    {
+        if (m_regex.m_program.size() >= MaxProgramSize) {
+            fail("Regular expression too big");
+        }
+        Regex::Instruction instruction;
+        instruction.op = op;
+        instruction.arg = arg;
+        m_regex.m_program.push_back(instruction);
+        return static_cast<int>(m_regex.m_program.size() - 1);
+    }
+
+    int size() const { return static_cast<int>(m_regex.m_program.size()); }
+    Regex::Instruction& at(int pc) { return m_regex.m_program[pc]; }
+
+    // A split to the next instruction, with the other branch patched in later.
+    int emitSplit(bool greedy, int other = -1)
+    {
+        const int split = emit(Regex::Op::Split);
+        (greedy ? at(split).x : at(split).y) = split + 1;
+        (greedy ? at(split).y : at(split).x) = other;
+        return split;
+    }
+
+    void patchSplit(int split, bool greedy, int target)
+    {
+        (greedy ? at(split).y : at(split).x) = target;
+    }
+
+    void generate(const Node& node)
+    {
+        switch (node.type) {
+        case Node::Type::Empty:
+            break;
+        case Node::Type::Char:
+            emit(Regex::Op::Char, m_regex.m_caseFold ? foldCase(node.value) : node.value);
+            break;
+        case Node::Type::Any:
+            emit(Regex::Op::Any);
+            break;
+        case Node::Type::Set:
+            emit(Regex::Op::Set, node.value);
+            break;
+        case Node::Type::Assert:
+            emit(Regex::Op::Assert, node.value);
+            break;
+        case Node::Type::Group:
+            if (node.capture) {
+                emit(Regex::Op::Save, node.value * 2);
+            }
+            generate(*node.children[0]);
+            if (node.capture) {
+                emit(Regex::Op::Save, node.value * 2 + 1);
+            }
+            break;
+        case Node::Type::Concat:
+            for (const auto& child : node.children) {
+                generate(*child);
+            }
+            break;
+        case Node::Type::Alternate: {
+            std::vector<int> jumps;
+            for (size_t i = 0; i < node.children.size(); i++) {
+                if (i + 1 == node.children.size()) {
+                    generate(*node.children[i]);
+                    break;
+                }
+                const int split = emitSplit(true);
+                generate(*node.children[i]);
+                jumps.push_back(emit(Regex::Op::Jump));
+                patchSplit(split, true, size());
+            }
+            for (int jump : jumps) {
+                at(jump).x = size();
+            }
+            break;
+        }
+        case Node::Type::Repeat:
+            generateRepeat(node);
+            break;
+        }
+    }
+
+    void generateRepeat(const Node& node)
+    {
+        const Node& body = *node.children[0];
+        if (node.max == -1) {
+            for (int i = 1; i < node.min; i++) {
+                generate(body);
+            }
+            if (node.min == 0) {
+                const int split = emitSplit(node.greedy);
+                generate(body);
+                at(emit(Regex::Op::Jump)).x = split;
+                patchSplit(split, node.greedy, size());
+            }
+            else {
+                const int start = size();
+                generate(body);
+                emitSplit(!node.greedy, start);
+                // The split continues to the next instruction when the loop is done.
+            }
+            return;
+        }
+        for (int i = 0; i < node.min; i++) {
+            generate(body);
+        }
+        std::vector<int> splits;
+        for (int i = node.min; i < node.max; i++) {
+            splits.push_back(emitSplit(node.greedy));
+            generate(body);
+        }
+        for (int split : splits) {
+            patchSplit(split, node.greedy, size());
+        }
+    }
+public:
+    Compiler(Regex& regex, const std::string& pattern) : m_regex(regex), m_pattern(pattern) {}
+
+    void compile()
+    {
+        auto tree = parseAlternation();
+        if (!atEnd()) {
+            fail("Unmatched ) or \\)");
+        }
+        emit(Regex::Op::Save, 0);
+        generate(*tree);
+        emit(Regex::Op::Save, 1);
+        emit(Regex::Op::Match);
+        const auto& first = m_regex.m_program[1];
+        if (first.op == Regex::Op::Char && first.arg < 128 &&
+            (!m_regex.m_caseFold || unicode::category(first.arg) > unicode::Lo)) {
+            m_regex.m_firstChar = static_cast<int>(first.arg);
+        }
+    }
+};
+
+// Runs a program over a string. Each list holds the threads at one position of the string in
+// priority order, along with the group offsets seen by each thread.
+class Matcher
+{
+    struct ThreadList
+    {
+        std::vector<int> pcs;
+        std::vector<size_t> slots;
+        std::vector<unsigned> marks;
+        unsigned generation = 0;
+
+        void clear()
+        {
+            pcs.clear();
+            slots.clear();
+            generation++;
+        }
+    };
+
+    const Regex& m_regex;
+    const std::string& m_str;
+    const size_t m_slotCount;
+    ThreadList m_lists[2];
+    std::vector<size_t> m_slots;
+
+    // An instruction for addThread to follow, or with a negative pc, a save to undo
+    struct Pending
+    {
+        int pc;
+        size_t slot;
+        size_t old;
+    };
+    std::vector<Pending> m_pending;
+
+    std::uint32_t charAt(size_t pos, size_t& length) const
+    {
+        if (pos >= m_str.size()) {
+            length = 0;
+            return 0;
+        }
+        std::uint32_t encoded;
+        length = utf8::next(m_str.c_str() + pos, &encoded);
+        if (!length) {
+            length = 1;
+            return 0;
+        }
+        return utf8::decode(encoded);
+    }
+
+    std::uint32_t charBefore(size_t pos) const
+    {
+        size_t start = pos - 1;
+        while (start > 0 && pos - start < 4 && (m_str[start] & 0xC0) == 0x80) {
+            start--;
+        }
+        size_t length;
+        return charAt(start, length);
+    }
+
+    bool holds(Regex::Assertion assertion, size_t pos) const
+    {
+        const bool atStart = pos == 0;
+        const bool atEnd = pos >= m_str.size();
+        size_t length;
+        const bool wordBefore = !atStart && isWordChar(charBefore(pos));
+        const bool wordAfter = !atEnd && isWordChar(charAt(pos, length));
+        switch (assertion) {
+        case Regex::Assertion::LineStart: return atStart || m_str[pos - 1] == '\n';
+        case Regex::Assertion::LineEnd: return atEnd || m_str[pos] == '\n';
+        case Regex::Assertion::StringStart: return atStart;
+        case Regex::Assertion::StringEnd: return atEnd;
+        case Regex::Assertion::WordBoundary: return wordBefore != wordAfter;
+        case Regex::Assertion::NotWordBoundary: return wordBefore == wordAfter;
+        case Regex::Assertion::WordStart: return !wordBefore && wordAfter;
+        case Regex::Assertion::WordEnd: return wordBefore && !wordAfter;
+        case Regex::Assertion::SymbolStart:
+            return (atStart || !inClass(charBefore(pos), SymbolChar)) &&
+                (!atEnd && inClass(charAt(pos, length), SymbolChar));
+        case Regex::Assertion::SymbolEnd:
+            return (!atStart && inClass(charBefore(pos), SymbolChar)) &&
+                (atEnd || !inClass(charAt(pos, length), SymbolChar));
+        }
+        return false;
+    }
+
+    // Follows the instructions which do not consume input and adds the threads waiting for
+    // the next character to the list. The instructions are followed depth first in the order of
+    // their priority, from a stack of their own so that long chains of them cannot overflow the
+    // call stack. A save is undone by an entry popped after everything that followed it.
+    void addThread(ThreadList& list, int pc, size_t pos)
+    {
+        m_pending.push_back({pc, 0, 0});
+        while (!m_pending.empty()) {
+            const Pending p = m_pending.back();
+            m_pending.pop_back();
+            if (p.pc < 0) {
+                m_slots[p.slot] = p.old;
+                continue;
+            }
+            if (list.marks[p.pc] == list.generation) {
+                continue;
+            }
+            list.marks[p.pc] = list.generation;
+            const auto& instruction = m_regex.m_program[p.pc];
+            switch (instruction.op) {
+            case Regex::Op::Jump:
+                m_pending.push_back({instruction.x, 0, 0});
+                break;
+            case Regex::Op::Split:
+                m_pending.push_back({instruction.y, 0, 0});
+                m_pending.push_back({instruction.x, 0, 0});
+                break;
+            case Regex::Op::Save:
+                m_pending.push_back({-1, static_cast<size_t>(instruction.arg),
+                                     m_slots[instruction.arg]});
+                m_slots[instruction.arg] = pos;
+                m_pending.push_back({p.pc + 1, 0, 0});
+                break;
+            case Regex::Op::Assert:
+                if (holds(static_cast<Regex::Assertion>(instruction.arg), pos)) {
+                    m_pending.push_back({p.pc + 1, 0, 0});
+                }
+                break;
+            default:
+                list.pcs.push_back(p.pc);
+                list.slots.insert(list.slots.end(), m_slots.begin(), m_slots.end());
+                break;
+            }
+        }
+    }
+public:
+    Matcher(const Regex& regex, const std::string& str) :
+        m_regex(regex),
+        m_str(str),
+        m_slotCount(regex.m_groups * 2),
+        m_slots(m_slotCount, std::string::npos)
+    {
+        for (auto& list : m_lists) {
+            list.marks.resize(regex.m_program.size(), 0);
+        }
+    }
+
+    bool search(size_t pos, std::vector<size_t>& groups)
+    {
+        ThreadList* current = &m_lists[0];
+        ThreadList* next = &m_lists[1];
+        current->clear();
+        bool matched = false;
+        for (;;) {
+            if (!matched) {
+                if (current->pcs.empty() && m_regex.m_firstChar >= 0) {
+                    const void* found = std::memchr(m_str.c_str() + pos, m_regex.m_firstChar,
+                                                    m_str.size() - std::min(pos, m_str.size()));
+                    if (!found) {
+                        return false;
+                    }
+                    pos = static_cast<const char*>(found) - m_str.c_str();
+                }
+                std::fill(m_slots.begin(), m_slots.end(), std::string::npos);
+                addThread(*current, 0, pos);
+            }
+            if (current->pcs.empty() && (matched || pos >= m_str.size())) {
+                break;
+            }
+            size_t length;
+            const std::uint32_t c = charAt(pos, length);
+            const std::uint32_t folded = m_regex.m_caseFold ? foldCase(c) : c;
+            next->clear();
+            for (size_t i = 0; i < current->pcs.size(); i++) {
+                const auto& instruction = m_regex.m_program[current->pcs[i]];
+                bool advance = false;
+                switch (instruction.op) {
+                case Regex::Op::Match:
+                    matched = true;
+                    groups.assign(current->slots.begin() + i * m_slotCount,
+                                  current->slots.begin() + (i + 1) * m_slotCount);
+                    break;
+                case Regex::Op::Char:
+                    advance = length && folded == instruction.arg;
+                    break;
+                case Regex::Op::Any:
+                    advance = length && c != '\n';
+                    break;
+                case Regex::Op::Set:
+                    advance = length && m_regex.m_sets[instruction.arg].contains(c, m_regex.m_caseFold);
+                    break;
+                default:
+                    break;
+                }
+                if (instruction.op == Regex::Op::Match) {
+                    // Threads after this one have a lower priority than the match.
+                    break;
+                }
+                if (advance) {
+                    std::copy(current->slots.begin() + i * m_slotCount,
+                              current->slots.begin() + (i + 1) * m_slotCount,
+                              m_slots.begin());
+                    addThread(*next, current->pcs[i] + 1, pos + length);
+                }
+            }
+            if (!length) {
+                break;
+            }
+            pos += length;
+            std::swap(current, next);
+        }
+        return matched;
+    }
+};
+
+ALISP_INLINE Regex::Regex(const std::string& pattern, bool caseFold) : m_caseFold(caseFold)
+{
+    Compiler(*this, pattern).compile();
+}
+
+ALISP_INLINE bool Regex::search(const std::string& str, size_t start, std::vector<size_t>& groups) const
+{
+    if (start > str.size()) {
+        return false;
+    }
+    return Matcher(*this, str).search(start, groups);
+}
+
+ALISP_INLINE std::shared_ptr<const Regex> Cache::get(const std::string& pattern, bool caseFold)
+{
+    return m_cache.get((caseFold ? "i:" : "s:") + pattern, [&]() {
+        return std::make_shared<const Regex>(pattern, caseFold);
+    });
+}
+
+}
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "LruCache.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace alisp
+{
+
+namespace regex
+{
+
+// A regular expression in Emacs syntax compiled into a program for a Pike VM: a Thompson NFA
+// simulation which keeps its threads in priority order. Matching takes time linear in the
+// length of the string, yet submatches follow the same leftmost and greedy-first rules as a
+// backtracking matcher would. Strings are UTF-8 and all positions are byte offsets.
+class Regex
+{
+public:
+    enum class Op : std::uint8_t
+    {
+        Char,
+        Any,
+        Set,
+        Split,
+        Jump,
+        Save,
+        Assert,
+        Match
+    };
+
+    enum class Assertion : std::uint8_t
+    {
+        LineStart,
+        LineEnd,
+        StringStart,
+        StringEnd,
+        WordBoundary,
+        NotWordBoundary,
+        WordStart,
+        WordEnd,
+        SymbolStart,
+        SymbolEnd
+    };
+
+    struct CharSet
+    {
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> ranges;
+        std::uint32_t classes = 0;
+        bool negated = false;
+
+        bool contains(std::uint32_t c, bool caseFold) const;
+    };
+
+    struct Instruction
+    {
+        Op op;
+        std::uint32_t arg = 0; // Character, set, save slot or assertion
+        int x = 0;             // Jump target, or preferred branch of a split
+        int y = 0;             // Other branch of a split
+    };
+
+    Regex(const std::string& pattern, bool caseFold);
+
+    // Number of groups including the whole match, which is group zero.
+    size_t groupCount() const { return m_groups; }
+
+    // Finds the leftmost match which begins at or after the byte offset start. On success
+    // groups receives a start and an end offset for each group, or npos for a group which
+    // did not take part in the match.
+    bool search(const std::string& str, size_t start, std::vector<size_t>& groups) const;
+private:
+    std::vector<Instruction> m_program;
+    std::vector<CharSet> m_sets;
+    size_t m_groups = 1;
+    bool m_caseFold;
+    int m_firstChar = -1; // ASCII character every match starts with, if there is one
+
+    friend class Compiler;
+    friend class Matcher;
+};
+
+// Compiled patterns, least recently used ones dropped first once the capacity is reached.
+class Cache
+{
+    LruCache<Regex> m_cache;
+public:
+    Cache(size_t capacity = 64) : m_cache(capacity) {}
+
+    std::shared_ptr<const Regex> get(const std::string& pattern, bool caseFold);
+    size_t size() const { return m_cache.size(); }
+};
+}
+
+}
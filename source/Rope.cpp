@@ -0,0 +1,175 @@
+#include "Rope.hpp"
+#include "UTF8.hpp"
+#include "alisp.hpp"
+#include <algorithm>
+
+namespace alisp
+{
+
+// Byte offset of a character position within the text of a leaf.
+ALISP_STATIC size_t leafOffset(const std::string& text, size_t chars, size_t pos)
+{
+    if (text.size() == chars) {
+        return pos;
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < pos && offset < text.size(); i++) {
+        offset += std::max<size_t>(1, utf8::next(text.c_str() + offset));
+    }
+    return std::min(offset, text.size());
+}
+
+ALISP_INLINE Rope::NodePtr Rope::makeLeaf(std::string text)
+{
+    auto node = std::make_shared<Node>();
+    node->chars = utf8::countChars(text.data(), text.size());
+    node->bytes = text.size();
+    node->text = std::move(text);
+    return node;
+}
+
+ALISP_INLINE Rope::NodePtr Rope::makeNode(NodePtr left, NodePtr right)
+{
+    auto node = std::make_shared<Node>();
+    node->bytes = left->bytes + right->bytes;
+    node->chars = left->chars + right->chars;
+    node->height = std::max(left->height, right->height) + 1;
+    node->left = std::move(left);
+    node->right = std::move(right);
+    return node;
+}
+
+ALISP_INLINE Rope::NodePtr Rope::build(const std::string& text, size_t from, size_t to)
+{
+    if (to - from <= ChunkSize) {
+        return makeLeaf(text.substr(from, to - from));
+    }
+    size_t mid = from + (to - from) / 2;
+    while (mid < to && !utf8::kernels::startsCharacter(text[mid])) {
+        mid++;
+    }
+    return makeNode(build(text, from, mid), build(text, mid, to));
+}
+
+ALISP_INLINE Rope::Rope(const std::string& text)
+{
+    if (!text.empty()) {
+        m_root = build(text, 0, text.size());
+    }
+}
+
+ALISP_INLINE Rope::NodePtr Rope::join(const NodePtr& a, const NodePtr& b)
+{
+    if (!a) {
+        return b;
+    }
+    if (!b) {
+        return a;
+    }
+
+    // Small pieces go into the leaf next to them instead of a leaf of their own, so that
+    // appending a character at a time does not end up with a node per character.
+    if (!a->height && !b->height && a->bytes + b->bytes <= ChunkSize) {
+        return makeLeaf(a->text + b->text);
+    }
+    if (!b->height && a->height && !a->right->height && a->right->bytes + b->bytes <= ChunkSize) {
+        return makeNode(a->left, makeLeaf(a->right->text + b->text));
+    }
+    if (!a->height && b->height && !b->left->height && a->bytes + b->left->bytes <= ChunkSize) {
+        return makeNode(makeLeaf(a->text + b->left->text), b->right);
+    }
+
+    // Like joining AVL trees: descend along the edge of the higher tree until the heights
+    // match, then rotate on the way back up if a node ended up too high on one side.
+    if (a->height > b->height + 1) {
+        const NodePtr r = join(a->right, b);
+        if (r->height <= a->left->height + 1) {
+            return makeNode(a->left, r);
+        }
+        if (r->left->height > r->right->height) {
+            return makeNode(makeNode(a->left, r->left->left),
+                            makeNode(r->left->right, r->right));
+        }
+        return makeNode(makeNode(a->left, r->left), r->right);
+    }
+    if (b->height > a->height + 1) {
+        const NodePtr l = join(a, b->left);
+        if (l->height <= b->right->height + 1) {
+            return makeNode(l, b->right);
+        }
+        if (l->right->height > l->left->height) {
+            return makeNode(makeNode(l->left, l->right->left),
+                            makeNode(l->right->right, b->right));
+        }
+        return makeNode(l->left, makeNode(l->right, b->right));
+    }
+    return makeNode(a, b);
+}
+
+ALISP_INLINE Rope::NodePtr Rope::slice(const NodePtr& node, size_t from, size_t to)
+{
+    if (from >= to) {
+        return nullptr;
+    }
+    if (from == 0 && to == node->chars) {
+        return node;
+    }
+    if (!node->height) {
+        const size_t begin = leafOffset(node->text, node->chars, from);
+        const size_t end = leafOffset(node->text, node->chars, to);
+        return makeLeaf(node->text.substr(begin, end - begin));
+    }
+    const size_t split = node->left->chars;
+    if (to <= split) {
+        return slice(node->left, from, to);
+    }
+    if (from >= split) {
+        return slice(node->right, from - split, to - split);
+    }
+    return join(slice(node->left, from, split), slice(node->right, 0, to - split));
+}
+
+ALISP_INLINE std::uint32_t Rope::at(size_t pos) const
+{
+    const Node* node = m_root.get();
+    while (node->height) {
+        if (pos < node->left->chars) {
+            node = node->left.get();
+        }
+        else {
+            pos -= node->left->chars;
+            node = node->right.get();
+        }
+    }
+    std::uint32_t enc;
+    utf8::next(node->text.c_str() + leafOffset(node->text, node->chars, pos), &enc);
+    return utf8::decode(enc);
+}
+
+ALISP_INLINE Rope Rope::substr(size_t from, size_t to) const
+{
+    return m_root ? Rope(slice(m_root, from, std::min(to, m_root->chars))) : Rope();
+}
+
+ALISP_INLINE void Rope::appendTo(std::string& out) const
+{
+    if (!m_root) {
+        return;
+    }
+    if (!m_root->height) {
+        out += m_root->text;
+        return;
+    }
+    Rope(m_root->left).appendTo(out);
+    Rope(m_root->right).appendTo(out);
+}
+
+ALISP_INLINE std::string Rope::toString() const
+{
+    std::string ret;
+    ret.reserve(bytes());
+    appendTo(ret);
+    return ret;
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace alisp
+{
+
+// Immutable UTF-8 text kept as a balanced tree of chunks, each node knowing how many bytes and
+// characters are below it. Joining two ropes takes time logarithmic in their size and shares
+// all of their nodes, as do substrings, so long texts can be built piece by piece without
+// copying what was already there.
+class Rope
+{
+    struct Node
+    {
+        std::shared_ptr<const Node> left, right;
+        std::string text; // Leaves only
+        size_t bytes = 0;
+        size_t chars = 0;
+        int height = 0; // Zero for leaves
+    };
+    using NodePtr = std::shared_ptr<const Node>;
+
+    NodePtr m_root;
+
+    Rope(NodePtr root) : m_root(std::move(root)) {}
+
+    static NodePtr makeLeaf(std::string text);
+    static NodePtr makeNode(NodePtr left, NodePtr right);
+    static NodePtr build(const std::string& text, size_t from, size_t to);
+    static NodePtr join(const NodePtr& a, const NodePtr& b);
+    static NodePtr slice(const NodePtr& node, size_t from, size_t to);
+public:
+    // Small pieces are merged into leaves of up to this many bytes.
+    static constexpr size_t ChunkSize = 1024;
+
+    // Texts shorter than this are better off as plain strings.
+    static constexpr size_t MinBytes = 4 * ChunkSize;
+
+    Rope() = default;
+    explicit Rope(const std::string& text);
+
+    explicit operator bool() const { return m_root != nullptr; }
+    size_t bytes() const { return m_root ? m_root->bytes : 0; }
+    size_t chars() const { return m_root ? m_root->chars : 0; }
+    int height() const { return m_root ? m_root->height : 0; }
+
+    // Character at a position, which must be less than chars().
+    std::uint32_t at(size_t pos) const;
+
+    // Characters from position from up to but not including position to.
+    Rope substr(size_t from, size_t to) const;
+
+    void appendTo(std::string& out) const;
+    std::string toString() const;
+
+    friend Rope operator+(const Rope& a, const Rope& b) { return Rope(join(a.m_root, b.m_root)); }
+};
+
+}
@@ -38,32 +38,23 @@ void Machine::initSequenceFunctions()
     defun("nreverse", [this](const Object& obj) -> ObjectPtr {
         if (obj.isList()) {
             auto list = obj.asList();
-            auto head = list->cc;
-            auto tail = list->cc;
-            std::set<const ConsCell*> heads;
-            while (tail && tail->cdr) {
-                assert(tail->cdr->isList());
-                auto newhead = tail->cdr->asList()->cc;
-                if (heads.count(newhead.get())) {
-                    throw exceptions::CircularList(obj.toString());
-                }
-                heads.insert(newhead.get());
-                assert(tail->cdr->asList()->cc.get());
-                std::shared_ptr<ConsCell> oldc;
-                if (newhead->cdr) {
-                    if (!newhead->cdr->asList()) {
-                        auto to = ConsCellObject(newhead, this);
-                        throw exceptions::WrongTypeArgument(to.toString());
-                    }
-                    assert(newhead->cdr->asList());
-                    assert(newhead->cdr->asList()->cc);
-                    oldc = newhead->cdr->asList()->cc;
+            if (list->cc && list->cc->chain().circular) {
+                throw exceptions::CircularList(obj.toString());
+            }
+            ConsCellPtr p = list->cc;
+            for (const ConsCell* last = p.get(); last; last = last->next()) {
+                if (last->dotted()) {
+                    throw exceptions::WrongTypeArgument(last->dotted()->toString());
                 }
-                newhead->cdr = std::make_unique<ConsCellObject>(head, this);
-                tail->cdr = oldc ? std::make_unique<ConsCellObject>(oldc, this) : nullptr;
-                head = newhead;
             }
-            return std::make_unique<ConsCellObject>(head, this);
+            ConsCellPtr head;
+            while (p) {
+                ConsCellPtr next = p->takeNext();
+                p->setNext(std::move(head));
+                head = std::move(p);
+                p = std::move(next);
+            }
+            return std::make_unique<ConsCellObject>(std::move(head), this);
         }
         else {
             throw exceptions::WrongTypeArgument(obj.toString());
@@ -74,39 +65,36 @@ void Machine::initSequenceFunctions()
             return obj.clone();
         }
         else if (obj.isList()) {
-            std::vector<std::shared_ptr<ConsCell>> ccs;
-            std::set<const ConsCell*> inserted;
-            auto ptr = obj.asList();
-            while (ptr) {
-                if (inserted.count(ptr->consCell().get())) {
-                    throw exceptions::CircularList(obj.toString());
+            const ConsCell* head = obj.asList()->cc.get();
+            CycleDetector detector(head);
+            for (const ConsCell* ptr = head; ptr; ptr = ptr->next()) {
+                if (ptr->dotted()) {
+                    throw exceptions::WrongTypeArgument("listp " + ptr->dotted()->toString());
                 }
-                inserted.insert(ptr->consCell().get());
-                ccs.push_back(ptr->consCell());
-                if (ptr->cdr() && !ptr->cdr()->isList()) {
-                    throw exceptions::WrongTypeArgument("listp " + ptr->cdr()->toString());
+                if (ptr->next() && detector.step(ptr->next())) {
+                    throw exceptions::CircularList(obj.toString());
                 }
-                ptr = ptr->next();
+            }
+
+            // Take the cells apart so that relinking them doesn't drop any shared references.
+            std::vector<ConsCellPtr> ccs;
+            ccs.push_back(obj.asList()->cc);
+            while (ccs.back()->next()) {
+                ccs.push_back(ccs.back()->takeNext());
             }
             ConsCell cca;
-            cca.cdr = std::make_unique<ConsCellObject>(this);
-            cca.cdr->asList()->cc = std::make_shared<ConsCell>();
-            ConsCell& ccb = *cca.cdr->asList()->cc;            
+            cca.setNext(ConsCellPtr::make());
+            ConsCell& ccb = *cca.next();
             std::stable_sort(ccs.begin(), ccs.end(), [&](const auto& a, const auto& b) {
                 cca.car = a->car->clone();
                 ccb.car = b->car->clone();
                 FArgs args(cca, *this);
                 return !pred.func(args)->isNil();
             });
-            for (auto it = ccs.begin(); it != ccs.end(); ++it) {
-                if (it + 1 == ccs.end()) {
-                    it->get()->cdr = nullptr;
-                }
-                else {
-                    it->get()->cdr = std::make_unique<ConsCellObject>(*(it +1), this);
-                }
+            for (size_t i = ccs.size() - 1; i > 0; i--) {
+                ccs[i - 1]->setNext(std::move(ccs[i]));
             }
-            return std::make_unique<ConsCellObject>(ccs.front(), this);
+            return std::make_unique<ConsCellObject>(std::move(ccs.front()), this);
         }
         throw exceptions::WrongTypeArgument(obj.toString());
     });
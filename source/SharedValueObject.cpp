@@ -1,102 +1,95 @@
-#define ENABLE_DEBUG_REFCOUNTING
 #include "alisp.hpp"
 #include "SharedValueObject.hpp"
+#include "ConsCellObject.hpp"
+#include "SymbolObject.hpp"
 #include <map>
+#include <vector>
 
 namespace alisp {
 
-ALISP_INLINE void SharedValueObjectBase::tryDestroySharedData()
+ALISP_INLINE void visitShared(const Object& obj, const SharedRefVisitor& f)
 {
-    if (!sharedDataPointer()) {
-        return;
+    if (obj.isList()) {
+        obj.asList()->visitShared(f);
     }
-    if (markedForCycleDeletion) {
-        markedForCycleDeletion->erase(this);
-        if (Object::destructionDebug()) {
-            std::cout << this << " was deleted.\n";
-        }
-        return;
+    else if (obj.isSymbol()) {
+        obj.asSymbol()->visitShared(f);
     }
+}
 
-    // Of course if our shared pointer is the last remaining pointer to the shared data,
-    // then there is no need for complex cycle checks.
-    if (sharedDataRefCount() == 1) {
-        reset();
-        return;
-    }
-    
-    if (Object::destructionDebug()) {
-        std::cout << "A reference to shared data " << toString()
-                  << " is about to be reduced by one. this=" << this << std::endl;
+ALISP_INLINE void visitShared(const ConsCell* cell, const SharedRefVisitor& f)
+{
+    for (; cell; cell = cell->next()) {
+        if (!f(SharedRef{cell, cell->refCount, const_cast<ConsCell*>(cell)})) {
+            return;
+        }
+        if (cell->car) {
+            visitShared(*cell->car, f);
+        }
+        if (cell->dotted()) {
+            visitShared(*cell->dotted(), f);
+        }
     }
+}
 
-    // Traverse through the list. For every cons cell encountered, count how many times
-    // it is referenced by the list.
+// Called before a reference to shared data is dropped while other references to it remain.
+// The traversal starts from the reference being dropped, so that reference is counted too.
+ALISP_STATIC void collectUnreachable(const std::function<void(const SharedRefVisitor&)>& traverse)
+{
+    // For every cell and symbol encountered, count how many times it is referenced from
+    // within the structure.
     struct RefData {
         size_t refsFromCycle = 0;
-        size_t totalRefs = 0; // except ref from this->cc as we are possibly about the del it!
+        size_t totalRefs = 0;
+        ConsCell* cell = nullptr;
+        Symbol* symbol = nullptr;
     };
     std::map<const void*, RefData> referredTimes;
-    size_t maxUseCount = 0;
-    traverse([&](const Object& baseObj) {
-        const SharedValueObjectBase* obj = dynamic_cast<const SharedValueObjectBase*>(&baseObj);
-        if (!obj || !obj->sharedDataPointer()) {
-            return false;
-        }
-        auto ptr = obj->sharedDataPointer();
-        referredTimes[ptr].refsFromCycle++;
-        referredTimes[ptr].totalRefs = obj->sharedDataRefCount();
-        if (referredTimes[ptr].refsFromCycle >= 2) {
-            return false;
-        }
-        return true;
+    traverse([&](const SharedRef& ref) {
+        RefData& data = referredTimes[ref.data];
+        data.totalRefs = ref.refCount;
+        data.cell = ref.cell;
+        data.symbol = ref.symbol;
+        return ++data.refsFromCycle == 1;
     });
-    for (auto& p : referredTimes) {
-        if (Object::destructionDebug()) {
-            std::cout << p.first << ": totalRefs=" << p.second.totalRefs
-                      << ", refsFromCycle=" << p.second.refsFromCycle << std::endl;
-        }
+    for (const auto& p : referredTimes) {
         if (p.second.totalRefs > p.second.refsFromCycle) {
-            // Fair enough. Somebody is still referring to the cycle from outside it.
+            // Fair enough. Somebody is still referring to the structure from outside it.
             return;
         }
     }
 
-    if (Object::destructionDebug()) {
-        std::cout << "The whole cycle is unreachable!\n";
-    }
-    std::set<SharedValueObjectBase*> clearList;
-    traverse([&](const Object& baseObj) {
-        const SharedValueObjectBase* obj = dynamic_cast<const SharedValueObjectBase*>(&baseObj);
-        if (!obj || !obj->sharedDataPointer()) {
-            return false;
-        }
-        auto cc = const_cast<SharedValueObjectBase*>(obj);
-        if (clearList.count(cc)) {
-            return false;
-        }
-        clearList.insert(cc);
-        cc->markedForCycleDeletion = &clearList;
-        return true;
-    });
-    while (clearList.size()) {
-        if (Object::destructionDebug()) {
-            std::cout << "Still " << clearList.size() << " objects left to destroy!\n";
-            for (auto p : clearList) {
-                std::cout << "   " << p << std::endl;
-            }
+    // The whole structure is unreachable. Detach everything the cells and symbols hold before
+    // letting any of it go, which breaks the cycles so that reference counting can free them.
+    std::vector<ObjectPtr> objects;
+    std::vector<ConsCellPtr> cells;
+    std::vector<std::unique_ptr<ConsCellObject>> plists;
+    for (auto& p : referredTimes) {
+        if (ConsCell* cell = p.second.cell) {
+            objects.push_back(cell->takeCar());
+            objects.push_back(cell->takeDotted());
+            cells.push_back(cell->takeNext());
         }
-        auto p = *clearList.begin();
-        clearList.erase(clearList.begin());
-        if (Object::destructionDebug()) {
-            std::cout << p << " about to be reseted\n";
+        if (Symbol* symbol = p.second.symbol) {
+            objects.push_back(std::move(symbol->variable));
+            plists.push_back(std::move(symbol->plist));
         }
-        p->reset();
-        if (Object::destructionDebug())
-            std::cout << p << " done...\n";
     }
-    if (Object::destructionDebug())
-        std::cout << "Done deleting circular list!\n";
+}
+
+ALISP_INLINE void collectCycles(const ConsCell* cell)
+{
+    collectUnreachable([cell](const SharedRefVisitor& f) { visitShared(cell, f); });
+}
+
+ALISP_INLINE void SharedValueObjectBase::tryDestroySharedData()
+{
+    // Of course if our reference is the last remaining reference to the shared data, then
+    // there is no need for complex cycle checks.
+    if (!sharedDataPointer() || sharedDataRefCount() == 1) {
+        return;
+    }
+    collectUnreachable([this](const SharedRefVisitor& f) { visitShared(f); });
 }
 
 }
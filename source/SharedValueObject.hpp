@@ -1,19 +1,39 @@
 #pragma once
 #include "Object.hpp"
-#include <set>
+#include <functional>
 
 namespace alisp
 {
 
+struct ConsCell;
+struct Symbol;
+
+// A reference to shared data as seen by the cycle collector. Only cons cells and symbols
+// refer onwards to other data, so only they can be part of a cycle.
+struct SharedRef
+{
+    const void* data;
+    size_t refCount;
+    ConsCell* cell = nullptr;
+    Symbol* symbol = nullptr;
+};
+
+// Returns whether to continue to the references held by the data.
+using SharedRefVisitor = std::function<bool(const SharedRef&)>;
+
 struct SharedValueObjectBase : Object
 {
-    std::set<SharedValueObjectBase*>* markedForCycleDeletion = nullptr;
-    void tryDestroySharedData(); // Derived classes must call this from destructor.
+    void tryDestroySharedData(); // Derived classes which can be part of a cycle must call this
+                                 // from destructor.
     virtual const void* sharedDataPointer() const = 0;
     virtual size_t sharedDataRefCount() const = 0;
-    virtual void reset() = 0;
+    virtual void visitShared(const SharedRefVisitor& f) const {}
 };
 
+void visitShared(const Object& obj, const SharedRefVisitor& f);
+void visitShared(const ConsCell* cell, const SharedRefVisitor& f);
+void collectCycles(const ConsCell* cell);
+
 template<typename T>
 struct SharedValueObject : SharedValueObjectBase,
     ConvertibleTo<T>,
@@ -23,10 +43,8 @@ struct SharedValueObject : SharedValueObjectBase,
     std::shared_ptr<T> value;
 
     SharedValueObject(std::shared_ptr<T> value) : value(value) {}
-    ~SharedValueObject() { tryDestroySharedData(); }
     const void* sharedDataPointer() const override { return value.get(); }
     size_t sharedDataRefCount() const override { return value.use_count(); };
-    void reset() override { value.reset(); }
 
     bool eq(const Object& o) const override
     {
@@ -0,0 +1,173 @@
+#include "AtScopeExit.hpp"
+#include "ConsCellObject.hpp"
+#include "Error.hpp"
+#include "Machine.hpp"
+#include "SymbolObject.hpp"
+#include "alisp.hpp"
+#include <limits>
+
+namespace alisp
+{
+
+ALISP_STATIC int countForms(const ConsCell* forms)
+{
+    int n = 0;
+    for (; forms; forms = forms->next()) {
+        n++;
+    }
+    return n;
+}
+
+ALISP_STATIC void requireForms(const ConsCell* forms, int min)
+{
+    const int n = countForms(forms);
+    if (n < min) {
+        throw exceptions::WrongNumberOfArguments(n);
+    }
+}
+
+// Evaluates forms one after another, returning the value of the last one.
+ALISP_STATIC ObjectPtr evalBody(Machine& m, const ConsCell* body)
+{
+    ObjectPtr ret;
+    for (; body; body = body->next()) {
+        ret = body->car->eval();
+    }
+    return ret ? std::move(ret) : m.makeNil();
+}
+
+ALISP_STATIC bool isTrue(const ConsCell& form)
+{
+    ObjectPtr storage;
+    return !form.car->evalBorrowed(storage)->isNil();
+}
+
+ALISP_INLINE ObjectPtr Machine::let(const ConsCell* args, bool star)
+{
+    requireForms(args, 2);
+    std::vector<std::pair<const SymbolObject*, ObjectPtr>> pushList;
+    const size_t depth = bindingDepth();
+    const AtScopeExit onExit([this, depth]() { unbindVariables(depth); });
+    for (auto& arg : *args->car->asList()) {
+        const SymbolObject* name;
+        ObjectPtr value;
+        if (arg.isList()) {
+            auto cc = arg.asList()->cc.get();
+            name = dynamic_cast<const SymbolObject*>(cc->car.get());
+            assert(name && name->name.size());
+            value = cc->next() ? cc->next()->car->eval() : makeNil();
+        }
+        else if ((name = dynamic_cast<const SymbolObject*>(&arg))) {
+            assert(name->name.size());
+            value = makeNil();
+        }
+        else {
+            throw exceptions::WrongTypeArgument(arg.toString());
+        }
+        if (star) {
+            bindVariable(*name, std::move(value));
+        }
+        else {
+            pushList.emplace_back(name, std::move(value));
+        }
+    }
+    for (auto& push : pushList) {
+        bindVariable(*push.first, std::move(push.second));
+    }
+    return evalBody(*this, args->next());
+}
+
+ALISP_INLINE ObjectPtr Machine::evalSpecialForm(SpecialForm form, const ConsCell* args)
+{
+    switch (form) {
+    case SpecialForm::If:
+        requireForms(args, 2);
+        if (isTrue(*args)) {
+            return args->next()->car->eval();
+        }
+        return evalBody(*this, args->next()->next());
+    case SpecialForm::Let:
+    case SpecialForm::LetStar:
+        return let(args, form == SpecialForm::LetStar);
+    case SpecialForm::While:
+        requireForms(args, 1);
+        while (isTrue(*args)) {
+            for (const ConsCell* body = args->next(); body; body = body->next()) {
+                body->car->eval();
+            }
+        }
+        return makeNil();
+    case SpecialForm::Cond:
+        for (; args; args = args->next()) {
+            const Object& clause = *args->car;
+            requireType<ConsCellObject>(clause);
+            if (clause.isNil()) {
+                continue;
+            }
+            const ConsCell& cc = *clause.asList()->cc;
+            ObjectPtr value = cc.car->eval();
+            if (!value->isNil()) {
+                return cc.next() ? evalBody(*this, cc.next()) : std::move(value);
+            }
+        }
+        return makeNil();
+    case SpecialForm::And: {
+        ObjectPtr ret = makeTrue();
+        for (; args; args = args->next()) {
+            ret = args->car->eval();
+            if (ret->isNil()) {
+                break;
+            }
+        }
+        return ret;
+    }
+    case SpecialForm::Or:
+        for (; args; args = args->next()) {
+            ObjectPtr value = args->car->eval();
+            if (!value->isNil()) {
+                return value;
+            }
+        }
+        return makeNil();
+    case SpecialForm::Progn:
+        return evalBody(*this, args);
+    case SpecialForm::Prog1: {
+        if (!args) {
+            return makeNil();
+        }
+        ObjectPtr ret = args->car->eval();
+        evalBody(*this, args->next());
+        return ret;
+    }
+    case SpecialForm::None:
+        break;
+    }
+    assert(false);
+    return makeNil();
+}
+
+ALISP_INLINE void Machine::initSpecialForms()
+{
+    const std::pair<const char*, SpecialForm> forms[] = {
+        {"if", SpecialForm::If},
+        {"let", SpecialForm::Let},
+        {"let*", SpecialForm::LetStar},
+        {"while", SpecialForm::While},
+        {"cond", SpecialForm::Cond},
+        {"and", SpecialForm::And},
+        {"or", SpecialForm::Or},
+        {"progn", SpecialForm::Progn},
+        {"prog1", SpecialForm::Prog1}
+    };
+    // The functions are only called by funcall and apply, as the evaluator recognizes the
+    // symbols and evaluates the forms itself.
+    for (const auto& [name, form] : forms) {
+        const Function* func = makeSpecialForm(name, 0, std::numeric_limits<int>::max(),
+                                               [this, form = form](FArgs& args) {
+            return evalSpecialForm(form, args.cc);
+        });
+        getSymbol(func->name)->special = form;
+    }
+}
+
+}
@@ -1,70 +1,179 @@
 #pragma once
+#include <algorithm>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <cstring>
 #include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 #include "UTF8.hpp"
 #include <iostream>
 
 namespace alisp {
 
-class String {
-    std::shared_ptr<std::string> m_str;
-    
-    size_t mapToUnderlying(size_t pos) const
-    {
-        return proceed(0, pos);
-    }
+// Maps character positions of a UTF-8 string to byte offsets. Built lazily on first use and
+// rebuilt whenever the string has changed size or was explicitly invalidated. An ASCII string
+// maps positions directly, others keep the offset of every Interval'th character so that any
+// position is at most Interval characters of decoding away.
+class StringIndex
+{
+    static constexpr size_t Interval = 64;
+
+    bool m_valid = false;
+    bool m_ascii = false;
+    size_t m_bytes = 0;
+    size_t m_length = 0;
+    std::vector<size_t> m_checkpoints;
 
-    size_t proceed(size_t startBytes, size_t n) const
+    void update(const std::string& str)
     {
-        size_t it = startBytes;
-        const char* str = c_str();
-        for (size_t i = 0;i < n;i++) {
-            const size_t proceed = utf8::next(str + it, nullptr);
+        if (m_valid && m_bytes == str.size()) {
+            return;
+        }
+        m_checkpoints.clear();
+        // Characters of the ASCII prefix take a byte each. Only the rest must be decoded.
+        const size_t bytes = std::strlen(str.c_str());
+        const size_t ascii = utf8::asciiPrefix(str.c_str(), bytes);
+        for (size_t i = 0; i < ascii; i += Interval) {
+            m_checkpoints.push_back(i);
+        }
+        m_length = ascii;
+        size_t offset = ascii;
+        for (;;) {
+            if (m_length % Interval == 0) {
+                m_checkpoints.push_back(offset);
+            }
+            const size_t proceed = utf8::next(str.c_str() + offset);
             if (proceed == 0) {
-                return std::string::npos;
+                break;
             }
-            it += proceed;
+            offset += proceed;
+            m_length++;
+        }
+        // Every character taking a single byte is all we need for direct indexing.
+        m_ascii = m_length == offset;
+        if (m_ascii) {
+            m_checkpoints.clear();
         }
-        return it;
+        m_bytes = str.size();
+        m_valid = true;
     }
+public:
+    void invalidate() { m_valid = false; }
+
+    size_t length(const std::string& str)
+    {
+        update(str);
+        return m_length;
+    }
+
+    // Returns the byte offset of the given character, or npos if the string is shorter. The
+    // position one past the last character maps to the end of the string.
+    size_t byteOffset(const std::string& str, size_t index)
+    {
+        update(str);
+        if (index > m_length) {
+            return std::string::npos;
+        }
+        if (m_ascii) {
+            return index;
+        }
+        size_t offset = m_checkpoints[index / Interval];
+        for (size_t n = index % Interval; n; n--) {
+            offset += utf8::next(str.c_str() + offset);
+        }
+        return offset;
+    }
+};
+
+// Makes a string and its index in a single allocation.
+inline std::pair<std::shared_ptr<std::string>, std::shared_ptr<StringIndex>>
+makeIndexedString(std::string str)
+{
+    struct Storage
+    {
+        std::string str;
+        StringIndex index;
+    };
+    auto storage = std::make_shared<Storage>(Storage{std::move(str), StringIndex()});
+    return { std::shared_ptr<std::string>(storage, &storage->str),
+             std::shared_ptr<StringIndex>(storage, &storage->index) };
+}
+
+class String {
+    std::shared_ptr<std::string> m_str;
+    std::shared_ptr<StringIndex> m_index;
 public:
     static const size_t npos = std::string::npos;
+
+    // Byte offset of a character position, or npos past the end of the string.
+    size_t mapToUnderlying(size_t pos) const
+    {
+        return m_index->byteOffset(*m_str, pos);
+    }
     
-    String(std::string s) : m_str(std::make_shared<std::string>(std::move(s))) {}
-    String(const String& o) : m_str(o.m_str) {}
-    String(const std::shared_ptr<std::string>& o) : m_str(o) {}
+    String(std::string s)
+    {
+        std::tie(m_str, m_index) = makeIndexedString(std::move(s));
+    }
+    String(const String& o) : m_str(o.m_str), m_index(o.m_index) {}
+    String(const std::shared_ptr<std::string>& o) :
+        m_str(o),
+        m_index(std::make_shared<StringIndex>())
+    {}
+    String(const std::shared_ptr<std::string>& o, const std::shared_ptr<StringIndex>& index) :
+        m_str(o),
+        m_index(index)
+    {}
 
     std::shared_ptr<std::string> sharedPointer() const { return m_str; }
+    long useCount() const { return m_str.use_count(); }
+    std::shared_ptr<StringIndex> sharedIndex() const { return m_index; }
     const std::string& toStdString() const { return *m_str; }
     const char* c_str() const { return m_str->c_str(); }
-    size_t size() const { return utf8::strlen(c_str()); }
+    size_t size() const { return m_index->length(*m_str); }
     size_t length() const { return size(); }
     String copy() const { return String(*m_str); }
-    void operator+=(std::uint32_t codepoint) { *m_str += utf8::encode(codepoint); }
-    void operator+=(std::string str) { *m_str += str; }
+
+    // Must be called after modifying the underlying string in place.
+    void contentsChanged() const { m_index->invalidate(); }
+
+    void operator+=(std::uint32_t codepoint)
+    {
+        *m_str += utf8::encode(codepoint);
+        contentsChanged();
+    }
+
+    void operator+=(std::string str)
+    {
+        *m_str += str;
+        contentsChanged();
+    }
 
     String substr(size_t from, size_t n = npos) const
     {
         if (n == 0) {
             return String(std::string());
         }
+        const size_t charFrom = from;
         from = mapToUnderlying(from);
         if (from == npos) {
             throw std::runtime_error("String index out of range");
         }
         if (n != npos) {
-            const size_t to = proceed(from, n);
-            n = to - from;
+            const size_t to = mapToUnderlying(charFrom + n);
+            n = to == npos ? npos : to - from;
         }
         return String(toStdString().substr(from, n));
     }
 
     std::uint32_t operator[](size_t index) const
     {
-        size_t to = mapToUnderlying(index);
+        const size_t to = mapToUnderlying(index);
         std::uint32_t enc;
-        if (utf8::next(c_str() + to, &enc) == 0) {
+        if (to == npos || utf8::next(c_str() + to, &enc) == 0) {
             throw std::runtime_error("String index out of range");
         }
         return utf8::decode(enc);
@@ -115,6 +224,42 @@ public:
     bool operator==(const char* cstr) const { return (!m_str && !cstr[0]) || *m_str == cstr; }
 };
 
+// Strings which read the same share one copy. Used for string literals read from code and for
+// symbol names handed out as strings. Shared text must not be modified in place: whoever wants
+// to modify a string takes a private copy of text which others refer to.
+class StringTable
+{
+    std::unordered_map<std::string_view, String> m_strings; // Keys view the text of the values
+    size_t m_purgeAt = 1024;
+
+    // Drops the strings nobody uses anymore. A string made by String(std::string) keeps its
+    // text and index in one allocation, so two references are the table's own.
+    void purge()
+    {
+        for (auto it = m_strings.begin(); it != m_strings.end();) {
+            it = it->second.useCount() <= 2 ? m_strings.erase(it) : std::next(it);
+        }
+        m_purgeAt = std::max<size_t>(1024, m_strings.size() * 2);
+    }
+public:
+    // Returns a string with the shared text. Each one gets an index of its own, which also
+    // keeps the strings distinct objects as far as eq is concerned.
+    String intern(std::string str)
+    {
+        auto it = m_strings.find(str);
+        if (it == m_strings.end()) {
+            if (m_strings.size() >= m_purgeAt) {
+                purge();
+            }
+            String shared(std::move(str));
+            it = m_strings.emplace(shared.toStdString(), shared).first;
+        }
+        return String(it->second.sharedPointer());
+    }
+
+    size_t size() const { return m_strings.size(); }
+};
+
 inline std::ostream &operator<<(std::ostream &os, const String& str)
 {
     os << str.toStdString();
@@ -8,118 +8,110 @@
 #include "alisp.hpp"
 #include <algorithm>
 #include <cstdint>
+#include <limits>
 #include <ostream>
-#include <regex>
 #include <sstream>
 #include <string>
 #include "UTF8.hpp"
 #include "String.hpp"
 #include "SymbolObject.hpp"
+#include "StreamObject.hpp"
+#include "AtScopeExit.hpp"
+#include "Format.hpp"
+#include "Rope.hpp"
+#include "Unicode.hpp"
 
 namespace alisp
 {
 
-ALISP_STATIC String format(const String str, FArgs& args)
+// Substitutes \\& and \\N in the replacement text of replace-regexp-in-string.
+ALISP_STATIC std::string expandReplacement(const std::string& rep,
+                                           const std::string& str,
+                                           const std::vector<size_t>& groups)
 {
-    String ret("");
-    for (auto it = str.begin(); it != str.end(); ++it) {
-        const std::uint32_t c = *it;
-        if (c == '%') {
-            ++it;
-            assert(it != str.end());
-            std::uint32_t n = *it;
-
-            bool leadingZeros = false;
-            bool plus = false;
-            int intWidth = 0;
-            while (n == '+') {
-                plus = true;
-                n = *++it;
-            }
-            while (n == '0') {
-                leadingZeros = true;
-                n = *++it;
-            }
-            if (n >= '1' && n <= '9') {
-                std::string s;
-                s += n;
-                n = *++it;
-                while (n >= '1' && n <= '9') {
-                    s += n;
-                    n = *++it;
-                }
-                intWidth = std::atoi(s.c_str());
-            }
-            
-            if (n == '%') {
-                ret += c;
-            }
-            else if (n == 'd') {
-                const auto nextSym = args.pop();
-                std::string val;
-                if (nextSym->isInt() || nextSym->isFloat()) {
-                    val = std::to_string(nextSym->value<Number>().i);
-                }
-                else {
-                    throw exceptions::Error("Format specifier doesn’t match argument type");
-                }
-                if (plus && val[0] != '-') {
-                    val = "+" + val;
-                }
-                if (intWidth && val.size() < intWidth) {
-                    const char filler = (leadingZeros ? '0' : ' ');
-                    const bool startsWithSign = val[0] == '+' || val[0] == '-';
-                    if (startsWithSign && filler == '0') {
-                        val = val[0] + std::string(intWidth - val.size(), filler) + val.substr(1);
-                    }
-                    else {
-                        val = std::string(intWidth - val.size(), filler) + val;
-                    }
-                }
-                ret += val;
-            }
-            else if (n == 'c') {
-                const auto nextSym = args.pop();
-                if (!nextSym->isCharacter()) {
-                    throw exceptions::Error("Format specifier doesn’t match argument type");
-                }
-                ret += utf8::encode(nextSym->value<std::uint32_t>());
-            }
-            else if (n == 'S') { ret += args.pop()->toString(false); }
-            else if (n == 's') { ret += args.pop()->toString(true); }
-            else {
-                throw exceptions::Error("Invalid format operation");
-            }
+    std::string ret;
+    for (size_t i = 0; i < rep.size(); i++) {
+        if (rep[i] != '\\') {
+            ret += rep[i];
+            continue;
         }
-        else {
+        const char c = i + 1 < rep.size() ? rep[++i] : '\0';
+        if (c == '\\') {
             ret += c;
+            continue;
+        }
+        if (c != '&' && (c < '0' || c > '9')) {
+            throw exceptions::Error("Invalid use of `\\' in replacement text");
+        }
+        const size_t group = c == '&' ? 0 : c - '0';
+        if (group * 2 >= groups.size()) {
+            throw exceptions::Error("replace-match subexpression does not exist");
+        }
+        if (groups[group * 2] != std::string::npos) {
+            ret.append(str, groups[group * 2], groups[group * 2 + 1] - groups[group * 2]);
         }
     }
     return ret;
 }
 
+ALISP_STATIC std::string callReplacementFunction(const Object& func, const String& matched)
+{
+    const auto function = func.resolveFunction();
+    ConsCell cc;
+    cc.car = std::make_unique<StringObject>(matched);
+    FArgs args(cc, function->parent);
+    const auto ret = function->func(args);
+    if (!ret->isString()) {
+        throw exceptions::WrongTypeArgument(ret->toString());
+    }
+    return ret->value<std::string>();
+}
+
+ALISP_INLINE std::ostream& Machine::standardOutput()
+{
+    const auto sym = getSymbolOrNull(parsedSymbolName("*standard-output*"));
+    const auto stream = sym && sym->variable ?
+        sym->variable->valueOrNull<std::ostream*>() : std::nullopt;
+    return stream ? **stream : std::cout;
+}
+
 void Machine::initStringFunctions()
 {
-    defun("print", [](const Object& obj, std::optional<std::ostream*> stream){
-        if (!stream) { *stream = &std::cout; }
-        (**stream) << "\n" << obj.toString() << "\n";
+    // Printing goes to *standard-output* unless a stream is given, so that it can be captured
+    // by with-output-to-string.
+    auto outputStream = [this](std::optional<std::ostream*> stream) {
+        return stream ? *stream : &standardOutput();
+    };
+    defun("print", [outputStream](const Object& obj, std::optional<std::ostream*> stream){
+        (*outputStream(stream)) << "\n" << obj.toString() << "\n";
         return obj.clone();
     });
-    defun("prin1", [](const Object& obj, std::optional<std::ostream*> stream){
-        if (!stream) { *stream = &std::cout; }
-        (**stream) << obj.toString();
+    defun("prin1", [outputStream](const Object& obj, std::optional<std::ostream*> stream){
+        (*outputStream(stream)) << obj.toString();
         return obj.clone();
     });
-    defun("princ", [](const Object& obj, std::optional<std::ostream*> stream){
-        if (!stream) { *stream = &std::cout; }
-        (**stream) << obj.toString(true);
+    defun("princ", [outputStream](const Object& obj, std::optional<std::ostream*> stream){
+        (*outputStream(stream)) << obj.toString(true);
         return obj.clone();
     });
-    defun("write-char", [](std::uint32_t codepoint, std::optional<std::ostream*> stream) {
-        if (!stream) { *stream = &std::cout; }
-        (**stream) << utf8::encode(codepoint);
+    defun("write-char", [outputStream](std::uint32_t codepoint,
+                                       std::optional<std::ostream*> stream) {
+        (*outputStream(stream)) << utf8::encode(codepoint);
         return codepoint;
     });
+    makeFunc("with-output-to-string", 0, std::numeric_limits<int>::max(), [this](FArgs& args) {
+        std::ostringstream output;
+        const std::string name = parsedSymbolName("*standard-output*");
+        const size_t depth = bindingDepth();
+        bindVariable(name, std::make_unique<OStreamObject>(&output));
+        {
+            AtScopeExit onExit([this, depth]() { unbindVariables(depth); });
+            if (args.hasNext()) {
+                args.evalAll();
+            }
+        }
+        return makeObject(output.str());
+    });
     defun("char-or-string-p", [](const Object& obj) { return obj.isString() || obj.isCharacter(); });
     defun("make-string", [](std::int64_t num, std::uint32_t c) {
         if (c < 128) {
@@ -149,18 +141,82 @@ void Machine::initStringFunctions()
     defun("max-char", []() { return utf8::MaxChar; });
     defun("string-or-null-p", [](const Object& obj) { return obj.isString() || obj.isNil(); });
     defun("string-bytes", [](const std::string& s) { return static_cast<std::int64_t>(s.size()); });
-    defun("concat", [](const std::string& str1, const std::string& str2) { return str1 + str2; });
-    defun("substring", [](String str,
+    defun("concat", [](Rest& args) -> ObjectPtr {
+        // The pieces are borrowed until the call is over, so the result can be sized up front
+        // and written with a single allocation. Long results are joined as ropes instead,
+        // which shares the pieces which already were ropes instead of copying them.
+        std::vector<const StringObject*> pieces;
+        size_t size = 0;
+        while (args.hasNext()) {
+            const Object* piece = args.pop();
+            if (piece->isNil()) {
+                continue;
+            }
+            const auto str = dynamic_cast<const StringObject*>(piece);
+            if (!str) {
+                throw exceptions::WrongTypeArgument(piece->toString());
+            }
+            size += str->bytes();
+            pieces.push_back(str);
+        }
+        if (size >= Rope::MinBytes) {
+            Rope ret;
+            for (const StringObject* piece : pieces) {
+                ret = ret + piece->toRope();
+            }
+            return std::make_unique<StringObject>(ret);
+        }
+        std::string ret;
+        ret.reserve(size);
+        for (const StringObject* piece : pieces) {
+            piece->appendTo(ret);
+        }
+        return std::make_unique<StringObject>(std::move(ret));
+    });
+    defun("string-join", [](const ConsCell* strings, std::optional<std::string> separator) {
+        std::string ret;
+        if (!strings) {
+            return ret;
+        }
+        const std::string sep = separator ? *separator : "";
+        size_t size = 0, count = 0;
+        for (const Object& obj : *strings) {
+            if (!obj.isString()) {
+                throw exceptions::WrongTypeArgument(obj.toString());
+            }
+            size += obj.value<const std::string&>().size();
+            count++;
+        }
+        ret.reserve(size + sep.size() * (count - 1));
+        bool first = true;
+        for (const Object& obj : *strings) {
+            if (!first) {
+                ret += sep;
+            }
+            ret += obj.value<const std::string&>();
+            first = false;
+        }
+        return ret;
+    });
+    defun("substring", [](const Object& obj,
                           std::optional<std::int64_t> start,
-                          std::optional<std::int64_t> end) {
-        if (start && *start < 0) {
-            *start = static_cast<std::int64_t>(str.size()) + *start;
+                          std::optional<std::int64_t> end) -> ObjectPtr {
+        const auto str = dynamic_cast<const StringObject*>(&obj);
+        if (!str) {
+            throw exceptions::WrongTypeArgument(obj.toString());
         }
-        if (end && *end < 0) {
-            *end = static_cast<std::int64_t>(str.size()) + *end;
+        if (!start) {
+            return obj.clone();
         }
-        return !start ? str : (!end ? str.substr(*start) : str.substr(*start, *end - *start));
+        const auto length = static_cast<std::int64_t>(str->length());
+        std::int64_t from = *start < 0 ? length + *start : *start;
+        std::int64_t to = !end ? length : *end < 0 ? length + *end : *end;
+        if (from < 0 || from > length || to < from || to > length) {
+            throw exceptions::ArgsOutOfRange(obj.toString() + " " + std::to_string(*start));
+        }
+        return str->substring(from, to);
     });
+
     defun("string", [](Rest& rest) {
         std::string ret;
         while (rest.hasNext()) {
@@ -174,10 +230,19 @@ void Machine::initStringFunctions()
         }
         return ret;
     });
-    defun("store-substring", [this](String sobj,
-                                    std::int64_t idx,
-                                    std::variant<std::string, std::uint32_t> obj)
-    {
+    // The string is modified in place, so these take the object itself rather than a copy.
+    auto mutableString = [](Object* obj) {
+        const auto str = dynamic_cast<StringObject*>(obj);
+        if (!str) {
+            throw exceptions::WrongTypeArgument(obj->toString());
+        }
+        return str->mutableString();
+    };
+    makeFunc("store-substring", 3, 3, [this, mutableString](FArgs& args) -> ObjectPtr {
+        Object* const target = args.pop();
+        String sobj = mutableString(target);
+        const auto idx = getFuncParam<std::int64_t>(args);
+        const auto obj = getFuncParam<std::variant<std::string, std::uint32_t>>(args);
         auto& str = *sobj.sharedPointer();
         std::string s;
         try {
@@ -193,66 +258,256 @@ void Machine::initStringFunctions()
         for (size_t i = 0; i < s.length(); i++) {
             str[idx+i] = s[i];
         }
-        return StringObject(sobj);
+        sobj.contentsChanged();
+        return target->clone();
     });
-    defun("clear-string", [](std::string& str) { for (auto& c : str) { c = 0; } });
-    defun("split-string", [this](std::string s,
-                                 std::optional<std::string> sep,
-                                 std::optional<bool> omitNulls) -> ObjectPtr {
-        ListBuilder builder(*this);
-        std::smatch m;
-        std::regex e(sep ? *sep : "[ \\n\\t\\r\\v]+");
-
-        if (sep && !omitNulls) {
-            omitNulls = false;
+    makeFunc("clear-string", 1, 1, [this, mutableString](FArgs& args) {
+        const String str = mutableString(args.pop());
+        for (auto& c : *str.sharedPointer()) { c = 0; }
+        str.contentsChanged();
+        return makeNil();
+    });
+    setVariable(parsedSymbolName("case-fold-search"), makeTrue());
+    auto compileRegexp = [this](const std::string& pattern) {
+        const auto caseFold = getSymbolOrNull(parsedSymbolName("case-fold-search"));
+        return m_regexCache.get(pattern, caseFold && caseFold->variable &&
+                                !caseFold->variable->isNil());
+    };
+    auto setMatchData = [this](const String& str, const std::vector<size_t>& groups) {
+        m_matchData.clear();
+        for (const size_t offset : groups) {
+            m_matchData.push_back(offset == std::string::npos ? -1 :
+                                  utf8::countChars(str.c_str(), offset));
         }
-
-        auto addMatch = [&](std::string m) {
-            if (!omitNulls || *omitNulls) {
-                if (m.empty()) {
-                    return;
-                }
+        m_matchString = str;
+        m_matchBuffer = nullptr;
+    };
+    auto startOffset = [](const String& str, std::optional<std::int64_t> start) {
+        const auto length = static_cast<std::int64_t>(str.size());
+        std::int64_t index = start ? *start : 0;
+        if (index < 0) {
+            index += length;
+        }
+        if (index < 0 || index > length) {
+            throw exceptions::ArgsOutOfRange(std::to_string(*start));
+        }
+        return str.mapToUnderlying(index);
+    };
+    defun("split-string", [this, compileRegexp](const std::string& s,
+                                                std::optional<std::string> separators,
+                                                std::optional<bool> omitNulls) -> ObjectPtr {
+        // Follows split-string of Emacs: after an empty match the next search starts one
+        // character further so that the same empty match is not found again.
+        const bool keepNulls = separators && !(omitNulls && *omitNulls);
+        const auto regex = compileRegexp(separators ? *separators : "[ \f\t\n\r\v]+");
+        ListBuilder builder(*this);
+        auto push = [&](size_t from, size_t to) {
+            if (keepNulls || to > from) {
+                builder.append(std::make_unique<StringObject>(s.substr(from, to - from)));
             }
-            builder.append(std::make_unique<StringObject>(std::move(m)));
         };
-        std::regex_iterator<std::string::iterator> rit(s.begin(), s.end(), e);
-        std::regex_iterator<std::string::iterator> rend;
-        size_t from = 0;
-        bool lastWasEmpty = false;
-        while (rit != rend) {
-            auto m = s.substr(from, rit->position() - from);
-            addMatch(m);
-            from = rit->position() + rit->length();
-            lastWasEmpty = rit->position() == s.length() && m.empty();
-            ++rit;
-        }
-        if (!lastWasEmpty) {
-            addMatch(s.substr(from));
+        std::vector<size_t> groups;
+        size_t start = 0;
+        for (bool first = true;; first = false) {
+            size_t from = start;
+            if (!first && start == groups[0] && start < s.size()) {
+                from += std::max<size_t>(1, utf8::next(s.c_str() + start));
+            }
+            if (!regex->search(s, from, groups) || start >= s.size()) {
+                break;
+            }
+            push(start, groups[0]);
+            start = groups[1];
         }
+        push(start, s.size());
         return builder.get();
     });
+    defun("string-match", [this, compileRegexp, setMatchData, startOffset](
+              const std::string& regexp,
+              String str,
+              std::optional<std::int64_t> start) -> ObjectPtr {
+        std::vector<size_t> groups;
+        if (!compileRegexp(regexp)->search(str.toStdString(), startOffset(str, start), groups)) {
+            return makeNil();
+        }
+        setMatchData(str, groups);
+        return makeInt(m_matchData[0]);
+    });
+    auto matchPosition = [this](std::int64_t group, size_t end) -> ObjectPtr {
+        if (group < 0) {
+            throw exceptions::ArgsOutOfRange(std::to_string(group));
+        }
+        const size_t i = static_cast<size_t>(group) * 2 + end;
+        if (i >= m_matchData.size() || m_matchData[i] < 0) {
+            return makeNil();
+        }
+        return makeInt(m_matchData[i]);
+    };
+    defun("match-beginning", [matchPosition](std::int64_t group) { return matchPosition(group, 0); });
+    defun("match-end", [matchPosition](std::int64_t group) { return matchPosition(group, 1); });
+    defun("match-string", [this](std::int64_t group, std::optional<String> str) -> ObjectPtr {
+        const size_t i = static_cast<size_t>(group) * 2;
+        if (group < 0 || i + 1 >= m_matchData.size() || m_matchData[i] < 0) {
+            return makeNil();
+        }
+        if (!str && m_matchBuffer) {
+            return makeObject(m_matchBuffer->substring(m_matchData[i], m_matchData[i + 1]));
+        }
+        if (!str && !m_matchString) {
+            return makeNil();
+        }
+        const String& from = str ? *str : *m_matchString;
+        return makeObject(from.substr(m_matchData[i], m_matchData[i + 1] - m_matchData[i]));
+    });
+    defun("string-search", [this](const std::string& needle,
+                                  String haystack,
+                                  std::optional<std::int64_t> start) -> ObjectPtr {
+        if (start && (*start < 0 || *start > static_cast<std::int64_t>(haystack.size()))) {
+            throw exceptions::ArgsOutOfRange(std::to_string(*start));
+        }
+        const size_t from = start ? haystack.mapToUnderlying(*start) : 0;
+        const size_t found = haystack.toStdString().find(needle, from);
+        if (found == std::string::npos) {
+            return makeNil();
+        }
+        return makeInt(utf8::countChars(haystack.c_str(), found));
+    });
+    defun("replace-regexp-in-string", [this, compileRegexp, setMatchData, startOffset](
+              const std::string& regexp,
+              const Object& rep,
+              String str,
+              std::optional<bool> /* fixedCase */,
+              std::optional<bool> literal,
+              std::optional<std::int64_t> subexp,
+              std::optional<std::int64_t> start) {
+        // The case of the replacement is never adjusted, as if fixedCase was always given.
+        const auto regex = compileRegexp(regexp);
+        const std::string& s = str.toStdString();
+        const size_t group = subexp ? static_cast<size_t>(*subexp) : 0;
+        if (group >= regex->groupCount()) {
+            throw exceptions::ArgsOutOfRange(std::to_string(group));
+        }
+        std::string result;
+        std::vector<size_t> groups;
+        size_t pos = startOffset(str, start);
+        size_t lastEnd = std::string::npos;
+        // An empty match is tried at the end of the string too, but not right after another
+        // match, and each one is stepped past by a character.
+        auto step = [&]() {
+            const size_t length = std::max<size_t>(1, utf8::next(s.c_str() + pos));
+            result.append(s, pos, length);
+            pos += length;
+        };
+        while (pos <= s.size() && regex->search(s, pos, groups)) {
+            const size_t matchStart = groups[0];
+            const size_t matchEnd = groups[1];
+            if (matchStart == matchEnd && matchStart == lastEnd) {
+                result.append(s, pos, matchStart - pos);
+                pos = matchStart;
+                if (pos == s.size()) {
+                    break;
+                }
+                step();
+                continue;
+            }
+            result.append(s, pos, matchStart - pos);
+            std::string replacement;
+            if (rep.isString()) {
+                replacement = rep.value<std::string>();
+            }
+            else {
+                // The function sees the match data of the matched text alone, as in Emacs.
+                const String matched(s.substr(matchStart, matchEnd - matchStart));
+                std::vector<size_t> relative;
+                for (const size_t offset : groups) {
+                    relative.push_back(offset == std::string::npos ? offset : offset - matchStart);
+                }
+                setMatchData(matched, relative);
+                replacement = callReplacementFunction(rep, matched);
+            }
+            if (!literal || !*literal) {
+                replacement = expandReplacement(replacement, s, groups);
+            }
+            if (groups[group * 2] == std::string::npos) {
+                throw exceptions::Error("replace-match subexpression does not exist");
+            }
+            result.append(s, matchStart, groups[group * 2] - matchStart);
+            result += replacement;
+            result.append(s, groups[group * 2 + 1], matchEnd - groups[group * 2 + 1]);
+            pos = lastEnd = matchEnd;
+            if (matchStart == matchEnd) {
+                if (pos == s.size()) {
+                    break;
+                }
+                step();
+            }
+        }
+        if (pos < s.size()) {
+            result.append(s, pos, std::string::npos);
+        }
+        return result;
+    });
     defun("char-equal", [](std::uint32_t c1, std::uint32_t c2) { return c1 == c2; });
-    defun("string=", [](const std::string& a, const std::string& b) { return a == b; });
-    defun("string-equal", [](const std::string& a, const std::string& b) { return a == b; });
+    // Strings which share their text, like literals which read the same, compare without
+    // looking at the text.
+    defun("string=", [](const std::string& a, const std::string& b) { return &a == &b || a == b; });
+    defun("string-equal", [](const std::string& a, const std::string& b) {
+        return &a == &b || a == b;
+    });
     defun("string<", [](const std::string& a, const std::string& b) { return a < b; });
     defun("string-lessp", [](const std::string& a, const std::string& b) { return a < b; });
     defun("string-greaterp", [](const std::string& a, const std::string& b) { return a > b; });
-    defun("number-to-string", [](std::variant<std::int64_t, std::uint32_t, double> num) {
-        try {
-            const std::uint32_t val = std::get<std::uint32_t>(num);
-            return std::to_string(val);
-        }
-        catch (std::bad_variant_access&) {}
-        try {
-            const std::int64_t val = std::get<std::int64_t>(num);
-            return std::to_string(val);
+    defun("number-to-string", [](const Object& num) {
+        if (!num.isInt() && !num.isFloat()) {
+            throw exceptions::WrongTypeArgument(num.toString());
         }
-        catch (std::bad_variant_access&) {}
-        const double val = std::get<double>(num);
-        return std::to_string(val);
+        return num.toString();
     });
+
     defun("char-to-string", [](std::uint32_t c1) { return utf8::encode(c1); });
-    defun("string-to-number", [](std::string str) -> ObjectPtr {
+    // Characters have the simple case mappings and strings the full ones, so that like in Emacs
+    // (upcase ?ß) is ?ß but (upcase "ß") is "SS".
+    auto changeCase = [this](const Object& obj, unicode::Case to, bool initialsOnly) -> ObjectPtr {
+        if (obj.isCharacter()) {
+            const auto c = obj.value<std::uint32_t>();
+            return makeInt(to == unicode::Case::Upper ? unicode::toUpper(c) :
+                           to == unicode::Case::Lower ? unicode::toLower(c) : unicode::toTitle(c));
+        }
+        if (!obj.isString()) {
+            throw exceptions::WrongTypeArgument(obj.toString());
+        }
+        return std::make_unique<StringObject>(
+            unicode::convertCase(obj.value<const std::string&>(), to, initialsOnly));
+    };
+    defun("upcase", [changeCase](const Object& obj) {
+        return changeCase(obj, unicode::Case::Upper, false);
+    });
+    defun("downcase", [changeCase](const Object& obj) {
+        return changeCase(obj, unicode::Case::Lower, false);
+    });
+    defun("capitalize", [changeCase](const Object& obj) {
+        return changeCase(obj, unicode::Case::Title, false);
+    });
+    defun("upcase-initials", [changeCase](const Object& obj) {
+        return changeCase(obj, unicode::Case::Title, true);
+    });
+    defun("char-uppercase-p", [](std::uint32_t c) { return unicode::isUpper(c); });
+    defun("get-char-code-property", [this](std::uint32_t c, const Symbol& prop) -> ObjectPtr {
+        if (prop.name == parsedSymbolName("general-category")) {
+            return makeSymbol(unicode::categoryName(c), true);
+        }
+        if (prop.name == parsedSymbolName("uppercase")) {
+            return makeInt(unicode::toUpper(c));
+        }
+        if (prop.name == parsedSymbolName("lowercase")) {
+            return makeInt(unicode::toLower(c));
+        }
+        if (prop.name == parsedSymbolName("titlecase")) {
+            return makeInt(unicode::toTitle(c));
+        }
+        return makeNil();
+    });
+    defun("string-to-number", [this](std::string str) -> ObjectPtr {
         std::stringstream ss(str);
         if (str.find("e") == std::string::npos && str.find(".") == std::string::npos) {
             std::int64_t i;
@@ -278,12 +533,17 @@ void Machine::initStringFunctions()
         std::getline(*stream, str);
         return str;
     });
-    defun("message", [this](String str, Rest& args) {
-        str = format(str, args);
+    auto format = [this](const std::string& formatString, Rest& args) {
+        return m_formatCache.get(formatString, [&]() {
+            return std::make_shared<const FormatString>(formatString);
+        })->format(args);
+    };
+    defun("message", [format](const std::string& formatString, Rest& args) {
+        const std::string str = format(formatString, args);
         std::cout << str << std::endl;
         return str;
     });
-    defun("format", [](String formatString, Rest& args) {
+    defun("format", [format](const std::string& formatString, Rest& args) {
         return format(formatString, args);
     });
 
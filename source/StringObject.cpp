@@ -4,6 +4,8 @@
 #include "SharedValueObject.hpp"
 #include "StringObject.hpp"
 #include "ValueObject.hpp"
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include "Error.hpp"
 #include "UTF8.hpp"
@@ -11,61 +13,157 @@
 namespace alisp {
 
 ALISP_INLINE StringObject::StringObject(std::string value) :
-    SharedValueObject<std::string>(std::make_shared<std::string>(std::move(value)))
+    SharedValueObject<StringBody>(std::make_shared<StringBody>())
 {
-
+    this->value->own = std::move(value);
 }
 
 ALISP_INLINE StringObject::StringObject(const StringObject& o) :
-    SharedValueObject<std::string>(o.value)
+    SharedValueObject<StringBody>(o.value),
+    rope(o.rope)
 {
 
 }
 
 ALISP_INLINE StringObject::StringObject(const String& o) :
-    SharedValueObject<std::string>(o.sharedPointer())
+    SharedValueObject<StringBody>(std::make_shared<StringBody>())
+{
+    value->shared = o.sharedPointer();
+}
+
+ALISP_INLINE StringObject::StringObject(Rope rope) :
+    SharedValueObject<StringBody>(std::make_shared<StringBody>()),
+    rope(std::move(rope))
+{
+
+}
+
+ALISP_INLINE const std::string& StringObject::flat() const
+{
+    // The copies of this object share the body, so they all see the flattened text.
+    if (!isFlat()) {
+        value->own.reserve(rope.bytes());
+        rope.appendTo(value->own);
+    }
+    return value->text();
+}
+
+ALISP_INLINE Rope StringObject::toRope() const
 {
+    return isFlat() ? Rope(value->text()) : rope;
+}
 
+ALISP_INLINE void StringObject::appendTo(std::string& out) const
+{
+    if (isFlat()) {
+        out += value->text();
+    }
+    else {
+        rope.appendTo(out);
+    }
+}
+
+ALISP_INLINE ObjectPtr StringObject::substring(size_t from, size_t to) const
+{
+    if (isFlat()) {
+        return std::make_unique<StringObject>(convertTo(ConvertibleTo<String>::Tag())
+                                              .substr(from, to - from));
+    }
+    const Rope slice = rope.substr(from, to);
+    if (slice.bytes() < Rope::MinBytes) {
+        return std::make_unique<StringObject>(slice.toString());
+    }
+    return std::make_unique<StringObject>(slice);
+}
+
+ALISP_INLINE bool StringObject::eq(const Object& obj) const
+{
+    const StringObject* o = dynamic_cast<const StringObject*>(&obj);
+    return o && value == o->value;
 }
 
 ALISP_INLINE bool StringObject::equal(const Object& obj) const
 {
-    return eq(obj) || (obj.isString() && *value == obj.value<const std::string&>());
+    return eq(obj) || (obj.isString() && flat() == obj.value<const std::string&>());
+}
+
+ALISP_INLINE String StringObject::mutableString()
+{
+    flat();
+    if (value->shared) {
+        // Text nobody else refers to anymore need not be copied.
+        if (value->shared.use_count() == 1) {
+            value->own = std::move(*value->shared);
+        }
+        else {
+            value->own = *value->shared;
+        }
+        value->shared.reset();
+    }
+    return String(std::shared_ptr<std::string>(value, &value->own),
+                  std::shared_ptr<StringIndex>(value, &value->index));
+}
+
+ALISP_INLINE String StringObject::convertTo(ConvertibleTo<String>::Tag) const
+{
+    flat();
+    return String(value->shared ? value->shared : std::shared_ptr<std::string>(value, &value->own),
+                  std::shared_ptr<StringIndex>(value, &value->index));
+}
+
+ALISP_INLINE std::string& StringObject::convertTo(ConvertibleTo<std::string&>::Tag) const
+{
+    // Whoever asks for the text itself may modify it.
+    const String str = const_cast<StringObject*>(this)->mutableString();
+    str.contentsChanged();
+    return value->own;
 }
 
 ALISP_INLINE
 size_t StringObject::length() const
 {
-    return value ? utf8::strlen(value->c_str()) : 0;
+    if (!isFlat()) {
+        return rope.chars();
+    }
+    return convertTo(ConvertibleTo<String>::Tag()).size();
 }
 
 ALISP_INLINE ObjectPtr StringObject::copy() const
 {
-    return std::make_unique<StringObject>(*value);
+    return std::make_unique<StringObject>(flat());
 }
 
 ALISP_INLINE ObjectPtr StringObject::reverse() const
 {
-    std::string reversed;
-    for (const std::uint32_t codepoint : String(value)) {
-        reversed = utf8::encode(codepoint) + reversed;
+    // Characters are copied as they are from the front of the string to the back of the
+    // result, which keeps this linear.
+    const std::string& str = flat();
+    std::string reversed(str.size(), '\0');
+    size_t end = str.size();
+    for (size_t offset = 0; offset < str.size();) {
+        const size_t length = std::min(std::max<size_t>(1, utf8::next(str.c_str() + offset)),
+                                       str.size() - offset);
+        end -= length;
+        std::memcpy(&reversed[end], str.data() + offset, length);
+        offset += length;
     }
-    return std::make_unique<StringObject>(reversed);
+    return std::make_unique<StringObject>(std::move(reversed));
 }
 
 ALISP_INLINE std::unique_ptr<Object> StringObject::elt(std::int64_t index) const
 {
-    std::uint32_t encoded;
-    size_t offset = 0;
-    const char* start = value->c_str();
-    for (std::int64_t i = 0; i <= index; i++) {
-        if (offset >= value->size()) {
+    if (!isFlat()) {
+        if (index < 0 || static_cast<size_t>(index) >= rope.chars()) {
             throw std::runtime_error("Index out of range");
         }
-        const size_t proceed = utf8::next(start + offset, &encoded);
-        offset += proceed;
+        return makeInt(rope.at(static_cast<size_t>(index)));
+    }
+    try {
+        return makeInt(convertTo(ConvertibleTo<String>::Tag())[static_cast<size_t>(index)]);
+    }
+    catch (std::runtime_error&) {
+        throw std::runtime_error("Index out of range");
     }
-    return makeInt(utf8::decode(encoded));
 }
 
 ListPtr StringObject::mapCar(const Function& func) const
@@ -75,7 +173,7 @@ ListPtr StringObject::mapCar(const Function& func) const
     IntObject* ptr = integer.get();
     ConsCell cc;
     cc.car = std::move(integer);
-    for (const std::uint32_t codepoint : String(value)) {
+    for (const std::uint32_t codepoint : convertTo(ConvertibleTo<String>::Tag())) {
         ptr->value = codepoint;
         FArgs args(cc, func.parent);
         builder.append(func.func(args));
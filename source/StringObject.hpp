@@ -3,25 +3,78 @@
 #include "Sequence.hpp"
 #include "SharedValueObject.hpp"
 #include "String.hpp"
+#include "Rope.hpp"
 
 namespace alisp
 {
 
+// What the copies of a string object share, which makes them the same string as far as eq is
+// concerned and lets them all see it being modified. Equal literals read from code keep their
+// text in the string table and point to it from here; the text is copied into the body before
+// it is modified, unless nothing else refers to it anymore.
+struct StringBody
+{
+    std::string own;                     // The text, unless it is shared
+    std::shared_ptr<std::string> shared; // Text shared with other strings, or null
+    StringIndex index;
+
+    const std::string& text() const { return shared ? *shared : own; }
+};
+
 struct StringObject :
-        SharedValueObject<std::string>,
+        SharedValueObject<StringBody>,
         Sequence,
-        ConvertibleTo<String>
+        ConvertibleTo<String>,
+        ConvertibleTo<std::string>,
+        ConvertibleTo<std::string&>,
+        ConvertibleTo<const std::string&>
 {
+    // Long strings made by joining or slicing others are kept as ropes. The text is then
+    // flattened into the body, which starts out empty, only when something needs it in one
+    // piece. A rope is never empty, so an empty body means the text has not been flattened.
+    Rope rope;
+
     StringObject(std::string value);
     StringObject(const StringObject& o);
     StringObject(const String& o);
+    StringObject(Rope rope);
+
+    bool isFlat() const { return !rope || !value->text().empty(); }
+    const std::string& flat() const;
+
+    // Returns the text as a rope, which for a flat string means copying it into one.
+    Rope toRope() const;
+    void appendTo(std::string& out) const;
+    size_t bytes() const { return isFlat() ? value->text().size() : rope.bytes(); }
+
+    // Characters from position from up to but not including position to.
+    ObjectPtr substring(size_t from, size_t to) const;
 
     std::string toString(bool aesthetic = false) const override
     {
-        return aesthetic ? *value : ("\"" + *value + "\"");
+        if (aesthetic) {
+            return isFlat() ? value->text() : rope.toString();
+        }
+        // Printed to be read back: backslashes and quotes are escaped.
+        std::string text;
+        text.reserve(bytes());
+        appendTo(text);
+        std::string ret;
+        ret.reserve(text.size() + 2);
+        ret += '"';
+        for (const char c : text) {
+            if (c == '"' || c == '\\') {
+                ret += '\\';
+            }
+            ret += c;
+        }
+        ret += '"';
+        return ret;
     }
 
     bool isString() const override { return true; }
+    Object* tryEvalBorrowed() override { return this; }
+    bool eq(const Object& obj) const override;
     bool equal(const Object& obj) const override;
     std::string typeOf() const override { return "string"; }
 
@@ -34,10 +87,20 @@ struct StringObject :
     ObjectPtr reverse() const override;
     std::unique_ptr<ConsCellObject> mapCar(const Function& func) const override;
 
+    // Returns the string for modifying it in place. Text shared with other strings is copied
+    // first, so that those are left as they are.
+    String mutableString();
+
     size_t length() const override;
     std::unique_ptr<Object> elt(std::int64_t index) const override;
 
-    String convertTo(ConvertibleTo<String>::Tag) const override { return String(value); }
+    String convertTo(ConvertibleTo<String>::Tag) const override;
+    std::string convertTo(ConvertibleTo<std::string>::Tag) const override { return flat(); }
+    std::string& convertTo(ConvertibleTo<std::string&>::Tag) const override;
+    const std::string& convertTo(ConvertibleTo<const std::string&>::Tag) const override
+    {
+        return flat();
+    }
 };
 
 }
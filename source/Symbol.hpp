@@ -1,6 +1,8 @@
 #pragma once
+#include <cstdint>
 #include <memory>
 #include <string>
+#include "ObjectPtr.hpp"
 
 namespace alisp
 {
@@ -11,19 +13,41 @@ struct ConsCell;
 struct ConsCellObject;
 class Machine;
 
-struct Symbol
+// Control forms which the evaluator handles itself instead of calling their functions.
+enum class SpecialForm : std::uint8_t
+{
+    None,
+    If,
+    Let,
+    LetStar,
+    While,
+    Cond,
+    And,
+    Or,
+    Progn,
+    Prog1
+};
+
+struct Symbol : std::enable_shared_from_this<Symbol>
 {
     Machine* parent;
     bool constant = false;
-    bool local = false;
+    SpecialForm special = SpecialForm::None; // Until the function is redefined
     std::string name;
     std::string description;
     std::unique_ptr<Object> variable;
     std::unique_ptr<ConsCellObject> plist;
     std::unique_ptr<Object> function;
+    std::shared_ptr<Function> resolved; // Of the function cell, made when first called
 
     Symbol(Machine& parent);
     ~Symbol();
+
+    // Replaces the function cell, which also stops the symbol from being a special form.
+    void setFunction(std::unique_ptr<Object> definition);
+
+    // Resolving a lambda makes a new Function, so the one of the function cell is kept.
+    const std::shared_ptr<Function>& resolvedFunction();
 };
 
 Object* get(const ConsCell& plist, const Object& property);
@@ -9,8 +9,32 @@
 namespace alisp
 {
 
-ALISP_INLINE Symbol::Symbol(Machine& parent) : parent(&parent) {}
-ALISP_INLINE Symbol::~Symbol() {}
+ALISP_INLINE Symbol::Symbol(Machine& parent) : parent(&parent)
+{
+    memoryStats().created(MemoryKind::Symbol);
+    memoryStats().allocated(MemoryKind::Symbol, sizeof(Symbol));
+}
+
+ALISP_INLINE Symbol::~Symbol()
+{
+    memoryStats().destroyed(MemoryKind::Symbol);
+    memoryStats().freed(MemoryKind::Symbol, sizeof(Symbol));
+}
+
+ALISP_INLINE void Symbol::setFunction(std::unique_ptr<Object> definition)
+{
+    function = std::move(definition);
+    resolved = nullptr;
+    special = SpecialForm::None;
+}
+
+ALISP_INLINE const std::shared_ptr<Function>& Symbol::resolvedFunction()
+{
+    if (!resolved) {
+        resolved = function->resolveFunction();
+    }
+    return resolved;
+}
 
 ALISP_STATIC ConsCellObject* getPlist(Symbol& symbol)
 {
@@ -55,7 +79,7 @@ ALISP_INLINE void Machine::initSymbolFunctions()
         return std::make_unique<SymbolObject>(this, symbol, "");
     });
     defun("symbol-plist", [&](Symbol& symbol) { return getPlist(symbol)->clone(); });
-    defun("symbol-name", [](const Symbol& sym) { return sym.name; });
+    defun("symbol-name", [this](const Symbol& sym) { return m_strings.intern(sym.name); });
     defun("symbolp", [](const Object& obj) { return obj.isSymbol(); });
     defun("put", [&](Symbol& symbol, const Object& property, const Object& value) {
         auto plist = getPlist(symbol);
@@ -77,7 +101,7 @@ ALISP_INLINE void Machine::initSymbolFunctions()
                 }
                 cc = cc->next();
                 if (!cc->next()) {
-                    cc->cdr = makeConsCell(property.clone(), makeConsCell(value.clone()));
+                    cc->setCdr(makeConsCell(property.clone(), makeConsCell(value.clone())));
                 }
             }
         }
@@ -89,6 +113,9 @@ ALISP_INLINE void Machine::initSymbolFunctions()
     defun("unintern", [this](const Symbol& sym) {
         const bool uninterned =
             m_syms.count(sym.name) && m_syms[sym.name].get() == &sym && m_syms.erase(sym.name);
+        if (uninterned) {
+            symbolTableChanged();
+        }
         return uninterned;
     });
     defun("intern-soft", [this](const std::string& name) {
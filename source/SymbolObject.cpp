@@ -24,6 +24,19 @@ ALISP_INLINE void SymbolObject::traverse(const std::function<bool(const Object&)
     }
 }
 
+ALISP_INLINE void SymbolObject::visitShared(const SharedRefVisitor& f) const
+{
+    if (!sym || !f(SharedRef{sym.get(), size_t(sym.use_count()), nullptr, sym.get()})) {
+        return;
+    }
+    if (sym->variable) {
+        alisp::visitShared(*sym->variable, f);
+    }
+    if (sym->plist) {
+        alisp::visitShared(*sym->plist, f);
+    }
+}
+
 ALISP_INLINE bool SymbolObject::eq(const Object& o) const
 {
     const SymbolObject* op = dynamic_cast<const SymbolObject*>(&o);
@@ -35,28 +48,29 @@ ALISP_INLINE bool SymbolObject::eq(const Object& o) const
     return lhs == rhs;
 }
 
-ALISP_INLINE std::unique_ptr<Object> SymbolObject::eval() 
+ALISP_INLINE Object* SymbolObject::tryEvalBorrowed()
 {
-    const auto var = sym ? sym->variable.get() : parent->getSymbol(name)->variable.get();
+    // Keywords are made when first used, with themselves as their value.
+    const Symbol* s = getSymbolOrNull();
+    const auto var = s ? s->variable.get() : getSymbol()->variable.get();
     if (!var) {
         throw exceptions::VoidVariable(toString());
     }
-    return var->clone();
+    return var;
+}
+
+ALISP_INLINE std::unique_ptr<Object> SymbolObject::eval() 
+{
+    return tryEvalBorrowed()->clone();
 }
 
 ALISP_INLINE std::shared_ptr<Function> SymbolObject::resolveFunction() const
 {
-    if (sym) {
-        return sym->function->resolveFunction();
-    }
-    auto sym = parent->getSymbol(name);
-    if (sym && !sym->function && sym->local) {
-        sym = parent->getSymbol(name, true);
-    }
-    if (!sym->function) {
+    Symbol* s = getSymbolOrNull();
+    if (!s || !s->function) {
         throw exceptions::VoidFunction(toString());
     }
-    return sym->function->resolveFunction();
+    return s->resolvedFunction();
 }
 
 ALISP_INLINE std::string SymbolObject::toString(bool aesthetic) const
@@ -72,7 +86,15 @@ ALISP_INLINE std::string SymbolObject::toString(bool aesthetic) const
 
 ALISP_INLINE Symbol* SymbolObject::getSymbolOrNull() const
 {
-    return sym ? sym.get() : parent->getSymbolOrNull(name).get();
+    if (sym) {
+        return sym.get();
+    }
+    if (cachedSymbol && cachedVersion == parent->symbolTableVersion()) {
+        return cachedSymbol;
+    }
+    cachedSymbol = parent->getSymbolOrNull(name).get();
+    cachedVersion = parent->symbolTableVersion();
+    return cachedSymbol;
 }
 
 ALISP_INLINE std::shared_ptr<Symbol> SymbolObject::getSymbol() const
@@ -16,6 +16,10 @@ struct SymbolObject :
     std::string name;
     Machine* parent;
 
+    // The symbol of the name, once looked up, and Machine::symbolTableVersion() at the time.
+    mutable Symbol* cachedSymbol = nullptr;
+    mutable std::uint32_t cachedVersion = 0;
+
     SymbolObject(Machine* parent,
                  std::shared_ptr<Symbol> sym = nullptr,
                  std::string name = "") :
@@ -37,21 +41,27 @@ struct SymbolObject :
     };
 
     std::shared_ptr<Symbol> getSymbol() const;
+
+    // Like getSymbol(), but without making a symbol. Variable references and calls find their
+    // symbol through this, so only the first time looks the name up.
     Symbol* getSymbolOrNull() const;
     
     std::shared_ptr<Function> resolveFunction() const override;
 
-    void reset() override { sym.reset(); }
     bool isSymbol() const override { return true; }
     std::string toString(bool aesthetic = false) const override;
     std::string typeOf() const override { return "symbol"; }
 
     std::unique_ptr<Object> clone() const override
     {
+        if (isShared()) {
+            return ObjectPtr(const_cast<SymbolObject*>(this));
+        }
         return std::make_unique<SymbolObject>(parent, sym, name);
     }
 
     std::unique_ptr<Object> eval() override;
+    Object* tryEvalBorrowed() override;
 
     bool eq(const Object& o) const override;
 
@@ -61,6 +71,7 @@ struct SymbolObject :
     const void* sharedDataPointer() const override { return sym.get(); }
     size_t sharedDataRefCount() const override { return sym.use_count(); }
     void traverse(const std::function<bool(const Object&)>& f) const override;
+    void visitShared(const SharedRefVisitor& f) const override;
 
     const Symbol& convertTo(ConvertibleTo<const Symbol&>::Tag) const override
     {
@@ -1,8 +1,17 @@
 #pragma once
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <string>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ALISP_UTF8_SSE2
+#if defined(__GNUC__) || defined(__clang__)
+#include <immintrin.h>
+#define ALISP_UTF8_AVX2
+#endif
+#endif
 
 namespace alisp
 {
@@ -57,19 +66,219 @@ inline bool isValidCodepoint(std::int64_t i)
         && isValidCodepoint(static_cast<std::uint32_t>(i));
 }
 
+// Kernels which process a whole buffer at a time. SSE2 is always there on x86-64 and AVX2 is
+// used when the CPU running the program supports it. Other platforms get the scalar versions,
+// which still go through the buffer a machine word at a time where they can.
+namespace kernels {
+
+inline int popcount(std::uint32_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcount(x);
+#else
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    return (((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+#endif
+}
+
+inline int countTrailingZeros(std::uint32_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(x);
+#else
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+inline bool startsCharacter(char c) { return (c & 0xC0) != 0x80; }
+inline char toUpperAscii(char c) { return c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c; }
+
+inline size_t countCharsScalar(const char* s, size_t n)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += startsCharacter(s[i]);
+    }
+    return count;
+}
+
+inline size_t asciiPrefixScalar(const char* s, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, s + i, 8);
+        if (word & 0x8080808080808080ull) {
+            break;
+        }
+    }
+    while (i < n && !(s[i] & 0x80)) {
+        i++;
+    }
+    return i;
+}
+
+// Adds delta to the letters from first to first + 25, which changes the case of ASCII letters.
+inline void shiftLettersScalar(char* s, size_t n, char first, char delta)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] >= first && s[i] <= first + 25) {
+            s[i] += delta;
+        }
+    }
+}
+
+#ifdef ALISP_UTF8_SSE2
+
+// Continuation bytes are 0x80-0xBF, which as signed bytes are exactly the ones below -64.
+inline size_t countCharsSse2(const char* s, size_t n)
+{
+    const __m128i lastContinuation = _mm_set1_epi8(-65);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        count += popcount(_mm_movemask_epi8(_mm_cmpgt_epi8(v, lastContinuation)));
+    }
+    return count + countCharsScalar(s + i, n - i);
+}
+
+inline size_t asciiPrefixSse2(const char* s, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        if (const std::uint32_t mask = _mm_movemask_epi8(v)) {
+            return i + countTrailingZeros(mask);
+        }
+    }
+    return i + asciiPrefixScalar(s + i, n - i);
+}
+
+inline void shiftLettersSse2(char* s, size_t n, char first, char delta)
+{
+    const __m128i beforeFirst = _mm_set1_epi8(first - 1);
+    const __m128i afterLast = _mm_set1_epi8(first + 26);
+    const __m128i offset = _mm_set1_epi8(delta);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        const __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(v, beforeFirst),
+                                             _mm_cmplt_epi8(v, afterLast));
+        v = _mm_add_epi8(v, _mm_and_si128(letter, offset));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(s + i), v);
+    }
+    shiftLettersScalar(s + i, n - i, first, delta);
+}
+
+#endif
+
+#ifdef ALISP_UTF8_AVX2
+
+__attribute__((target("avx2"))) inline size_t countCharsAvx2(const char* s, size_t n)
+{
+    const __m256i lastContinuation = _mm256_set1_epi8(-65);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        count += popcount(_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, lastContinuation)));
+    }
+    return count + countCharsSse2(s + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline size_t asciiPrefixAvx2(const char* s, size_t n)
+{
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        if (const std::uint32_t mask = _mm256_movemask_epi8(v)) {
+            return i + countTrailingZeros(mask);
+        }
+    }
+    return i + asciiPrefixSse2(s + i, n - i);
+}
+
+__attribute__((target("avx2"))) inline void shiftLettersAvx2(char* s, size_t n, char first,
+                                                              char delta)
+{
+    const __m256i beforeFirst = _mm256_set1_epi8(first - 1);
+    const __m256i afterLast = _mm256_set1_epi8(first + 26);
+    const __m256i offset = _mm256_set1_epi8(delta);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        const __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(v, beforeFirst),
+                                                _mm256_cmpgt_epi8(afterLast, v));
+        v = _mm256_add_epi8(v, _mm256_and_si256(letter, offset));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(s + i), v);
+    }
+    shiftLettersSse2(s + i, n - i, first, delta);
+}
+
+#endif
+
+struct Table
+{
+    size_t (*countChars)(const char*, size_t);
+    size_t (*asciiPrefix)(const char*, size_t);
+    void (*shiftLetters)(char*, size_t, char, char);
+};
+
+inline Table select()
+{
+#ifdef ALISP_UTF8_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return Table{countCharsAvx2, asciiPrefixAvx2, shiftLettersAvx2};
+    }
+#endif
+#ifdef ALISP_UTF8_SSE2
+    return Table{countCharsSse2, asciiPrefixSse2, shiftLettersSse2};
+#else
+    return Table{countCharsScalar, asciiPrefixScalar, shiftLettersScalar};
+#endif
+}
+
+inline const Table& get()
+{
+    static const Table table = select();
+    return table;
+}
+
+}
+
+// Number of characters in the first n bytes. Bytes which can not continue a character are
+// counted as characters of their own.
+inline size_t countChars(const char* s, size_t n) { return kernels::get().countChars(s, n); }
+
+// Number of bytes before the first one which is not ASCII.
+inline size_t asciiPrefix(const char* s, size_t n) { return kernels::get().asciiPrefix(s, n); }
+
+// Change the case of the ASCII letters in the first n bytes, leaving all other bytes as they are.
+inline void toUpperAscii(char* s, size_t n) { kernels::get().shiftLetters(s, n, 'a', 'A' - 'a'); }
+inline void toLowerAscii(char* s, size_t n) { kernels::get().shiftLetters(s, n, 'A', 'a' - 'A'); }
+
 inline size_t next(const char *txt, std::uint32_t* ch = nullptr)
 {
+    if (!(*txt & 0x80)) {
+        if (ch) *ch = *txt;
+        return *txt ? 1 : 0;
+    }
     int len;
     std::uint32_t encoding = 0;
     len = u8length(txt);
     for (int i=0; i<len && txt[i] != '\0'; i++) {
         encoding = (encoding << 8) | (unsigned char)txt[i];
     }
-    errno = 0;
     if (len == 0 || !isValidCodepoint(encoding)) {
         encoding = txt[0];
         len = 1;
-        errno = EINVAL;
     }
     if (ch) *ch = encoding;
     return encoding ? len : 0 ;
@@ -77,12 +286,7 @@ inline size_t next(const char *txt, std::uint32_t* ch = nullptr)
 
 inline size_t strlen(const char *s)
 {
-    int len=0;
-    while (*s) {
-        if ((*s & 0xC0) != 0x80) len++;
-        s++;
-    }
-    return len;
+    return countChars(s, std::strlen(s));
 }
 
 inline std::string encode(std::uint32_t codepoint)
@@ -123,21 +327,10 @@ inline std::uint32_t decode(std::uint32_t c)
 
 inline std::string toUpper(const std::string& str)
 {
+    // Only ASCII letters have their case changed. The bytes of other characters are never in
+    // the ASCII range, so the whole string can be mapped byte by byte.
     std::string ret = str;
-    auto it = ret.c_str();
-    std::uint32_t enc;
-    size_t p = 0;
-    for (;;) {
-        const size_t proceed = next(it + p, &enc);
-        if (!proceed) {
-            break;
-        }
-        const std::uint32_t decoded = decode(enc);
-        if (decoded < 128) {
-            ret[p] = ::_toupper(decoded);
-        }
-        p += proceed;
-    }
+    toUpperAscii(&ret[0], std::strlen(ret.c_str()));
     return ret;
 }
 
@@ -0,0 +1,145 @@
+#pragma once
+#include "UTF8.hpp"
+#include "UnicodeTables.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace alisp
+{
+
+namespace unicode
+{
+
+inline const tables::Properties& properties(std::uint32_t c)
+{
+    if (c > utf8::MaxChar) {
+        return tables::properties[0];
+    }
+    const std::uint32_t block = tables::blocks[c >> tables::BlockShift];
+    const std::uint32_t offset = c & ((1u << tables::BlockShift) - 1);
+    return tables::properties[tables::entries[(block << tables::BlockShift) + offset]];
+}
+
+inline Category category(std::uint32_t c) { return properties(c).category; }
+inline const char* categoryName(std::uint32_t c) { return tables::categoryNames[category(c)]; }
+
+// Simple case mappings, which map a character to exactly one character.
+inline std::uint32_t toUpper(std::uint32_t c) { return c + properties(c).upper; }
+inline std::uint32_t toLower(std::uint32_t c) { return c + properties(c).lower; }
+inline std::uint32_t toTitle(std::uint32_t c) { return c + properties(c).title; }
+
+// Like in Emacs, a character is upper case if it has a lower case form, and the other way
+// round.
+inline bool isUpper(std::uint32_t c) { return toLower(c) != c; }
+inline bool isLower(std::uint32_t c) { return toUpper(c) != c || category(c) == Ll; }
+
+// Letters, and the marks and numbers which are used like them.
+inline bool isAlpha(std::uint32_t c)
+{
+    const Category cat = category(c);
+    return cat <= Me || cat == Nl;
+}
+
+inline bool isDecimal(std::uint32_t c) { return category(c) == Nd; }
+inline bool isAlnum(std::uint32_t c) { return isAlpha(c) || isDecimal(c); }
+inline bool isWord(std::uint32_t c) { return category(c) <= No; }
+inline bool isPunct(std::uint32_t c) { return category(c) >= Pc && category(c) <= So; }
+
+inline bool isSpace(std::uint32_t c)
+{
+    return (c >= '\t' && c <= '\r') || (category(c) >= Zs && category(c) <= Zp);
+}
+
+inline bool isGraphic(std::uint32_t c)
+{
+    const Category cat = category(c);
+    return !(cat >= Zs && cat <= Cc) && cat != Cs && cat != Cn;
+}
+
+inline bool isPrint(std::uint32_t c) { return isGraphic(c) || category(c) == Zs; }
+
+enum class Case
+{
+    Upper,
+    Lower,
+    Title
+};
+
+// Appends the full case mapping of a character, which for some is more than one character.
+inline void appendCase(std::string& out, std::uint32_t c, Case to)
+{
+    const tables::Properties& p = properties(c);
+    if (p.special >= 0) {
+        const tables::SpecialCasing& s = tables::specialCasing[p.special];
+        out += to == Case::Upper ? s.upper : to == Case::Lower ? s.lower : s.title;
+        return;
+    }
+    const std::uint32_t mapped = c + (to == Case::Upper ? p.upper :
+                                      to == Case::Lower ? p.lower : p.title);
+    if (mapped < 128) {
+        out += static_cast<char>(mapped);
+    }
+    else {
+        out += utf8::encode(mapped);
+    }
+}
+
+// Converts a whole string. Words are runs of letters, marks and numbers: with Case::Title the first
+// character of every word is converted to title case and the rest to lower case, or left as
+// they are if initialsOnly is set.
+inline std::string convertCase(const std::string& str, Case to, bool initialsOnly = false)
+{
+    std::string ret;
+    size_t i = 0;
+    if (to != Case::Title) {
+        // Any ASCII prefix is converted in place, a vector at a time.
+        i = utf8::asciiPrefix(str.data(), str.size());
+        ret.assign(str, 0, i);
+        if (to == Case::Upper) {
+            utf8::toUpperAscii(&ret[0], i);
+        }
+        else {
+            utf8::toLowerAscii(&ret[0], i);
+        }
+        if (i == str.size()) {
+            return ret;
+        }
+    }
+    ret.reserve(str.size() + str.size() / 8);
+    bool inWord = false;
+    while (i < str.size()) {
+        std::uint32_t enc;
+        const size_t len = std::max<size_t>(1, utf8::next(str.c_str() + i, &enc));
+        if (len == 1 && (str[i] & 0x80)) {
+            // Not UTF-8, copied as it is.
+            ret += str[i++];
+            inWord = false;
+            continue;
+        }
+        const std::uint32_t c = utf8::decode(enc);
+        const bool word = isWord(c);
+        if (to != Case::Title) {
+            appendCase(ret, c, to);
+        }
+        else if (word && !inWord) {
+            appendCase(ret, c, Case::Title);
+        }
+        else if (word && !initialsOnly) {
+            appendCase(ret, c, Case::Lower);
+        }
+        else {
+            ret.append(str, i, len);
+        }
+        inWord = word;
+        i += len;
+    }
+    return ret;
+}
+
+inline std::string upcase(const std::string& str) { return convertCase(str, Case::Upper); }
+inline std::string downcase(const std::string& str) { return convertCase(str, Case::Lower); }
+
+}
+
+}
@@ -1,10 +1,51 @@
 #include "alisp.hpp"
 #include "ValueObject.hpp"
 #include "UTF8.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
 
 namespace alisp
 {
 
+ALISP_INLINE std::string intToString(std::int64_t value)
+{
+    char buf[24];
+    return std::string(buf, std::to_chars(buf, buf + sizeof(buf), value).ptr);
+}
+
+ALISP_INLINE std::string floatToString(double value)
+{
+    if (std::isnan(value)) {
+        return std::signbit(value) ? "-0.0e+NaN" : "0.0e+NaN";
+    }
+    if (std::isinf(value)) {
+        return value < 0 ? "-1.0e+INF" : "1.0e+INF";
+    }
+
+    // The shortest round trip digits tell how many decimals are needed. Like %g, plain
+    // notation is used unless the exponent is very small or larger than the digits printed.
+    char buf[32];
+    char* end = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::scientific).ptr;
+    char* e = std::find(buf, end, 'e');
+    int exponent = 0;
+    std::from_chars(e[1] == '+' ? e + 2 : e + 1, end, exponent);
+    const int digits = static_cast<int>(std::count_if(buf, e, [](char c) {
+        return c >= '0' && c <= '9';
+    }));
+    if (exponent < -4 || exponent >= std::max(digits, 15)) {
+        return std::string(buf, end);
+    }
+    char fixed[48];
+    end = std::to_chars(fixed, fixed + sizeof(fixed), value, std::chars_format::fixed,
+                        std::max(0, digits - 1 - exponent)).ptr;
+    std::string ret(fixed, end);
+    if (ret.find('.') == std::string::npos) {
+        ret += ".0";
+    }
+    return ret;
+}
+
 ALISP_INLINE bool IntObject::isCharacter() const
 {
     return value >= 0 && value <= utf8::MaxChar;
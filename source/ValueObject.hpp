@@ -27,10 +27,15 @@ struct ValueObject : Object, ConvertibleTo<T>
         ss << std::fixed << value;
         return ss.str();
     }
-    Object* trySelfEvaluate() override { return this; }
+    Object* tryEvalBorrowed() override { return this; }
     T convertTo(typename ConvertibleTo<T>::Tag) const override { return value; }
 };
 
+// Integers and floats are printed without going through streams. A float is printed as the
+// shortest text which reads back to the same value, laid out like Emacs does.
+std::string intToString(std::int64_t value);
+std::string floatToString(double value);
+
 struct Number
 {
     std::int64_t i;
@@ -49,9 +54,13 @@ struct IntObject :
 {
     IntObject(std::int64_t value) : ValueObject<std::int64_t>(value) {}
     bool isInt() const override { return true; }
-    std::unique_ptr<Object> clone() const override { return std::make_unique<IntObject>(value); }
+    std::unique_ptr<Object> clone() const override
+    {
+        return isShared() ? ObjectPtr(const_cast<IntObject*>(this)) : ObjectPtr(std::make_unique<IntObject>(value));
+    }
     bool isCharacter() const override;
     std::string typeOf() const override { return "integer"; }
+    std::string toString(bool = false) const override { return intToString(value); }
 
     int convertTo(ConvertibleTo<int>::Tag) const override { return value; }
     std::uint32_t convertTo(ConvertibleTo<std::uint32_t>::Tag) const override { return value; }
@@ -68,6 +77,7 @@ struct FloatObject :
     bool isFloat() const override { return true; }
     std::unique_ptr<Object> clone() const override { return std::make_unique<FloatObject>(value); }
     std::string typeOf() const override { return "float"; }
+    std::string toString(bool = false) const override { return floatToString(value); }
     Number convertTo(ConvertibleTo<Number>::Tag) const override {
         return Number(value);
     }
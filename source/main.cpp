@@ -1,4 +1,3 @@
-#define ENABLE_DEBUG_REFCOUNTING
 #include <exception>
 #include <typeinfo>
 #include <chrono>
@@ -6,6 +5,7 @@
 #include "StreamObject.hpp"
 #include <variant>
 #include "UTF8.hpp"
+#include "Unicode.hpp"
 #include "alisp.hpp"
 #include <sstream>
 #include <fstream>
@@ -21,6 +21,8 @@
 #include <string>
 #include "ValueObject.hpp"
 #include "ConsCellObject.hpp"
+#include "StringObject.hpp"
+#include "Rope.hpp"
 
 using namespace alisp;
 
@@ -30,8 +32,8 @@ void ASSERT_EQ(std::string a, std::string b)
     oa = a;
     ob = b;
     if (ConvertParsedNamesToUpperCase) {
-        a = utf8::toUpper(a);
-        b = utf8::toUpper(b);
+        a = unicode::upcase(a);
+        b = unicode::upcase(b);
     }
 
     if (a == b) {
@@ -68,8 +70,8 @@ void ASSERT_OUTPUT_EQ(alisp::Machine& m, const char* expr, std::string res)
         oout = out;
         ores = res;
         if (ConvertParsedNamesToUpperCase) {
-            out = utf8::toUpper(out);
-            res = utf8::toUpper(res);
+            out = unicode::upcase(out);
+            res = unicode::upcase(res);
         }
         if (out != res) {
             std::cerr << "Expected '" << expr << "' to output '" << ores << "' but ";
@@ -86,8 +88,8 @@ void ASSERT_OUTPUT_CONTAINS(alisp::Machine& m, const char* expr, std::string res
 {
     std::string out = m.evaluate(expr)->toString();
     if (ConvertParsedNamesToUpperCase) {
-        out = utf8::toUpper(out);
-        res = utf8::toUpper(res);
+        out = unicode::upcase(out);
+        res = unicode::upcase(res);
     }
     if (out.find(res) == std::string::npos) {
         std::cerr << "Expected the output of '" << expr << "' to contain '" << res << "' but ";
@@ -233,7 +235,7 @@ void testListBasics()
     ASSERT_OUTPUT_EQ(m, "(proper-list-p '(a b . c))", "nil");
     ASSERT_OUTPUT_EQ(m, "(progn (setq x '(\"a\" \"b\")) (setq y (cons x x))"
                      "(eq (car (car y)) (car (cdr y))))", "t");
-    ASSERT_OUTPUT_CONTAINS(m, "(describe-variable 'y)", "((\"a\" \"b\") \"a\" \"b\")");
+    ASSERT_OUTPUT_CONTAINS(m, "(describe-variable 'y)", R"code(((\"a\" \"b\") \"a\" \"b\"))code");
     ASSERT_OUTPUT_EQ(m, "(length '(1 2 3 4))", "4");
     ASSERT_OUTPUT_EQ(m, "(length '(1))", "1");
     ASSERT_OUTPUT_EQ(m, "(length nil)", "0");
@@ -343,6 +345,21 @@ void testQuote()
                      "(1 2 3 4 2 3)");
     ASSERT_OUTPUT_EQ(m, "`(1 2 ,@() 3)", "(1 2 3)");
     ASSERT_OUTPUT_EQ(m, "`(1 2 ,() 3)", "(1 2 nil 3)");
+    ASSERT_OUTPUT_EQ(m, "`,(+ 1 2)", "3");
+    ASSERT_OUTPUT_EQ(m, "`(1 . ,(+ 1 1))", "(1 . 2)");
+    ASSERT_OUTPUT_EQ(m, "`(,@some-list . ,(+ 2 2))", "(2 3 . 4)");
+    ASSERT_OUTPUT_EQ(m, "`(,@() . ,(+ 2 2))", "4");
+    ASSERT_OUTPUT_EQ(m, "`(1 (2 . 3) ,@some-list)", "(1 (2 . 3) 2 3)");
+
+    // The same template fills in new values every time, and shares the parts without commas.
+    m.evaluate("(defun make-form (x) `(when ,x (list ,@some-list (a b)) done))");
+    ASSERT_OUTPUT_EQ(m, "(make-form 1)", "(when 1 (list 2 3 (a b)) done)");
+    ASSERT_OUTPUT_EQ(m, "(make-form 'y)", "(when y (list 2 3 (a b)) done)");
+    ASSERT_OUTPUT_EQ(m, "(eq (make-form 1) (make-form 1))", NilName);
+    ASSERT_OUTPUT_EQ(m, "(eq (nth 3 (nth 2 (make-form 1))) (nth 3 (nth 2 (make-form 2))))",
+                     TName);
+    ASSERT_OUTPUT_EQ(m, "(let ((l (make-form 1))) (setcar (cdr l) 5) (make-form 1))",
+                     "(when 1 (list 2 3 (a b)) done)");
 }
 
 void testCarFunction()
@@ -389,7 +406,29 @@ void testStrings()
         chars.erase(ch);
     }
     assert(chars.empty());
-    
+
+    // Indexing a long string with multibyte characters past several index checkpoints
+    std::string mixed;
+    for (int i = 0; i < 200; i++) {
+        mixed += i % 3 ? "a" : "ジ";
+    }
+    String s2(mixed);
+    assert(s2.size() == 200);
+    for (size_t i = 0; i < 200; i++) {
+        assert(s2[i] == (i % 3 ? 'a' : 12472));
+    }
+    ASSERT_EQ(s2.substr(129, 3), "ジaa");
+    assert(utf8::strlen(mixed.c_str()) == 200);
+    assert(utf8::countChars(mixed.c_str(), mixed.size()) ==
+           utf8::kernels::countCharsScalar(mixed.c_str(), mixed.size()));
+    assert(utf8::asciiPrefix(mixed.c_str() + 3, mixed.size() - 3) == 2);
+    const std::string letters = "abcdefghijklmnopqrstuvwxyz@[`{ジabcdefghijklmnopqrstuvwxyzäz";
+    ASSERT_EQ(utf8::toUpper(letters), "ABCDEFGHIJKLMNOPQRSTUVWXYZ@[`{ジABCDEFGHIJKLMNOPQRSTUVWXYZäZ");
+    s2 += "b";
+    assert(s2.size() == 201 && s2[200] == 'b');
+    ASSERT_OUTPUT_EQ(m, "(let ((s \"ジジ\")) (list (length s) (store-substring s 0 \"abcdef\") (length s) (elt s 5)))",
+                     "(2 \"abcdef\" 6 102)");
+
     ASSERT_OUTPUT_EQ(m, "(substring \"abcdefg\" 2)", "\"cdefg\"");
     ASSERT_EXCEPTION(m, "(substring \"abcdefg\" 2.0)", alisp::exceptions::WrongTypeArgument);
     ASSERT_OUTPUT_EQ(m, "(substring \"abcdefg\" 0 3)", "\"abc\"");
@@ -397,6 +436,26 @@ void testStrings()
     ASSERT_OUTPUT_EQ(m, "(substring \"abcdefg\" -3 -1)", "\"ef\"");
     ASSERT_OUTPUT_EQ(m, "(substring \"abcdefg\" -3 nil)", "\"efg\"");
     ASSERT_OUTPUT_EQ(m, "(concat \"ab\" \"cd\")", "\"abcd\"");
+    ASSERT_OUTPUT_EQ(m, "(concat)", "\"\"");
+    ASSERT_OUTPUT_EQ(m, "(concat \"a\" nil \"bä\" \"\" \"c\")", "\"abäc\"");
+    ASSERT_EXCEPTION(m, "(concat \"a\" 1)", exceptions::WrongTypeArgument);
+    ASSERT_OUTPUT_EQ(m, "(string-join '(\"a\" \"b\" \"c\") \", \")", "\"a, b, c\"");
+    ASSERT_OUTPUT_EQ(m, "(string-join '(\"a\" \"b\"))", "\"ab\"");
+    ASSERT_OUTPUT_EQ(m, "(string-join nil \"-\")", "\"\"");
+    ASSERT_EXCEPTION(m, "(string-join '(\"a\" b))", exceptions::WrongTypeArgument);
+    ASSERT_OUTPUT_EQ(m, "(with-output-to-string (princ \"a\") (prin1 'b) (write-char ?ä))",
+                     "\"abä\"");
+    ASSERT_OUTPUT_EQ(m, R"code(
+(defun print-report (n)
+  (let ((i 0))
+    (while (< i n)
+      (princ i)
+      (princ " ")
+      (setq i (1+ i)))))
+(list (with-output-to-string (print-report 3)
+                             (princ (with-output-to-string (princ "nested"))))
+      (with-output-to-string))
+)code", "(\"0 1 2 nested\" \"\")");
     ASSERT_OUTPUT_EQ(m, "(length \"abc\")", "3");
     ASSERT_OUTPUT_EQ(m, "(char-or-string-p (elt \"abc\" 0))", "t");
     ASSERT_OUTPUT_EQ(m, "(char-or-string-p \"abc\")", "t");
@@ -434,6 +493,53 @@ void testStrings()
     ASSERT_OUTPUT_EQ(m,
                      R"code((split-string "ooo" "o*" t))code",
                      R"code(nil)code");
+    ASSERT_OUTPUT_EQ(m, R"code((split-string "a,b;;c" "[,;]" t))code", R"code(("a" "b" "c"))code");
+    ASSERT_OUTPUT_EQ(m, R"code((split-string "ジaジbジ" "ジ"))code", R"code(("" "a" "b" ""))code");
+
+    // Regular expressions
+    ASSERT_OUTPUT_EQ(m, R"code((string-match "o+" "fooo"))code", "1");
+    ASSERT_OUTPUT_EQ(m, R"code((list (match-beginning 0) (match-end 0) (match-string 0)))code",
+                     R"code((1 4 "ooo"))code");
+    ASSERT_OUTPUT_EQ(m, R"code((string-match "x" "fooo"))code", "nil");
+    ASSERT_OUTPUT_EQ(m, R"code((string-match "\\(ジ+\\)\\([a-z]*\\)" "aジジbc1"))code", "1");
+    ASSERT_OUTPUT_EQ(m, R"code((list (match-string 1) (match-string 2) (match-end 2)))code",
+                     R"code(("ジジ" "bc" 5))code");
+    ASSERT_OUTPUT_EQ(m, R"code((string-match "a\\|b\\(c\\)?" "xb"))code", "1");
+    ASSERT_OUTPUT_EQ(m, "(match-beginning 1)", "nil");
+    ASSERT_OUTPUT_EQ(m, R"code((string-match "^b" "ab\nbc"))code", "3");
+    ASSERT_OUTPUT_EQ(m, R"code((string-match "a$" "ba\nc"))code", "1");
+    ASSERT_OUTPUT_EQ(m, R"code((string-match "\\bfoo\\b" "afoo foo"))code", "5");
+    ASSERT_OUTPUT_EQ(m, R"code((string-match "[[:digit:]]\\{2,3\\}" "a1b234"))code", "3");
+    ASSERT_OUTPUT_EQ(m, R"code((progn (string-match "<.*?>" "<a><b>") (match-end 0)))code", "3");
+    ASSERT_OUTPUT_EQ(m, R"code((progn (string-match "<.*>" "<a><b>") (match-end 0)))code", "6");
+    ASSERT_OUTPUT_EQ(m, R"code((string-match "B" "abc"))code", "1");
+    ASSERT_OUTPUT_EQ(m, R"code((let ((case-fold-search nil)) (string-match "B" "abc")))code", "nil");
+    ASSERT_OUTPUT_EQ(m, R"code((string-match "[^a-c]" "abcd" 1))code", "3");
+    ASSERT_OUTPUT_EQ(m, R"code((string-match "*a" "b*a"))code", "1");
+    ASSERT_EXCEPTION(m, R"code((string-match "\\(a" "a"))code", alisp::exceptions::InvalidRegexp);
+    ASSERT_EXCEPTION(m, R"code((string-match "[a" "a"))code", alisp::exceptions::InvalidRegexp);
+    ASSERT_EXCEPTION(m, R"code((string-match "\\(a\\)\\1" "aa"))code", alisp::exceptions::InvalidRegexp);
+    ASSERT_OUTPUT_EQ(m, R"code((condition-case nil (string-match "\\)" "a") (error 'caught)))code",
+                     "caught");
+    ASSERT_OUTPUT_EQ(m, R"code((string-search "ジb" "aジジb"))code", "2");
+    ASSERT_OUTPUT_EQ(m, R"code((string-search "a" "abca" 1))code", "3");
+    ASSERT_OUTPUT_EQ(m, R"code((string-search "x" "abc"))code", "nil");
+    ASSERT_EXCEPTION(m, R"code((string-search "a" "abc" 4))code", alisp::exceptions::ArgsOutOfRange);
+    // Long chains of instructions which match nothing are followed without recursing.
+    ASSERT_OUTPUT_EQ(m, R"code((string-match "\\(\\)\\{45000\\}" "a"))code", "0");
+    ASSERT_OUTPUT_EQ(m, R"code((replace-regexp-in-string "o+" "0" "foo boo"))code", R"code("f0 b0")code");
+    ASSERT_OUTPUT_EQ(m, R"code((replace-regexp-in-string "\\([a-z]\\)\\([0-9]\\)" "\\2\\1" "a1 b2"))code",
+                     R"code("1a 2b")code");
+    ASSERT_OUTPUT_EQ(m, R"code((replace-regexp-in-string "a" "\\&" "aba" nil t))code",
+                     R"code("\\&b\\&")code");
+    ASSERT_OUTPUT_EQ(m, R"code((replace-regexp-in-string "" "-" "ab"))code", R"code("-a-b-")code");
+    ASSERT_OUTPUT_EQ(m, R"code((replace-regexp-in-string "x*" "-" "abc"))code", R"code("-a-b-c-")code");
+    ASSERT_OUTPUT_EQ(m, R"code((replace-regexp-in-string "x*" "-" "axbxx"))code", R"code("-a-b-")code");
+    ASSERT_OUTPUT_EQ(m, R"code((replace-regexp-in-string "a\\(b\\)" "X" "abab" nil nil 1))code",
+                     R"code("aXaX")code");
+    ASSERT_OUTPUT_EQ(m, R"code((replace-regexp-in-string "[0-9]+" (lambda (s) (concat "<" s ">")) "a12b3"))code",
+                     R"code("a<12>b<3>")code");
+    ASSERT_OUTPUT_EQ(m, "(length \"a\\tb\\\\c\\\"\")", "6");
     ASSERT_OUTPUT_EQ(m, "(stringp (car '(\"a\")))", "t");
     ASSERT_OUTPUT_EQ(m, "(stringp \"abc\")", "t");
     ASSERT_OUTPUT_EQ(m, "(stringp 1)", "nil");
@@ -449,7 +555,7 @@ void testStrings()
     ASSERT_OUTPUT_EQ(m, R"code((format "%05d" -30))code", R"code("-0030")code");
     ASSERT_OUTPUT_EQ(m, R"code((format "%5d" -30))code", R"code("  -30")code");
     ASSERT_OUTPUT_EQ(m, R"code((format "%s" "cabra"))code", R"code("cabra")code");
-    ASSERT_OUTPUT_EQ(m, R"code((format "%S" "cabra"))code", R"code(""cabra"")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%S" "cabra"))code", R"code("\"cabra\"")code");
     ASSERT_OUTPUT_EQ(m, R"code((format "num: %d.%%" 50))code", R"code("num: 50.%")code");
     ASSERT_OUTPUT_EQ(m, R"code((format "%+d" 15))code", R"code("+15")code");
     ASSERT_OUTPUT_EQ(m, R"code((format "%+d" -15))code", R"code("-15")code");
@@ -458,6 +564,51 @@ void testStrings()
     ASSERT_OUTPUT_EQ(m, R"code((format "%+05d" 15))code", R"code("+0015")code");
     ASSERT_OUTPUT_EQ(m, R"code((format "%+6d" 15))code", R"code("   +15")code");
     ASSERT_OUTPUT_EQ(m, R"code((format "%+2d" 155))code", R"code("+155")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%-5d|" 15))code", R"code("15   |")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "% d" 15))code", R"code(" 15")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%.4d" 15))code", R"code("0015")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%d" 2.7))code", R"code("2")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%d" most-negative-fixnum))code",
+                     R"code("-9223372036854775808")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%x %X %o" 255 255 8))code", R"code("ff FF 10")code");
+    // Floats out of the range of integers are printed in full rather than wrapping around.
+    ASSERT_OUTPUT_EQ(m, R"code((format "%d" 1e30))code",
+                     R"code("1000000000000000019884624838656")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%d %d" -9223372036854775808.0 9223372036854775808.0))code",
+                     R"code("-9223372036854775808 9223372036854775808")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%x %#X %o" -1e20 1e30 1e19))code",
+                     R"code("-56bc75e2d63100000 0XC9F2C9CD04675000000000000 1053071060221172000000")code");
+    ASSERT_EXCEPTION(m, R"code((format "%d" (/ 1.0 0.0)))code", exceptions::ArithError);
+    ASSERT_OUTPUT_EQ(m, R"code((format "%#x %#o %04x" 255 8 10))code", R"code("0xff 010 000a")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%x" -255))code", R"code("-ff")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%f" 1.5))code", R"code("1.500000")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%.2f" 3.14159))code", R"code("3.14")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%8.3f|%-8.1f|" -2.5 2))code",
+                     R"code("  -2.500|2.0     |")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%08.2f" -2.5))code", R"code("-0002.50")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%.0f %#.0f" 2.0 2.0))code", R"code("2 2.")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%e" 1234.5))code", R"code("1.234500e+03")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%.2e" 0.000123))code", R"code("1.23e-04")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%g %g" 0.0001 1e10))code", R"code("0.0001 1e+10")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%#g %#g %#g %#.3g" 0.0001 1e10 0.0 2.5))code",
+                     R"code("0.000100000 1.00000e+10 0.00000 2.50")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%.1f" 1e20))code", R"code("100000000000000000000.0")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%6s|%-6s|" "äö" "ab"))code", R"code("    äö|ab    |")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%.2s" "äöü"))code", R"code("äö")code");
+    ASSERT_OUTPUT_EQ(m, R"code((format "%3c" ?ä))code", R"code("  ä")code");
+    ASSERT_EXCEPTION(m, R"code((format "%d"))code", exceptions::Error);
+    ASSERT_EXCEPTION(m, R"code((format "%d" "a"))code", exceptions::Error);
+    ASSERT_EXCEPTION(m, R"code((format "%q" 1))code", exceptions::Error);
+    ASSERT_EXCEPTION(m, R"code((format "abc %5"))code", exceptions::Error);
+    ASSERT_EXCEPTION(m, R"code((format "%99999999999d" 1))code", exceptions::Error);
+    ASSERT_EXCEPTION(m, R"code((format "%.99999999999f" 1.0))code", exceptions::Error);
+    ASSERT_OUTPUT_EQ(m, R"code(
+(let ((i 0) (out nil))
+  (while (< i 3)
+    (setq out (cons (format "%d:%s" i (make-string i ?x)) out))
+    (setq i (1+ i)))
+  out)
+)code", R"code(("2:xx" "1:x" "0:"))code");
     ASSERT_OUTPUT_EQ(m,
                      R"code(
 (progn
@@ -474,6 +625,39 @@ void testStrings()
     ASSERT_EXCEPTION(m, R"code((store-substring str 4 ?d))code", alisp::exceptions::Error);
     ASSERT_EXCEPTION(m, R"code((store-substring str -1 ?d))code", alisp::exceptions::Error);
     ASSERT_EXCEPTION(m, R"code((store-substring str -1 "abc"))code", alisp::exceptions::Error);
+    {
+        // Literals which read the same share their text until one of them is modified.
+        const auto literals = m.parse(R"code(("shared" "shared"))code");
+        assert(&literals->asList()->car()->value<const std::string&>() ==
+               &literals->asList()->cadr()->value<const std::string&>());
+    }
+    ASSERT_OUTPUT_EQ(m, R"code(
+(progn
+  (setq a "shared" b "shared" c a)
+  (store-substring a 0 "S")
+  (list a b c (eq a c) (eq (store-substring c 1 "H") a) (string= b "shared")))
+)code", R"code(("SHared" "shared" "SHared" t t t))code");
+    ASSERT_OUTPUT_EQ(m, R"code(
+(let ((l (list "shared" "shared")))
+  (store-substring (car l) 0 "S")
+  l)
+)code", R"code(("Shared" "shared"))code");
+    {
+        // Text asked for to be modified in place is copied first as well.
+        const auto literals = m.parse(R"code(("shared" "shared"))code");
+        const auto copy = literals->asList()->car()->clone();
+        literals->asList()->car()->value<std::string&>()[0] = 'S';
+        ASSERT_EQ(copy->toString(), "\"Shared\"");
+        ASSERT_EQ(literals->asList()->cadr()->toString(), "\"shared\"");
+    }
+    ASSERT_OUTPUT_EQ(m, R"code((progn (clear-string b) (list (string= b "shared") (string= "shared" "shared"))))code",
+                     R"code((nil t))code");
+    ASSERT_OUTPUT_EQ(m, R"code(
+(let ((name (symbol-name 'foo)))
+  (store-substring name 0 "g")
+  (list name (symbol-name 'foo)))
+)code", R"code(("goo" "foo"))code");
+    ASSERT_EXCEPTION(m, R"code((clear-string 'foo))code", alisp::exceptions::WrongTypeArgument);
     ASSERT_OUTPUT_EQ(m, R"code((char-equal 65 ?A))code", R"code(t)code");
     ASSERT_OUTPUT_EQ(m, R"code((char-equal ?x ?b))code", R"code(nil)code");
     ASSERT_OUTPUT_EQ(m, R"code((char-to-string 12472))code", R"code("ジ")code");
@@ -482,13 +666,19 @@ void testStrings()
     ASSERT_OUTPUT_EQ(m, R"code((string-bytes "aジb"))code", R"code(5)code");
     ASSERT_OUTPUT_EQ(m, R"code((elt "aジb" 2))code", R"code(98)code");
     ASSERT_OUTPUT_EQ(m, R"code((reverse "ABCDジEFG"))code", R"code("GFEジDCBA")code");
+    ASSERT_OUTPUT_EQ(m, R"code((reverse ""))code", R"code("")code");
     ASSERT_OUTPUT_EQ(m, R"code((elt "aジb" 1))code", R"code(12472)code");
     ASSERT_EXCEPTION(m, R"code((elt "aジb" 3))code", exceptions::Error);
     ASSERT_EXCEPTION(m, R"code((elt "" 0))code", exceptions::Error);
     ASSERT_OUTPUT_EQ(m, R"code((make-string 5 (elt "aジb" 1)))code", R"code("ジジジジジ")code");
     ASSERT_OUTPUT_EQ(m, R"code((make-string 2 ?\n))code", "\"\n\n\"");
     ASSERT_OUTPUT_EQ(m, R"code((make-string 4 ?\s))code", R"code("    ")code");
-    ASSERT_OUTPUT_EQ(m, R"code((make-string 4 ?\\))code", R"code("\\\\")code");
+    ASSERT_OUTPUT_EQ(m, R"code((make-string 4 ?\\))code", R"code("\\\\\\\\")code");
+    // Strings are printed so that they read back the same.
+    ASSERT_OUTPUT_EQ(m, R"code("a\\b\"c")code", R"code("a\\b\"c")code");
+    ASSERT_OUTPUT_EQ(m, R"code((length "a\\b\"c"))code", "5");
+    ASSERT_OUTPUT_EQ(m, R"code((with-output-to-string (prin1 (string ?\\ 34)) (princ "\\")))code",
+                     R"code("\"\\\\\\\"\"\\")code");
     /*
     ASSERT_OUTPUT_EQ(m, R"code((format t "format t"))code", R"code(nil)code");
     ASSERT_OUTPUT_EQ(m, R"code((format nil "format nil"))code", R"code("format nil")code");
@@ -501,7 +691,7 @@ void testStrings()
     ASSERT_OUTPUT_EQ(m, R"code((string-to-number "3"))code", "3");
     ASSERT_OUTPUT_CONTAINS(m, R"code((string-to-number "3.5"))code", "3.5");
     ASSERT_OUTPUT_EQ(m, R"code((string-to-number "X256"))code", "0");
-    ASSERT_OUTPUT_EQ(m, R"code("2\"5\"6")code", R"code("2"5"6")code");
+    ASSERT_OUTPUT_EQ(m, R"code("2\"5\"6")code", R"code("2\"5\"6")code");
 }
 
 void testDivision()
@@ -558,6 +748,8 @@ void testVariables()
                      "(setq z 3) (setq y x)) (list x y))", "(1 2)");
     ASSERT_OUTPUT_EQ(m, "(setq x 1) ; Put a value in the global binding.", "1");
     ASSERT_EXCEPTION(m, "(let ((x 2)) (makunbound 'x) x)", exceptions::VoidVariable);
+    ASSERT_OUTPUT_EQ(m, "(let ((x (list 1 2))) (list x (setq x 5) x))", "((1 2) 5 5)");
+    ASSERT_OUTPUT_EQ(m, "(progn (setq y 10) (+ y (setq y 1) y))", "12");
     ASSERT_OUTPUT_EQ(m, "x ; The global binding is unchanged.", "1");
     
     ASSERT_EXCEPTION(m, R"code(
@@ -600,6 +792,13 @@ void testVariables()
         ConvertParsedNamesToUpperCase ? "(intern-soft \"VAR2\")" : "(intern-soft \"var2\")",
         "nil");
     ASSERT_OUTPUT_EQ(m, "(defvar var2)", "var2");
+    ASSERT_OUTPUT_EQ(m, "(defconst const1 5 \"A constant.\")", "const1");
+    ASSERT_OUTPUT_EQ(m, "(defconst const1 (1+ const1))", "const1");
+    ASSERT_OUTPUT_EQ(m, "const1", "6");
+    ASSERT_EXCEPTION(m, "(setq const1 7)", exceptions::SettingConstant);
+    ASSERT_EXCEPTION(m, "(defconst :key 1)", exceptions::SettingConstant);
+    ASSERT_OUTPUT_EQ(m, "(condition-case err (setq t 1) (setting-constant (car err)))",
+                     "setting-constant");
     ASSERT_OUTPUT_EQ(
         m,
         ConvertParsedNamesToUpperCase ? "(intern-soft \"VAR2\")" : "(intern-soft \"var2\")",
@@ -796,7 +995,21 @@ void testBasicArithmetic()
     ASSERT_OUTPUT_EQ(m, "(floor -1.5)", "-2");
     ASSERT_OUTPUT_EQ(m, "(floor 1.5)", "1");
     ASSERT_OUTPUT_EQ(m, "(ceiling 2)", "2");
-    ASSERT_OUTPUT_EQ(m, "(abs -1.5)", "1.500000");
+    ASSERT_OUTPUT_EQ(m, "(abs -1.5)", "1.5");
+    ASSERT_OUTPUT_EQ(m, "(list 1.0 -0.0 0.1 (+ 0.1 0.2) 100000.0 1e20 1e-5 0.0001)",
+                     "(1.0 -0.0 0.1 0.30000000000000004 100000.0 1e+20 1e-05 0.0001)");
+    ASSERT_OUTPUT_EQ(m, "(list 123456789012345.0 1e15 (/ 1.0 3) 1.7976931348623157e308)",
+                     "(123456789012345.0 1e+15 0.3333333333333333 1.7976931348623157e+308)");
+    ASSERT_OUTPUT_EQ(m, "(list (/ 0.0 0.0) (/ 1.0 0) (/ -1.0 0))",
+                     "(-0.0e+NaN 1.0e+INF -1.0e+INF)");
+    ASSERT_OUTPUT_EQ(m, "(= (string-to-number (number-to-string (/ 1.0 7))) (/ 1.0 7))", "t");
+    ASSERT_OUTPUT_EQ(m, "(list (number-to-string 2.5) (number-to-string -42) (number-to-string ?a))",
+                     "(\"2.5\" \"-42\" \"97\")");
+    ASSERT_OUTPUT_EQ(m, "(format \"%s %S\" 0.5 most-negative-fixnum)",
+                     "\"0.5 -9223372036854775808\"");
+    ASSERT_EXCEPTION(m, "(number-to-string \"1\")", exceptions::WrongTypeArgument);
+    ASSERT_OUTPUT_EQ(m, "'(1e-5 -2.5e+3 +3 1e 100000000000000000000)",
+                     "(1e-05 -2500.0 3 1e 1e+20)");
     ASSERT_OUTPUT_EQ(m, "(abs -4)", "4");
 }
 
@@ -894,6 +1107,100 @@ void testMacros()
   x)
 (mirror 12) => 12
 )code");
+
+    // Each call is expanded once, however many times it is evaluated, until the macro is
+    // redefined.
+    ASSERT_OUTPUT_EQ(m, R"code(
+(progn
+  (setq expansions 0)
+  (defmacro counted (x) (setq expansions (1+ expansions)) x)
+  (defun use-counted (n) (counted n))
+  (list (use-counted 1) (use-counted 2) (use-counted 3) expansions))
+)code", "(1 2 3 1)");
+    ASSERT_OUTPUT_EQ(m, R"code(
+(progn
+  (defmacro counted (x) (setq expansions (1+ expansions)) (list '* x 10))
+  (list (use-counted 1) (use-counted 2) expansions))
+)code", "(10 20 2)");
+    ASSERT_OUTPUT_EQ(m, R"code(
+(let ((i 0) (acc nil))
+  (while (< i 5)
+    (when (< i 3) (push i acc))
+    (setq i (1+ i)))
+  acc)
+)code", "(2 1 0)");
+    ASSERT_EXCEPTION(m, "(counted)", exceptions::WrongNumberOfArguments);
+
+    // Expanding everything leaves quoted data and the variables of let alone.
+    ASSERT_OUTPUT_EQ(m, "(macroexpand-all '(when a (push 'x l) '(when b)))",
+                     "(if a (progn (setq l (cons 'x l)) '(when b)))");
+    ASSERT_OUTPUT_EQ(m, "(macroexpand-all '(let ((when (unless a b)) c) (cond ((when d) e))))",
+                     "(let ((when (if a nil b)) c) (cond ((if d (progn)) e)))");
+    // The unquoted parts of a backquote template are expanded, the constant parts are not.
+    ASSERT_OUTPUT_EQ(m, "(macroexpand-all '`(when ,(when x 1) (when y) ,@(unless z l) . ,(inc w)))",
+                     "(backquote (when (, (if x (progn 1))) (when y) (,@ (if z nil l)) , "
+                     "(setq w (1+ w))))");
+    ASSERT_OUTPUT_EQ(m, "(macroexpand-all '`(when a))", "(backquote (when a))");
+    ASSERT_OUTPUT_EQ(m, "(macroexpand-all '(lambda (x) (when x 1)))",
+                     "#'(lambda (x) (if x (progn 1)))");
+    ASSERT_OUTPUT_EQ(m, "(macroexpand-all '(condition-case err (pop l) (error (inc x))))",
+                     "(condition-case err (prog1 (car l) (setq l (cdr l))) (error (setq x (1+ x))))");
+    ASSERT_OUTPUT_EQ(m, R"code(
+(progn
+  (setq eager-macroexpand t)
+  (defun eager-counted (n) (when n (counted n)))
+  (setq eager-macroexpand nil)
+  (list (symbol-function 'eager-counted) (eager-counted 2)))
+)code", "((lambda (n) (if n (progn (* n 10)))) 20)");
+    ASSERT_OUTPUT_EQ(m, R"code(
+(let ((eager-macroexpand t))
+  (defun eager-template (x) `(a ,(when x 1)))
+  (list (symbol-function 'eager-template) (eager-template t)))
+)code", "((lambda (x) (backquote (a (, (if x (progn 1)))))) (a 1))");
+    ASSERT_OUTPUT_EQ(m, "(let ((eager-macroexpand t)) (lambda (y) (unless y 2)))",
+                     "(lambda (y) (if y nil 2))");
+
+    // Eager definitions fold constant expressions, but not variables bound in the body.
+    ASSERT_OUTPUT_EQ(m, R"code(
+(progn
+  (defconst folded-limit 10)
+  (let ((eager-macroexpand t))
+    (defun folded (x)
+      (when (> folded-limit 5)
+        (list (+ x (* 2 3)) (concat "a" "b") (car '(p q)) (if (eq 1 2) (print x) x 'y))))
+    (defun not-folded (folded-limit)
+      (list (1+ folded-limit) (/ 1 0) (length (list 1 2)))))
+  (list (symbol-function 'folded) (symbol-function 'not-folded) (folded 1)))
+)code", "((lambda (x) (progn (list (+ x 6) (concat \"a\" \"b\") 'p (progn x 'y)))) "
+        "(lambda (folded-limit) (list (1+ folded-limit) (/ 1 0) (length (list 1 2)))) "
+        "(7 \"ab\" p y))");
+    ASSERT_OUTPUT_EQ(m, R"code(
+(let ((eager-macroexpand t))
+  (defun folded-scopes (n)
+    (let ((folded-limit n) (m folded-limit)) (+ folded-limit m))
+    (dotimes (folded-limit (1+ folded-limit)) folded-limit)
+    (condition-case folded-limit (+ 1 folded-limit) (error folded-limit))
+    (setq n (- 1 1))
+    (quote (+ 1 2))
+    #'(lambda (folded-limit) (+ folded-limit (+ 1 1))))
+  (symbol-function 'folded-scopes))
+)code", "(lambda (n) (let ((folded-limit n) (m 10)) (+ folded-limit m)) "
+        "(dotimes (folded-limit 11) folded-limit) "
+        "(condition-case folded-limit 11 (error folded-limit)) "
+        "(setq n (- 1 1)) '(+ 1 2) #'(lambda (folded-limit) (+ folded-limit 2)))");
+    // A constant cannot be bound either, so folding it in cannot change what a call sees.
+    ASSERT_OUTPUT_EQ(m, "(let ((eager-macroexpand t)) (defun folded-constant () folded-limit))",
+                     "folded-constant");
+    ASSERT_EXCEPTION(m, "(let ((folded-limit 2)) (folded-constant))", exceptions::SettingConstant);
+    // Calls which make new strings are not folded: each call still gets a string of its own.
+    ASSERT_OUTPUT_EQ(m, R"code(
+(progn
+  (let ((eager-macroexpand t))
+    (defun folded-string () (concat "a" "b")))
+  (store-substring (folded-string) 0 "X")
+  (list (store-substring (folded-string) 1 "Y") (folded-string)
+        (eq (folded-string) (folded-string))))
+)code", "(\"aY\" \"ab\" nil)");
 }
 
 void testDeepCopy()
@@ -997,6 +1304,21 @@ void testFunctions()
     ASSERT_OUTPUT_EQ(m, "(caar '((8) 2 3))", "8");
     ASSERT_OUTPUT_EQ(m, "(progn (defun xx () t) (functionp 'xx))", "t");
     ASSERT_EQ(ss.str(), "fooabc");
+
+    // A call keeps calling whatever the function of its symbol currently is.
+    ASSERT_OUTPUT_EQ(m, R"code(
+(progn
+  (defun ic-f () 1)
+  (defun ic-call () (ic-f))
+  (list (ic-call)
+        (progn (defun ic-f () 2) (ic-call))
+        (progn (fset 'ic-f (lambda () 3)) (ic-call))
+        (let ((ic-f nil)) (fset 'ic-f (lambda () 4)) (ic-call))
+        (ic-call)
+        (progn (defmacro ic-f () 5) (ic-call))
+        (progn (unintern 'ic-f) (condition-case nil (ic-call) (void-function 'void)))
+        (progn (fset (intern "ic-f") (lambda () 6)) (ic-call))))
+)code", "(1 2 3 4 4 5 void 6)");
     ASSERT_OUTPUT_CONTAINS(m, R"code(
 (lambda (x)
   "Return the hyperbolic cosine of X."
@@ -1061,7 +1383,30 @@ void testLet()
   (symbol-value abracadabra))
 )code", "9");
     ASSERT_OUTPUT_EQ(m, "(symbol-value 'abracadabra)", "5");
-   
+
+    // A binding is seen by the functions called inside it and ends however the let is left.
+    ASSERT_OUTPUT_EQ(m, R"code(
+(progn
+  (defun read-depth () depth)
+  (defun bump-depth () (setq depth (1+ depth)))
+  (setq depth 0)
+  (list (let ((depth 10)) (bump-depth) (read-depth))
+        (catch 'out (let ((depth 20)) (throw 'out (read-depth))))
+        (condition-case nil (let ((depth 30)) (car depth)) (error (read-depth)))
+        (let ((depth 40)) (let ((depth 50)) (bump-depth)) depth)
+        depth))
+)code", "(11 20 0 40 0)");
+    ASSERT_OUTPUT_EQ(m, "(progn (makunbound 'depth) (list (let ((depth 1)) depth) (boundp 'depth)))",
+                     "(1 nil)");
+    ASSERT_OUTPUT_EQ(m, R"code(
+(progn
+  (let ((limit 4)) (defconst limit 5))
+  (list (boundp 'limit) (setq limit 1) (makunbound 'limit)))
+)code", "(nil 1 limit)");
+    ASSERT_OUTPUT_EQ(m, "(progn (defconst limit 3) limit)", "3");
+    ASSERT_EXCEPTION(m, "(let ((limit 4)) limit)", exceptions::SettingConstant);
+    ASSERT_EXCEPTION(m, "(funcall (lambda (limit) limit) 4)", exceptions::SettingConstant);
+    ASSERT_EXCEPTION(m, "(setq limit 6)", exceptions::SettingConstant);
 }
 
 void testIf()
@@ -1087,16 +1432,19 @@ void testCyclicals()
                      "z)",
                      "(1 2 3 4 5 6 7 2 3 4 5 6 . #6)");
 
-    // Unfortunately I haven't been able to reverse engineer how emacs cuts cyclical
-    // list printing. But as long as the number following hashtag is correct and the
-    // patter is visibly clear from inspecting the printed list, this shouldn't be a
-    // huge problem.
-    /*
+    // Printing stops where Brent's cycle detection notices the cycle, just like in emacs.
     ASSERT_OUTPUT_EQ(m,
                      "(progn (set 'z (list 1 2 3 4 5 6))"
                      "(setcdr (cdr (cdr (cdr (cdr (cdr z))))) (cdr (cdr z)))"
                      "z)", "(1 2 3 4 5 6 3 4 5 6 . #5)");
-    */
+    ASSERT_EXCEPTION(m, "(length z)", exceptions::Error);
+    ASSERT_OUTPUT_EQ(m, "(list-length z)", "nil");
+    ASSERT_OUTPUT_EQ(m, "(proper-list-p z)", "nil");
+    ASSERT_OUTPUT_EQ(m, "(let ((l (list 1 2 3))) (setcdr (cdr (cdr l)) (cdr (cdr l))) l)",
+                     "(1 2 3 . #1)");
+    ASSERT_OUTPUT_CONTAINS(m, "(setq big (make-list 100000 'a))", "(a a a a ");
+    ASSERT_OUTPUT_EQ(m, "(length big)", "100000");
+    ASSERT_OUTPUT_EQ(m, "(length (reverse big))", "100000");
     ASSERT_OUTPUT_EQ(m, "(let ((a (list 1))) (proper-list-p (setcdr a a)))", "nil");
     ASSERT_OUTPUT_EQ(m, "(let ((a (list 1)))(setcdr a a))", "(1 . #0)");
 
@@ -1150,22 +1498,22 @@ void testMemoryLeaks()
 {
     using namespace alisp;
     std::unique_ptr<Machine> m = std::make_unique<Machine>();
-    assert(Object::getDebugRefCount() > 0);
-    const int baseCount = Object::getDebugRefCount();
+    assert(memoryStats().live(MemoryKind::Object) > 0);
+    const auto baseCount = memoryStats().live(MemoryKind::Object);
     ASSERT_EXCEPTION(*m, "(pop nil)", exceptions::Error);
-    assert(Object::getDebugRefCount() == baseCount && "Macro call");
+    assert(memoryStats().live(MemoryKind::Object) == baseCount && "Macro call");
 
     // A quite simple circular test case:
     if (true) {
         auto obj = m->evaluate("(let ((a (list 1)))(setcdr a a))");
-        assert(Object::getDebugRefCount() > baseCount && "Circular");
+        assert(memoryStats().live(MemoryKind::Object) > baseCount && "Circular");
         obj = nullptr;
-        assert(Object::getDebugRefCount() == baseCount && "Circular");
+        assert(memoryStats().live(MemoryKind::Object) == baseCount && "Circular");
     }
 
     // A slightly more complicated one
     if (true) {
-        assert(Object::getDebugRefCount() == baseCount && "Before progn");
+        assert(memoryStats().live(MemoryKind::Object) == baseCount && "Before progn");
         auto obj = m->evaluate("(progn (set 'z (list 1 2 3 4 5 6 7))"
                                "(setcdr (cdr (cdr (cdr (cdr (cdr (cdr z)))))) (cdr z))"
                                "z)");
@@ -1173,19 +1521,19 @@ void testMemoryLeaks()
         m->getSymbolOrNull(zname);
         assert(obj->eq(*m->getSymbolOrNull(zname)->variable));
         assert(obj->eq(*m->evaluate(zname.c_str())));
-        assert(Object::getDebugRefCount() > baseCount && "Circular2");
+        assert(memoryStats().live(MemoryKind::Object) > baseCount && "Circular2");
         auto clone = obj->clone();
         clone = nullptr;
-        assert(Object::getDebugRefCount() > baseCount && "Circular2");
+        assert(memoryStats().live(MemoryKind::Object) > baseCount && "Circular2");
         obj = nullptr;
-        assert(Object::getDebugRefCount() > baseCount && "Circular2");
+        assert(memoryStats().live(MemoryKind::Object) > baseCount && "Circular2");
         m->evaluate("(unintern 'z)");
-        assert(Object::getDebugRefCount() == baseCount && "Circular2");
+        assert(memoryStats().live(MemoryKind::Object) == baseCount && "Circular2");
     }
 
     // One involving symbols
     if (true) {
-        assert(Object::getDebugRefCount() == baseCount);
+        assert(memoryStats().live(MemoryKind::Object) == baseCount);
         const char* code = R"code(
 (progn
   (setq s1 (make-symbol "a"))
@@ -1197,14 +1545,49 @@ void testMemoryLeaks()
   (unintern 's1))
 )code";
         m->evaluate(code);
-        assert(Object::getDebugRefCount() > baseCount && "Syms");
+        assert(memoryStats().live(MemoryKind::Object) > baseCount && "Syms");
         m->evaluate("(unintern 's2)");
-        assert(Object::getDebugRefCount() == baseCount && "Syms");
+        assert(memoryStats().live(MemoryKind::Object) == baseCount && "Syms");
+    }
+
+    // Predicates and small integers use the shared objects of the machine
+    if (true) {
+        auto obj = m->evaluate("(list (eq 1 1) (null 1) (+ 1 2) (1- -128) (* 4 256))");
+        assert(memoryStats().live(MemoryKind::Object) == baseCount + 3 && "Shared objects");
+        obj = nullptr;
+        assert(memoryStats().live(MemoryKind::Object) == baseCount);
+    }
+
+    // Cons cells are accounted like objects and sampling remembers the objects still alive
+    if (true) {
+        const auto conses = memoryStats().live(MemoryKind::ConsCell);
+        const auto bytes = memoryStats().bytes(MemoryKind::Object);
+        memoryStats().setSampleInterval(1);
+        auto obj = m->evaluate("(make-list 3 (memory-use-counts))");
+        assert(memoryStats().live(MemoryKind::ConsCell) == conses + 6);
+        size_t sampled = 0;
+        memoryStats().forEachSampled([&](const Object&) { sampled++; });
+        assert(sampled == 7 && "Sampled");
+        obj = nullptr;
+        memoryStats().setSampleInterval(0);
+        sampled = 0;
+        memoryStats().forEachSampled([&](const Object&) { sampled++; });
+        assert(sampled == 0 && "Sampled");
+        assert(memoryStats().live(MemoryKind::ConsCell) == conses);
+        assert(memoryStats().bytes(MemoryKind::Object) == bytes);
+        ASSERT_OUTPUT_EQ(*m, "(length (memory-use-counts))", "3");
+    }
+
+    // Values borrowed as arguments outlive the variable being set during the call
+    if (true) {
+        assert(memoryStats().live(MemoryKind::Object) == baseCount);
+        m->evaluate("(progn (setq bv (list 1 2)) (list bv (setq bv nil)) (unintern 'bv))");
+        assert(memoryStats().live(MemoryKind::Object) == baseCount && "Borrowed");
     }
 
     // Of course we should zero objects left after destroying the machine
     m = nullptr;
-    assert(Object::getDebugRefCount() == 0);
+    assert(memoryStats().live(MemoryKind::Object) == 0);
 }
 
 void testControlStructures()
@@ -1261,6 +1644,45 @@ void testControlStructures()
 )code", "2");
     ASSERT_OUTPUT_EQ(m, R"code( (cond ((= 1 2) 1)) )code", "nil");
     ASSERT_OUTPUT_EQ(m, "(cond)", "nil");
+    ASSERT_OUTPUT_EQ(m, "(cond (nil 1) ((+ 1 2)))", "3");
+    ASSERT_OUTPUT_EQ(m, "(let ((x 0)) (cond ((= x 0) (setq x 5) (+ x 1)) (t 0)))", "6");
+    ASSERT_OUTPUT_EQ(m, "(or nil (+ 1 1) (error \"Not evaluated\"))", "2");
+    ASSERT_OUTPUT_EQ(m, "(or)", "nil");
+    ASSERT_OUTPUT_EQ(m, "(let ((x 1)) (list (prog1 x (setq x 2)) x))", "(1 2)");
+    ASSERT_OUTPUT_EQ(m, "(prog1)", "nil");
+    ASSERT_OUTPUT_EQ(m, "(progn)", "nil");
+    ASSERT_EXCEPTION(m, "(if t)", exceptions::WrongNumberOfArguments);
+    ASSERT_EXCEPTION(m, "(while)", exceptions::WrongNumberOfArguments);
+    ASSERT_OUTPUT_EQ(m, "(list (functionp 'if) (functionp 'and) (fboundp 'while))", "(nil nil t)");
+
+    ASSERT_OUTPUT_EQ(m, "(let ((l nil)) (dotimes (i 4) (push i l)) l)", "(3 2 1 0)");
+    ASSERT_OUTPUT_EQ(m, "(let ((n 0)) (dotimes (i 5 (list i n)) (setq n (+ n i))))", "(5 10)");
+    ASSERT_OUTPUT_EQ(m, "(dotimes (i 0) (error \"Not evaluated\"))", "nil");
+    ASSERT_OUTPUT_EQ(m, "(let ((l nil)) (dotimes (i 3) (push i l) (setq i 10)) l)", "(2 1 0)");
+    ASSERT_OUTPUT_EQ(m, "(let ((n 0)) (dotimes (i 5000) (setq n (+ n i))) n)", "12497500");
+    ASSERT_OUTPUT_EQ(m, "(let ((l nil)) (dolist (x '(a b c) (length l)) (push x l)))", "3");
+    ASSERT_OUTPUT_EQ(m, "(let ((x 'outer)) (dolist (x '(1 2))) x)", "outer");
+    ASSERT_EXCEPTION(m, "(dotimes (i) 1)", exceptions::WrongTypeArgument);
+    ASSERT_EXCEPTION(m, "(dolist (x 5) 1)", exceptions::WrongTypeArgument);
+
+    ASSERT_OUTPUT_EQ(m, "(cl-loop for x in '(1 2 3) collect (* x x))", "(1 4 9)");
+    ASSERT_OUTPUT_EQ(m, "(cl-loop for i from 1 to 10 sum i)", "55");
+    ASSERT_OUTPUT_EQ(m, "(cl-loop for i from 0 below 10 by 3 collect i)", "(0 3 6 9)");
+    ASSERT_OUTPUT_EQ(m, "(cl-loop for x in '(a b c) for i from 1 collect (list i x))",
+                     "((1 a) (2 b) (3 c))");
+    ASSERT_OUTPUT_EQ(m, "(cl-loop for x in '((1 2) nil (3)) append x)", "(1 2 3)");
+    ASSERT_OUTPUT_EQ(m, "(cl-loop for x in '(1 2) collect x append (list x x))",
+                     "(1 1 1 2 2 2)");
+    ASSERT_OUTPUT_EQ(m, "(cl-loop for x in '(1 2.5) sum x)", "3.5");
+    ASSERT_OUTPUT_EQ(m, "(let ((l nil)) (cl-loop for x in '(1 2) do (push x l) (push 0 l)) l)",
+                     "(0 2 0 1)");
+    ASSERT_OUTPUT_EQ(m, "(cl-loop for x in nil collect x)", "nil");
+    ASSERT_OUTPUT_EQ(m, "(cl-loop for i from 1 to 3 do (+ i 1))", "nil");
+    ASSERT_EXCEPTION(m, "(cl-loop for x across \"ab\" collect x)", exceptions::Error);
+    ASSERT_EXCEPTION(m, "(cl-loop for x in '(1) collect x sum x)", exceptions::Error);
+
+    // A redefined control form is called like any other function.
+    ASSERT_OUTPUT_EQ(m, "(progn (defun prog1 (a b) (list b a)) (prog1 1 2))", "(2 1)");
     ASSERT_OUTPUT_EQ(m, "(xor t t)", "nil");
     ASSERT_OUTPUT_EQ(m, "(xor nil nil)", "nil");
     ASSERT_OUTPUT_EQ(m, "(xor t nil)", "t");
@@ -1408,6 +1830,68 @@ void testErrors()
     (error 1000000)))
 (safe-divide2 5000 0)
 )code", "1000000");
+
+    try {
+        m.evaluate("(defun stack-trace-test (x) (car x))");
+        m.evaluate("(stack-trace-test 1)");
+        assert(false);
+    }
+    catch (exceptions::Error& ex) {
+        ASSERT_EQ(ex.stackTrace(), "(car x)\n(stack-trace-test 1)\n");
+    }
+
+    m.evaluate("(defun backtrace-test (x) (list x (backtrace-frames)))");
+    ASSERT_OUTPUT_EQ(m, "(car (cdr (backtrace-test 1)))",
+                     "((list x (backtrace-frames)) (backtrace-test 1) (cdr (backtrace-test 1)) "
+                     "(car (cdr (backtrace-test 1))))");
+    ASSERT_OUTPUT_EQ(m, "(with-output-to-string (backtrace))",
+                     "\"  (with-output-to-string (backtrace))\n\"");
+    ASSERT_OUTPUT_EQ(m, "(condition-case nil (backtrace-test (car 1)) (error (backtrace-frames)))",
+                     "((condition-case nil (backtrace-test (car 1)) (error (backtrace-frames))))");
+}
+
+void testNonLocalExits()
+{
+    Machine m;
+    ASSERT_OUTPUT_EQ(m, R"code(
+(catch 'found
+  (dolist (x '(1 2 3 4))
+    (when (> x 2)
+      (throw 'found (* x 10))))
+  'none)
+)code", "30");
+    ASSERT_OUTPUT_EQ(m, "(catch 'none 1 2)", "2");
+    ASSERT_OUTPUT_EQ(m, "(catch 'none)", "nil");
+    ASSERT_OUTPUT_EQ(m, "(catch 'outer (catch 'inner (throw 'outer 1)) 2)", "1");
+    ASSERT_OUTPUT_EQ(m, "(catch 'outer (catch 'inner (throw 'inner 1)) 2)", "2");
+    ASSERT_OUTPUT_EQ(m, "(catch 'x (condition-case nil (throw 'x 'thrown) (error 'handled)))",
+                     "thrown");
+    ASSERT_OUTPUT_EQ(m, "(condition-case err (throw 'nowhere 5) (no-catch (cdr err)))",
+                     "(nowhere 5)");
+    ASSERT_EXCEPTION(m, "(throw 'nowhere 5)", exceptions::Error);
+
+    ASSERT_OUTPUT_EQ(m, "(unwind-protect 1 2 3)", "1");
+    ASSERT_OUTPUT_EQ(m, R"code(
+(let ((cleaned nil))
+  (list (catch 'x (unwind-protect (throw 'x 1) (setq cleaned t)))
+        cleaned))
+)code", "(1 t)");
+    ASSERT_OUTPUT_EQ(m, R"code(
+(let ((cleaned nil))
+  (condition-case nil
+      (unwind-protect (error "Failed") (setq cleaned 'after-error))
+    (error cleaned)))
+)code", "after-error");
+
+    // Leaving a loop with throw again and again.
+    ASSERT_OUTPUT_EQ(m, R"code(
+(let ((n 0))
+  (while (< n 200)
+    (setq n (+ n (catch 'next
+                   (while t
+                     (throw 'next 1))))))
+  n)
+)code", "200");
 }
 
 void testSequences()
@@ -1513,6 +1997,162 @@ c => (1 2 3 (4 middleguy-symbol 6) 7 8 9)
 )code");
 }
 
+void testRopes()
+{
+    // Appending a character at a time keeps the tree balanced and the leaves full.
+    Rope rope;
+    std::string expected;
+    for (int i = 0; i < 20000; i++) {
+        const std::string piece = i % 7 ? "a" : "ä";
+        rope = rope + Rope(piece);
+        expected += piece;
+    }
+    assert(rope.toString() == expected);
+    assert(rope.bytes() == expected.size());
+    assert(rope.chars() == 20000);
+    assert(rope.height() <= 8);
+    assert(rope.at(0) == 0xe4 && rope.at(1) == 'a' && rope.at(19999) == 0xe4);
+    assert(rope.substr(6, 9).toString() == "aäa");
+    assert(rope.substr(0, 20000).toString() == expected);
+    const Rope joined = rope.substr(100, 15000) + rope.substr(2, 5000);
+    assert(joined.chars() == 14900 + 4998);
+    assert(joined.at(14900) == rope.at(2));
+
+    Machine m;
+    ASSERT_OUTPUT_EQ(m, R"code(
+(progn
+  (setq big "")
+  (let ((i 0))
+    (while (< i 3000)
+      (setq big (concat big "line " (number-to-string i) "\n"))
+      (setq i (1+ i))))
+  (list (length big) (elt big 0) (elt big 10000) (substring big 7 12)))
+)code", R"code((28890 108 108 "line "))code");
+    const auto big = m.evaluate("big");
+    const auto str = dynamic_cast<const StringObject*>(big.get());
+    assert(str && !str->isFlat());
+    ASSERT_OUTPUT_EQ(m, "(length (substring big 100 6000))", "5900");
+    ASSERT_OUTPUT_EQ(m, "(length (format \"<%s>\" big))", "28892");
+    ASSERT_OUTPUT_EQ(m, "(length (concat big big))", "57780");
+    ASSERT_OUTPUT_EQ(m, "(substring big -5)", "\"2999\n\"");
+    assert(!str->isFlat());
+
+    // Handing the text over in one piece flattens it, for all references to the string.
+    ASSERT_OUTPUT_EQ(m, "(progn (setq same big) (string-match \"line 2999\" big))", "28880");
+    ASSERT_OUTPUT_EQ(m, "(progn (store-substring big 0 \"L\") (list (substring big 0 4) (eq same big)))",
+                     "(\"Line\" t)");
+    ASSERT_OUTPUT_EQ(m, "(substring same 0 4)", "\"Line\"");
+    ASSERT_OUTPUT_EQ(m, "(string= (concat big \"\") big)", "t");
+    ASSERT_EXCEPTION(m, "(substring big 5 100000)", exceptions::ArgsOutOfRange);
+}
+
+void testCaseConversion()
+{
+    assert(unicode::toUpper('a') == 'A' && unicode::toLower(0xc4) == 0xe4);
+    assert(unicode::toUpper(0x3c3) == 0x3a3 && unicode::toTitle(0x1c6) == 0x1c5);
+    assert(unicode::category(0x30b8) == unicode::Lo && unicode::category(0x10ffff) == unicode::Cn);
+    assert(unicode::isUpper(0x410) && !unicode::isUpper(0x430) && unicode::isLower(0xdf));
+    assert(unicode::isSpace(0x3000) && unicode::isPunct(0x3002) && !unicode::isAlpha('1'));
+    ASSERT_EQ(unicode::upcase("straße ǆ ジ"), "STRASSE Ǆ ジ");
+    ASSERT_EQ(unicode::downcase("ÄÖ ΣΑΣ ABC"), "äö σασ abc");
+
+    Machine m;
+    ASSERT_OUTPUT_EQ(m, "(upcase \"Hello, wörld!\")", "\"HELLO, WÖRLD!\"");
+    ASSERT_OUTPUT_EQ(m, "(downcase \"ÅNGSTRÖM\")", "\"ångström\"");
+    ASSERT_OUTPUT_EQ(m, "(upcase \"ß\")", "\"SS\"");
+    ASSERT_OUTPUT_EQ(m, "(upcase ?ß)", "223");
+    ASSERT_OUTPUT_EQ(m, "(list (upcase ?a) (downcase ?Ä) (capitalize ?ǆ))", "(65 228 453)");
+    ASSERT_OUTPUT_EQ(m, "(capitalize \"the qUICK brown-fox 3rd ßtraße\")",
+                     "\"The Quick Brown-Fox 3rd Sstraße\"");
+    ASSERT_OUTPUT_EQ(m, "(upcase-initials \"the qUICK éclair\")", "\"The QUICK Éclair\"");
+    ASSERT_OUTPUT_EQ(m, "(list (char-uppercase-p ?A) (char-uppercase-p ?a) (char-uppercase-p ?Ж))",
+                     "(t nil t)");
+    ASSERT_OUTPUT_EQ(m, "(get-char-code-property ?ジ 'general-category)", "Lo");
+    ASSERT_OUTPUT_EQ(m, "(get-char-code-property ?ж 'uppercase)", "1046");
+    ASSERT_EXCEPTION(m, "(upcase 'a)", exceptions::WrongTypeArgument);
+
+    // Regular expressions classify and fold characters with the same tables.
+    ASSERT_OUTPUT_EQ(m, "(let ((case-fold-search nil)) (string-match \"[[:upper:]]\" \"abcÄ\"))",
+                     "3");
+    ASSERT_OUTPUT_EQ(m, "(string-match \"[[:punct:]]\" \"ジ、\")", "1");
+    ASSERT_OUTPUT_EQ(m, "(let ((case-fold-search t)) (string-match \"ÖL\" \"Das öl\"))", "4");
+    ASSERT_OUTPUT_EQ(m, "(let ((case-fold-search t)) (string-match \"[α-ω]+\" \"ΣΑΣ\"))", "0");
+}
+
+void testBuffers()
+{
+    Machine m;
+    ASSERT_OUTPUT_EQ(m, "(current-buffer)", "#<buffer *scratch*>");
+    ASSERT_OUTPUT_EQ(m, "(bufferp (current-buffer))", "t");
+    ASSERT_OUTPUT_EQ(m, "(bufferp \"*scratch*\")", "nil");
+    ASSERT_OUTPUT_EQ(m, "(list (point) (point-min) (point-max) (buffer-size))", "(1 1 1 0)");
+    ASSERT_OUTPUT_EQ(m, "(insert \"hello\" ?\\s \"world\")", "nil");
+    ASSERT_OUTPUT_EQ(m, "(buffer-string)", "\"hello world\"");
+    ASSERT_OUTPUT_EQ(m, "(list (point) (point-max) (buffer-size))", "(12 12 11)");
+    ASSERT_OUTPUT_EQ(m, "(goto-char 6)", "6");
+    ASSERT_OUTPUT_EQ(m, "(progn (insert \",\") (buffer-string))", "\"hello, world\"");
+    ASSERT_OUTPUT_EQ(m, "(goto-char 100)", "13");
+    ASSERT_OUTPUT_EQ(m, "(goto-char -5)", "1");
+    ASSERT_OUTPUT_EQ(m, "(buffer-substring 1 6)", "\"hello\"");
+    ASSERT_OUTPUT_EQ(m, "(buffer-substring 6 1)", "\"hello\"");
+    ASSERT_EXCEPTION(m, "(buffer-substring 1 15)", exceptions::ArgsOutOfRange);
+
+    // Deleting text before point moves point back with the text after it.
+    ASSERT_OUTPUT_EQ(m, "(progn (goto-char 8) (delete-region 1 7) (list (point) (buffer-string)))",
+                     "(2 \" world\")");
+    ASSERT_OUTPUT_EQ(m, "(progn (goto-char 4) (delete-region 2 5) (list (point) (buffer-string)))",
+                     "(2 \" ld\")");
+    ASSERT_OUTPUT_EQ(m, "(progn (erase-buffer) (list (point) (buffer-string)))", "(1 \"\")");
+
+    // Positions count characters, not bytes.
+    ASSERT_OUTPUT_EQ(m, "(progn (insert \"äiti ja isä\") (list (point) (buffer-size)))", "(12 11)");
+    ASSERT_OUTPUT_EQ(m, "(buffer-substring 1 5)", "\"äiti\"");
+    ASSERT_OUTPUT_EQ(m, "(progn (goto-char 10) (insert ?ö) (buffer-string))", "\"äiti ja iösä\"");
+    ASSERT_OUTPUT_EQ(m, "(progn (delete-region 10 12) (buffer-string))", "\"äiti ja iä\"");
+    ASSERT_OUTPUT_EQ(m, "(buffer-substring 9 11)", "\"iä\"");
+
+    // Searching leaves point after the match and sets the match data.
+    ASSERT_OUTPUT_EQ(m, "(progn (erase-buffer) (insert \"öö foo bar foo\") (goto-char 1))", "1");
+    ASSERT_OUTPUT_EQ(m, "(search-forward \"foo\")", "7");
+    ASSERT_OUTPUT_EQ(m, "(list (match-beginning 0) (match-end 0) (match-string 0))",
+                     "(4 7 \"foo\")");
+    ASSERT_OUTPUT_EQ(m, "(search-forward \"foo\")", "15");
+    ASSERT_EXCEPTION(m, "(search-forward \"foo\")", exceptions::SearchFailed);
+    ASSERT_OUTPUT_EQ(m, "(progn (goto-char 1) (search-forward \"bar\" 10 t))", "nil");
+    ASSERT_OUTPUT_EQ(m, "(point)", "1");
+    ASSERT_OUTPUT_EQ(m, "(list (search-forward \"bar\" 10 'move) (point))", "(nil 10)");
+    ASSERT_OUTPUT_EQ(m, "(condition-case nil (search-forward \"baz\") (search-failed 'none))",
+                     "none");
+
+    // Switching buffers.
+    ASSERT_OUTPUT_EQ(m, "(get-buffer \"other\")", "nil");
+    ASSERT_OUTPUT_EQ(m, "(with-current-buffer (get-buffer-create \"other\") (insert \"abc\") "
+                     "(buffer-name))", "\"other\"");
+    ASSERT_OUTPUT_EQ(m, "(buffer-name)", "\"*scratch*\"");
+    ASSERT_OUTPUT_EQ(m, "(list (buffer-size \"other\") (buffer-size))", "(3 14)");
+    ASSERT_OUTPUT_EQ(m, "(progn (set-buffer \"other\") (buffer-string))", "\"abc\"");
+    ASSERT_OUTPUT_EQ(m, "(eq (current-buffer) (get-buffer \"other\"))", "t");
+    ASSERT_OUTPUT_EQ(m, "(progn (kill-buffer) (list (get-buffer \"other\") (buffer-name)))",
+                     "(nil \"*scratch*\")");
+
+    // A long run of edits in the middle of a large buffer.
+    ASSERT_OUTPUT_EQ(m, R"code(
+(progn
+  (erase-buffer)
+  (let ((i 0))
+    (while (< i 2000)
+      (insert "ab")
+      (setq i (1+ i))))
+  (goto-char 2001)
+  (let ((i 0))
+    (while (< i 1000)
+      (insert "ä")
+      (delete-region (point) (1+ (point)))
+      (setq i (1+ i))))
+  (list (point) (buffer-size) (buffer-substring 2999 3003)))
+)code", "(3001 4000 \"ääab\")");
+}
+
 void test()
 {
     testListBasics();
@@ -1523,6 +2163,7 @@ void test()
     testMacros();
     testSequences();
     testErrors();
+    testNonLocalExits();
     testNullFunction();
     testCarFunction();
     testConverter();
@@ -1544,14 +2185,17 @@ void test()
     testKeywords();
     testNthFunction();
     testStrings();
+    testBuffers();
+    testRopes();
+    testCaseConversion();
     testDescribeVariableFunction();
     testInternFunction();
     testEqFunction();
     testDivision();
     testSyntaxErrorDetection();
     //std::cout << "Remaining objects:\n";
-    //Object::printAllObjects();
-    assert(alisp::Object::getDebugRefCount() == 0);
+    //memoryStats().forEachSampled([](const Object& obj) { std::cout << obj << std::endl; });
+    assert(alisp::memoryStats().live(alisp::MemoryKind::Object) == 0);
     /*
 foo                 ; A symbol named ‘foo’.
 FOO                 ; A symbol named ‘FOO’, different from ‘foo’.
@@ -1580,7 +2224,7 @@ void eval(Machine& m, const std::string& expr, bool interactive)
         ex.onHandle(m);
         std::cerr << ex.getMessageString() << std::endl;
         std::cerr << "\nCall stack:\n";
-        std::cerr << ex.stackTrace << std::endl;
+        std::cerr << ex.stackTrace() << std::endl;
     }
     catch (exceptions::Exception& ex) {
         std::cerr << "An error was encountered:\n";
@@ -1622,7 +2266,7 @@ int main(int argc, char** argv)
             std::cerr << "Unhandled exception occurred:" << std::endl;
             std::cerr << error.getMessageString() << std::endl;
             std::cerr << "Call stack:\n";
-            std::cerr << error.stackTrace << std::endl;
+            std::cerr << error.stackTrace() << std::endl;
             return 1;
         }
         return 0;
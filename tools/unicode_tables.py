@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+"""Generates source/UnicodeTables.hpp from the Unicode character database.
+
+Usage: unicode_tables.py UCD_DIR [OUTPUT]
+
+UCD_DIR must contain UnicodeData.txt and SpecialCasing.txt of the wanted Unicode version, as
+found at https://www.unicode.org/Public/<version>/ucd/. Run it again and commit the result to
+move to a new version of Unicode.
+
+The properties of every code point are looked up in two stages: the high bits of the code point
+select a block and the low bits an entry within it. Equal blocks are stored once, and so are
+equal entries, which keeps the tables small although they cover all of Unicode.
+"""
+
+import os
+import re
+import sys
+
+CATEGORIES = ['Lu', 'Ll', 'Lt', 'Lm', 'Lo', 'Mn', 'Mc', 'Me', 'Nd', 'Nl', 'No', 'Pc', 'Pd',
+              'Ps', 'Pe', 'Pi', 'Pf', 'Po', 'Sm', 'Sc', 'Sk', 'So', 'Zs', 'Zl', 'Zp', 'Cc',
+              'Cf', 'Cs', 'Co', 'Cn']
+
+MAX_CHAR = 0x10ffff
+
+
+def read_unicode_data(path):
+    category = ['Cn'] * (MAX_CHAR + 1)
+    upper, lower, title = {}, {}, {}
+    first = None
+    with open(path, encoding='utf-8') as f:
+        for line in f:
+            fields = line.rstrip('\n').split(';')
+            if len(fields) < 15:
+                continue
+            cp = int(fields[0], 16)
+            if fields[1].endswith(', First>'):
+                first = cp
+                continue
+            start = first if fields[1].endswith(', Last>') else cp
+            first = None
+            for c in range(start, cp + 1):
+                category[c] = fields[2]
+            if fields[12]:
+                upper[cp] = int(fields[12], 16)
+            if fields[13]:
+                lower[cp] = int(fields[13], 16)
+            if fields[14]:
+                title[cp] = int(fields[14], 16)
+    return category, upper, lower, title
+
+
+def read_special_casing(path):
+    special = {}
+    version = None
+    with open(path, encoding='utf-8') as f:
+        for line in f:
+            match = re.match(r'# SpecialCasing-([0-9.]+)\.txt', line)
+            if match:
+                version = match.group(1)
+            data = line.split('#')[0].strip()
+            if not data:
+                continue
+            fields = [field.strip() for field in data.split(';')]
+            if len(fields) > 4 and fields[4]:
+                continue  # Depends on the context or the language
+            cp = int(fields[0], 16)
+            lower, title, upper = ([int(c, 16) for c in field.split()] for field in fields[1:4])
+            special[cp] = (upper, lower, title)
+    return special, version
+
+
+def c_string(codepoints):
+    return '"' + ''.join('\\x%02x' % b for b in ''.join(map(chr, codepoints)).encode()) + '"'
+
+
+def wrap(items, width=100):
+    lines, line = [], '   '
+    for item in items:
+        if len(line) + len(item) + 2 > width:
+            lines.append(line.rstrip())
+            line = '   '
+        line += ' ' + item + ','
+    return lines + [line.rstrip(',')]
+
+
+def array(out, ctype, name, values):
+    out.append('inline constexpr %s %s[] = {' % (ctype, name))
+    out += wrap([str(v) for v in values])
+    out.append('};')
+    out.append('')
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    ucd = sys.argv[1]
+    output = sys.argv[2] if len(sys.argv) > 2 else os.path.join(
+        os.path.dirname(os.path.abspath(__file__)), '..', 'source', 'UnicodeTables.hpp')
+
+    category, upper, lower, title = read_unicode_data(os.path.join(ucd, 'UnicodeData.txt'))
+    special, version = read_special_casing(os.path.join(ucd, 'SpecialCasing.txt'))
+
+    # Only the mappings which simple ones do not cover need a special entry.
+    special_list = []
+    special_index = {}
+    for cp in sorted(special):
+        mapped = special[cp]
+        simple = ([upper.get(cp, cp)], [lower.get(cp, cp)], [title.get(cp, upper.get(cp, cp))])
+        if tuple(mapped) != simple:
+            special_index[cp] = len(special_list)
+            special_list.append(mapped)
+
+    # Unassigned code points come first so that their properties are entry zero.
+    properties = [(CATEGORIES.index('Cn'), 0, 0, 0, -1)]
+    property_index = {properties[0]: 0}
+    entries = []
+    for cp in range(MAX_CHAR + 1):
+        up = upper.get(cp, cp)
+        key = (CATEGORIES.index(category[cp]), up - cp, lower.get(cp, cp) - cp,
+               title.get(cp, up) - cp, special_index.get(cp, -1))
+        if key not in property_index:
+            property_index[key] = len(properties)
+            properties.append(key)
+        entries.append(property_index[key])
+
+    # The block size which makes the tables smallest.
+    best = None
+    for shift in range(4, 11):
+        size = 1 << shift
+        blocks, block_index, stage1 = [], {}, []
+        for start in range(0, MAX_CHAR + 1, size):
+            block = tuple(entries[start:start + size])
+            if block not in block_index:
+                block_index[block] = len(blocks)
+                blocks.append(block)
+            stage1.append(block_index[block])
+        stage1_bytes = len(stage1) * (1 if len(blocks) <= 256 else 2)
+        total = stage1_bytes + len(blocks) * size * 2
+        if not best or total < best[0]:
+            best = (total, shift, stage1, blocks)
+    _, shift, stage1, blocks = best
+    stage1_type = 'std::uint8_t' if len(blocks) <= 256 else 'std::uint16_t'
+
+    out = [
+        '#pragma once',
+        '// Generated by tools/unicode_tables.py from the Unicode %s character database. Do not'
+        % version,
+        '// edit, run the script again instead.',
+        '#include <cstdint>',
+        '',
+        'namespace alisp',
+        '{',
+        '',
+        'namespace unicode',
+        '{',
+        '',
+        '// General categories, in the order of the Unicode standard.',
+        'enum Category : std::uint8_t',
+        '{',
+    ] + wrap(CATEGORIES) + [
+        '};',
+        '',
+        'namespace tables',
+        '{',
+        '',
+        'inline constexpr const char* categoryNames[] = {',
+    ] + wrap(['"%s"' % c for c in CATEGORIES]) + [
+        '};',
+        '',
+        '// Case mappings are stored as differences to the code point, which many share.',
+        'struct Properties',
+        '{',
+        '    Category category;',
+        '    std::int32_t upper;',
+        '    std::int32_t lower;',
+        '    std::int32_t title;',
+        '    std::int16_t special; // Index in specialCasing or -1',
+        '};',
+        '',
+        '// Mappings of a character to several, in UTF-8.',
+        'struct SpecialCasing',
+        '{',
+        '    const char* upper;',
+        '    const char* lower;',
+        '    const char* title;',
+        '};',
+        '',
+        'constexpr int BlockShift = %d;' % shift,
+        '',
+        'inline constexpr Properties properties[] = {',
+    ]
+    for p in properties:
+        out.append('    {%s, %d, %d, %d, %d},' % (CATEGORIES[p[0]], p[1], p[2], p[3], p[4]))
+    out.append('};')
+    out.append('')
+    out.append('inline constexpr SpecialCasing specialCasing[] = {')
+    for cp, mapped in zip(sorted(special_index, key=special_index.get), special_list):
+        out.append('    {%s, %s, %s}, // U+%04X' % (c_string(mapped[0]), c_string(mapped[1]),
+                                                    c_string(mapped[2]), cp))
+    out.append('};')
+    out.append('')
+    array(out, stage1_type, 'blocks', stage1)
+    array(out, 'std::uint16_t', 'entries', [e for block in blocks for e in block])
+    out += ['}', '', '}', '', '}']
+
+    with open(output, 'w', encoding='utf-8') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+    main()